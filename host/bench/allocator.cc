@@ -0,0 +1,75 @@
+#include "bench.hh"
+#include <sys/pmm.hh>
+#include <sys/heap.h>
+
+
+static void pmm_allocate_free( bench_state &state )
+{
+    size_t count = (size_t) state.range();
+    for (auto _ : state)
+    {
+        uintptr_t address = pmm_allocate(count, PFT_ALLOCATED);
+        bench_keep(address);
+        pmm_free(address, count);
+    }
+}
+BENCHMARK_ARG(pmm_allocate_free, 1);
+BENCHMARK_ARG(pmm_allocate_free, 16);
+
+/*
+ * Allocate frames while the first ones are taken, so every allocation has to
+ * skip them.
+ */
+static void pmm_allocate_fragmented( bench_state &state )
+{
+    static uintptr_t taken[256];
+    size_t count = (size_t) state.range();
+    for (size_t i = 0; i < count; ++i)
+        taken[i] = pmm_allocate(1, PFT_ALLOCATED);
+    // release every other frame
+    for (size_t i = 0; i < count; i += 2)
+        pmm_free(taken[i], 1);
+
+    for (auto _ : state)
+    {
+        uintptr_t address = pmm_allocate(2, PFT_ALLOCATED);
+        bench_keep(address);
+        pmm_free(address, 2);
+    }
+
+    for (size_t i = 1; i < count; i += 2)
+        pmm_free(taken[i], 1);
+}
+BENCHMARK_ARG(pmm_allocate_fragmented, 256);
+
+static void heap_allocate_free( bench_state &state )
+{
+    size_t size = (size_t) state.range();
+    for (auto _ : state)
+    {
+        void *ptr = heap_allocate(size);
+        bench_keep(ptr);
+        heap_free(ptr);
+    }
+}
+BENCHMARK_ARG(heap_allocate_free, 16);
+BENCHMARK_ARG(heap_allocate_free, 500);
+BENCHMARK_ARG(heap_allocate_free, 4000);
+BENCHMARK_ARG(heap_allocate_free, 1000000);
+
+/*
+ * Allocate a batch of blocks of different sizes and release them.
+ */
+static void heap_allocate_batch( bench_state &state )
+{
+    static void *blocks[64];
+    size_t count = (size_t) state.range();
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < count; ++i)
+            blocks[i] = heap_allocate(16 + (i % 8) * 24);
+        for (size_t i = 0; i < count; ++i)
+            heap_free(blocks[i]);
+    }
+}
+BENCHMARK_ARG(heap_allocate_batch, 64);
@@ -0,0 +1,145 @@
+/**
+ * Microbenchmarks for the host build, in the style of Google Benchmark:
+ *
+ *   static void heap_allocate_free( bench_state &state )
+ *   {
+ *       for (auto _ : state)
+ *           heap_free(heap_allocate(state.range()));
+ *   }
+ *   BENCHMARK_ARG(heap_allocate_free, 32);
+ *
+ * The loop body is measured. Its iteration count grows until the loop runs
+ * for at least the minimum time ('--min-time=<ms>', 500 ms by default), then
+ * the mean time per iteration is reported. '--filter=<text>' runs only the
+ * benchmarks whose name contains the text.
+ */
+
+#ifndef MACHINA_HOST_BENCH_HH
+#define MACHINA_HOST_BENCH_HH
+
+
+#include <sys/types.h>
+#include <sys/host.h>
+
+
+class bench_state
+{
+	public:
+		struct iterator
+		{
+			bench_state *state;
+			uint64_t remaining;
+
+			bool operator!=( const iterator & ) const
+			{
+				if (remaining != 0) return true;
+				state->stop();
+				return false;
+			}
+
+			void operator++()
+			{
+				--remaining;
+			}
+
+			struct __attribute__((unused)) value {};
+
+			value operator*() const
+			{
+				return value();
+			}
+		};
+
+		bench_state( uint64_t iterations, int64_t argument ) : iterations(iterations),
+			argument(argument), elapsed(0), started(0)
+		{
+		}
+
+		iterator begin()
+		{
+			started = host_time_ns();
+			return iterator{this, iterations};
+		}
+
+		iterator end()
+		{
+			return iterator{this, 0};
+		}
+
+		/**
+		 * Stop measuring (e.g. while preparing the next iteration).
+		 */
+		void pause()
+		{
+			stop();
+		}
+
+		void resume()
+		{
+			started = host_time_ns();
+		}
+
+		int64_t range() const
+		{
+			return argument;
+		}
+
+		uint64_t get_iterations() const
+		{
+			return iterations;
+		}
+
+		uint64_t get_elapsed() const
+		{
+			return elapsed;
+		}
+
+	private:
+		uint64_t iterations;
+		int64_t argument;
+		uint64_t elapsed;
+		uint64_t started;
+
+		void stop()
+		{
+			elapsed += host_time_ns() - started;
+		}
+};
+
+typedef void (*bench_func_t)( bench_state &state );
+
+struct bench_case
+{
+	const char *name;
+	bench_func_t func;
+	int64_t argument;
+	struct bench_case *next;
+};
+
+void bench_add( struct bench_case *bench );
+
+/**
+ * Prevent the compiler from removing the computation of @c value.
+ */
+template<typename T>
+static inline void bench_keep( const T &value )
+{
+	__asm__ volatile ("" :: "r" (&value) : "memory");
+}
+
+#define BENCHMARK_ARG(func, arg) \
+	__attribute__((constructor)) static void bench_add_##func##_##arg() \
+	{ \
+		static struct bench_case bench = { #func "/" #arg, func, (arg), nullptr }; \
+		bench_add(&bench); \
+	}
+
+#define BENCHMARK(func) \
+	__attribute__((constructor)) static void bench_add_##func() \
+	{ \
+		static struct bench_case bench = { #func, func, 0, nullptr }; \
+		bench_add(&bench); \
+	}
+
+
+#endif // MACHINA_HOST_BENCH_HH
@@ -0,0 +1,110 @@
+#include "bench.hh"
+#include <sys/Font.hh>
+#include <sys/host.h>
+#include <mc/stdio.h>
+
+
+using machina::Font;
+
+#define SCREEN_WIDTH   640
+#define SCREEN_HEIGHT  480
+
+struct font_file
+{
+    const char *name;
+    uint8_t *data;
+    size_t size;
+};
+
+static font_file FONTS[] =
+{
+    { "Tamzen8x16.psf", nullptr, 0 },
+    { "Tamzen10x20.psf", nullptr, 0 },
+};
+
+static const font_file &get_font_file( int64_t index )
+{
+    font_file &file = FONTS[index];
+    if (file.data == nullptr)
+    {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", MACHINA_FONTS_DIR, file.name);
+        if (host_read_file(path, &file.data, &file.size) != 0)
+        {
+            printf("Unable to read '%s'\n", path);
+            host_exit(1);
+        }
+    }
+    return file;
+}
+
+static void font_load( bench_state &state )
+{
+    const font_file &file = get_font_file(state.range());
+    for (auto _ : state)
+    {
+        const Font *font = Font::load(file.data, file.size);
+        bench_keep(font);
+        delete font;
+    }
+}
+BENCHMARK_ARG(font_load, 0);
+BENCHMARK_ARG(font_load, 1);
+
+/*
+ * Same as 'TextScreen::draw'.
+ */
+static void draw_glyph( Color *buffer, const Font &font, char symbol, uint32_t posX,
+    uint32_t posY, Color foreground, Color background )
+{
+    uint32_t glyphW = (uint32_t) font.getGlyphWidth();
+    uint32_t glyphH = (uint32_t) font.getGlyphHeight();
+    const uint8_t *glyph = font.getGlyph((uint8_t) symbol);
+
+    for (uint32_t y = 0; y < glyphH; ++y)
+    {
+        uint32_t offset = (y + posY) * SCREEN_WIDTH + posX;
+        uint32_t glyphIndex = y * glyphW;
+
+        for (uint32_t x = 0; x < glyphW; ++x)
+        {
+            if (glyph[glyphIndex + x] != 0)
+                buffer[offset + x] = foreground;
+            else
+                buffer[offset + x] = background;
+        }
+    }
+}
+
+/*
+ * Fill the screen with text.
+ */
+static void font_draw_screen( bench_state &state )
+{
+    static Color buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    static const char TEXT[] = "Machina - the quick brown fox jumps over the lazy dog 0123456789";
+
+    const font_file &file = get_font_file(state.range());
+    const Font *font = Font::load(file.data, file.size);
+    uint32_t columns = SCREEN_WIDTH / (uint32_t) font->getGlyphWidth();
+    uint32_t rows = SCREEN_HEIGHT / (uint32_t) font->getGlyphHeight();
+
+    for (auto _ : state)
+    {
+        size_t k = 0;
+        for (uint32_t row = 0; row < rows; ++row)
+        {
+            for (uint32_t column = 0; column < columns; ++column)
+            {
+                draw_glyph(buffer, *font, TEXT[k], column * (uint32_t) font->getGlyphWidth(),
+                    row * (uint32_t) font->getGlyphHeight(), 0xFFFF, 0x0000);
+                if (++k == sizeof(TEXT) - 1) k = 0;
+            }
+        }
+        bench_keep(buffer);
+    }
+
+    delete font;
+}
+BENCHMARK_ARG(font_draw_screen, 0);
+BENCHMARK_ARG(font_draw_screen, 1);
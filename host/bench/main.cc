@@ -0,0 +1,100 @@
+#include "bench.hh"
+#include <sys/pmm.hh>
+#include <sys/host.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+
+#define BENCH_MAX_ITERATIONS  (1ULL << 32)
+
+static struct bench_case *first = nullptr;
+static struct bench_case *last = nullptr;
+
+void bench_add( struct bench_case *bench )
+{
+    if (last)
+        last->next = bench;
+    else
+        first = bench;
+    last = bench;
+}
+
+static bool bench_match( const char *name, const char *filter )
+{
+    if (filter == nullptr) return true;
+    size_t length = strlen(filter);
+    for (; *name; ++name)
+        if (strncmp(name, filter, length) == 0) return true;
+    return length == 0;
+}
+
+static bool parse_option( const char *arg, const char *name, const char **value )
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') return false;
+    *value = arg + length + 1;
+    return true;
+}
+
+static uint64_t parse_number( const char *text )
+{
+    uint64_t value = 0;
+    for (; *text >= '0' && *text <= '9'; ++text)
+        value = value * 10 + (uint64_t) (*text - '0');
+    return value;
+}
+
+int main( int argc, char **argv )
+{
+    const char *filter = nullptr;
+    uint64_t min_time = 500 * 1000000ULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *value;
+        if (parse_option(argv[i], "--filter", &value))
+            filter = value;
+        else
+        if (parse_option(argv[i], "--min-time", &value))
+            min_time = parse_number(value) * 1000000ULL;
+        else
+        {
+            printf("Usage: %s [--filter=<text>] [--min-time=<ms>]\n", argv[0]);
+            host_exit(1);
+        }
+    }
+
+    host_pmm_initialize();
+
+    printf("%-40s %14s %12s\n", "Benchmark", "Time (ns)", "Iterations");
+    printf("------------------------------------------------------------------\n");
+    for (struct bench_case *bench = first; bench; bench = bench->next)
+    {
+        if (!bench_match(bench->name, filter)) continue;
+
+        // grow the iteration count until the run is long enough
+        uint64_t iterations = 1;
+        uint64_t elapsed = 0;
+        while (true)
+        {
+            bench_state state(iterations, bench->argument);
+            bench->func(state);
+            elapsed = state.get_elapsed();
+            if (elapsed >= min_time || iterations >= BENCH_MAX_ITERATIONS) break;
+
+            // aim 40% beyond the minimum time, growing at most 10 times
+            uint64_t next = (elapsed == 0) ? iterations * 10 :
+                (min_time + min_time * 2 / 5) / elapsed * iterations;
+            if (next > iterations * 10) next = iterations * 10;
+            if (next <= iterations) next = iterations + 1;
+            iterations = next;
+        }
+
+        // nanoseconds with one decimal place
+        uint64_t time = elapsed * 10 / iterations;
+        printf("%-40s %12llu.%llu %12llu\n", bench->name,
+            (unsigned long long) (time / 10), (unsigned long long) (time % 10),
+            (unsigned long long) iterations);
+    }
+
+    host_exit(0);
+}
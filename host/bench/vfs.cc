@@ -0,0 +1,83 @@
+#include "bench.hh"
+#include <sys/vfs.h>
+#include <sys/procfs.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+
+static int proc_numbers( uint8_t *buffer, int size, void *data )
+{
+    (void) data;
+
+    char *p = (char*) buffer;
+    p[0] = 0;
+    for (int i = 0; i < 64; ++i)
+        sncatprintf(p, (size_t) size, "%-8d 0x%08x\n", i, i * 4096);
+    return (int) strlen(p);
+}
+
+static void setup()
+{
+    static bool ready = false;
+    if (ready) return;
+    vfs_initialize();
+    procfs_initialize();
+    vfs_mount("procfs", "none", "/proc", "", 0, nullptr);
+    // some mount points to walk through in every lookup
+    vfs_mount("procfs", "none", "/proc/a", "", 0, nullptr);
+    vfs_mount("procfs", "none", "/proc/b", "", 0, nullptr);
+    vfs_mount("procfs", "none", "/mnt", "", 0, nullptr);
+    for (int i = 0; i < 16; ++i)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "/file%d", i);
+        procfs_register(name, proc_numbers, nullptr);
+    }
+    procfs_register("/numbers", proc_numbers, nullptr);
+    ready = true;
+}
+
+static void vfs_lookup_path( bench_state &state )
+{
+    setup();
+    for (auto _ : state)
+    {
+        struct mount *mp;
+        const char *rest;
+        int result = vfs_lookup("/proc/numbers", &mp, &rest);
+        vfs_release(mp);
+        bench_keep(result);
+    }
+}
+BENCHMARK(vfs_lookup_path);
+
+static void vfs_open_close( bench_state &state )
+{
+    setup();
+    for (auto _ : state)
+    {
+        struct file *fp = nullptr;
+        vfs_open("/proc/numbers", 0, &fp);
+        vfs_close(fp);
+    }
+}
+BENCHMARK(vfs_open_close);
+
+/*
+ * Read the whole file in chunks of the given size.
+ */
+static void vfs_open_read_close( bench_state &state )
+{
+    setup();
+    static uint8_t buffer[4096];
+    size_t chunk = (size_t) state.range();
+    for (auto _ : state)
+    {
+        struct file *fp = nullptr;
+        vfs_open("/proc/numbers", 0, &fp);
+        while (vfs_read(fp, buffer, chunk) > 0);
+        vfs_close(fp);
+    }
+}
+BENCHMARK_ARG(vfs_open_read_close, 64);
+BENCHMARK_ARG(vfs_open_read_close, 4096);
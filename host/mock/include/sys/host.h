@@ -0,0 +1,64 @@
+#ifndef MACHINA_HOST_H
+#define MACHINA_HOST_H
+
+/*
+ * Services of the host operating system for the mocks, tests and benchmarks.
+ * They are implemented with the C library in 'mock/source/platform.c', since
+ * the kernel sources are built without the host headers.
+ *
+ * The physical memory of the kernel is emulated by an anonymous mapping at
+ * HOST_MEMORY_BEGIN (the start of the frame table) up to HOST_MEMORY_END (the
+ * amount of "ARM memory" reported by the mailbox mock), so the physical
+ * memory manager and the heap use their addresses as they do in the target.
+ */
+
+#include <sys/types.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Map the emulated physical memory (only once). Aborts on failure.
+ */
+void host_map_memory();
+
+/**
+ * Initialize the physical memory manager with the memory splits reported by
+ * the mailbox mock, as the boot does.
+ */
+void host_pmm_initialize();
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+uint64_t host_time_ns();
+
+/**
+ * Write to the standard output.
+ */
+void host_putchar( char c );
+
+/**
+ * Write UART output to the standard error, if the environment variable
+ * MACHINA_UART is set.
+ */
+void host_uart( const char *text );
+
+/**
+ * Read the whole file at @c path into a buffer that must be released with
+ * @ref host_free. Returns zero on success.
+ */
+int host_read_file( const char *path, uint8_t **data, size_t *size );
+
+void host_free( void *ptr );
+
+void host_exit( int code ) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_HOST_H
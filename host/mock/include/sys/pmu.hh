@@ -0,0 +1,31 @@
+#ifndef MACHINA_PMU_HH
+#define MACHINA_PMU_HH
+
+/*
+ * Host version of 'kernel/include/sys/pmu.hh'. Regions are not measured (use
+ * the host profilers instead).
+ */
+
+#include <sys/types.h>
+
+
+struct pmu_region
+{
+	const char *name;
+};
+
+#define PMU_REGION_INITIALIZER(name)  { (name) }
+
+struct pmu_scope
+{
+	pmu_scope( struct pmu_region *region )
+	{
+		(void) region;
+	}
+
+	pmu_scope( const pmu_scope& ) = delete;
+	pmu_scope &operator=( const pmu_scope& ) = delete;
+};
+
+
+#endif // MACHINA_PMU_HH
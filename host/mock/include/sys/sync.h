@@ -0,0 +1,99 @@
+#ifndef MACHINA_SYNC_H
+#define MACHINA_SYNC_H
+
+/*
+ * Host version of 'kernel/include/sys/sync.h'. The API is the same, but there
+ * are no interrupts to mask and no events to wait for.
+ */
+
+#include <sys/types.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#define	sync_enableInterrupts()	\
+	do { } while (0)
+
+#define	sync_disableInterrupts() \
+	do { } while (0)
+
+#define sync_dataSyncBarrier() \
+	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define sync_dataMemBarrier() \
+	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define sync_instSyncBarrier() \
+	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define sync_instMemBarrier() \
+	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#define sync_sendEvent() \
+	__asm__ volatile ("" ::: "memory")
+
+#define sync_waitEvent() \
+	__asm__ volatile ("" ::: "memory")
+
+#define sync_compilerBarrier() \
+	__asm__ volatile ("" ::: "memory")
+
+
+typedef struct
+{
+	volatile uint32_t value;
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER   { 0 }
+
+static inline void spin_lock( spinlock_t *lock )
+{
+	while (__atomic_exchange_n(&lock->value, 1U, __ATOMIC_ACQUIRE) != 0)
+	{
+		while (__atomic_load_n(&lock->value, __ATOMIC_RELAXED) != 0)
+			sync_waitEvent();
+	}
+}
+
+static inline bool spin_trylock( spinlock_t *lock )
+{
+	return __atomic_exchange_n(&lock->value, 1U, __ATOMIC_ACQUIRE) == 0;
+}
+
+static inline void spin_unlock( spinlock_t *lock )
+{
+	__atomic_store_n(&lock->value, 0U, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t sync_saveInterrupts()
+{
+	return 0;
+}
+
+static inline void sync_restoreInterrupts( uint64_t flags )
+{
+	(void) flags;
+}
+
+static inline uint64_t spin_lock_irqsave( spinlock_t *lock )
+{
+	spin_lock(lock);
+	return 0;
+}
+
+static inline void spin_unlock_irqrestore( spinlock_t *lock, uint64_t flags )
+{
+	(void) flags;
+	spin_unlock(lock);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_SYNC_H
@@ -0,0 +1,16 @@
+#ifndef MACHINA_TRACE_HH
+#define MACHINA_TRACE_HH
+
+/*
+ * Host version of 'kernel/include/sys/trace.hh'. There is no code patching, so
+ * every tracepoint is always disabled (and its arguments are not evaluated).
+ */
+
+#include <sys/types.h>
+
+
+#define trace_event(name, ...) \
+	do { } while (0)
+
+
+#endif // MACHINA_TRACE_HH
@@ -0,0 +1,130 @@
+/*
+ * Mocks of the kernel services used by the subsystems built for the host:
+ * the UART, the mailbox, the scheduler and RCU (everything runs in a single
+ * thread, so grace periods end immediately).
+ */
+
+#include <sys/types.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <sys/mailbox.h>
+#include <sys/pmm.hh>
+#include <sys/task.h>
+#include <sys/rcu.h>
+#include <sys/host.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+
+//
+// UART
+//
+
+void uart_init()
+{
+}
+
+void uart_putc( uint8_t c )
+{
+    char text[2] = { (char) c, 0 };
+    host_uart(text);
+}
+
+void uart_puts( const char *str )
+{
+    host_uart(str);
+}
+
+void uart_print( const char *format, ... )
+{
+    char text[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    host_uart(text);
+}
+
+void _putchar( char c )
+{
+    host_putchar(c);
+}
+
+//
+// Mailbox
+//
+
+int mailbox_batch_submit( struct mailbox_batch *batch )
+{
+    uint32_t size = mailbox_batch_finish(batch);
+    uint32_t *end = batch->message + size / 4;
+
+    // answer the tags known by the mock; the others are left unanswered
+    uint32_t *word = batch->message + 2;
+    while (word < end && *word != 0)
+    {
+        struct mailbox_tag_header *header = (struct mailbox_tag_header*) word;
+        struct memory_tag *memory = (struct memory_tag*) header;
+        switch (header->id)
+        {
+            case MAILBOX_TAG_GET_ARM_MEMORY:
+                host_map_memory();
+                memory->base = 0;
+                memory->size = HOST_MEMORY_END;
+                header->code = MAILBOX_RESPONSE_BIT | 8;
+                break;
+            case MAILBOX_TAG_GET_VC_MEMORY:
+                memory->base = HOST_MEMORY_END;
+                memory->size = 0;
+                header->code = MAILBOX_RESPONSE_BIT | 8;
+                break;
+        }
+        word += sizeof(struct mailbox_tag_header) / 4 + header->size / 4;
+    }
+
+    batch->message[1] = MAILBOX_CODE_RESPONSE_OK;
+    return mailbox_batch_status(batch);
+}
+
+//
+// Kernel
+//
+
+void kernel_panic( const char *path, int line )
+{
+    uart_print("KERNEL PANIC!   at %s:%d\n", path, line);
+    printf("KERNEL PANIC!   at %s:%d\n", path, line);
+    host_exit(1);
+}
+
+void host_pmm_initialize()
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+    struct memory_tag *arm = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_ARM_MEMORY, struct memory_tag);
+    struct memory_tag *vc = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_VC_MEMORY, struct memory_tag);
+    if (mailbox_batch_submit(&batch) != EOK) kernel_panic(__FILE__, __LINE__);
+    pmm_initialize(arm, vc);
+}
+
+void task_preempt_disable()
+{
+}
+
+void task_preempt_enable()
+{
+}
+
+void rcu_synchronize()
+{
+}
+
+void rcu_call( struct rcu_head *head, rcu_func_t func )
+{
+    func(head);
+}
+
+void *memzero32( void *ptr, size_t size )
+{
+    return memset(ptr, 0, size);
+}
@@ -0,0 +1,90 @@
+/*
+ * Host services (see 'sys/host.h'). This is the only source built with the
+ * headers of the host C library.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/host.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+
+void host_map_memory()
+{
+	static int mapped = 0;
+	if (mapped) return;
+
+	void *begin = (void*) (uintptr_t) HOST_MEMORY_BEGIN;
+	size_t size = (size_t) (HOST_MEMORY_END - HOST_MEMORY_BEGIN);
+	void *addr = mmap(begin, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+	if (addr != begin)
+	{
+		fprintf(stderr, "Unable to map the physical memory at %p (%zu bytes)\n", begin, size);
+		abort();
+	}
+	mapped = 1;
+}
+
+uint64_t host_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void host_putchar( char c )
+{
+	putchar(c);
+}
+
+void host_uart( const char *text )
+{
+	static int enabled = -1;
+	if (enabled < 0) enabled = getenv("MACHINA_UART") != NULL;
+	if (enabled) fputs(text, stderr);
+}
+
+int host_read_file( const char *path, uint8_t **data, size_t *size )
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) return -1;
+
+	fseek(fp, 0, SEEK_END);
+	long length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	int result = -1;
+	uint8_t *buffer = (length > 0) ? (uint8_t*) malloc((size_t) length) : NULL;
+	if (buffer && fread(buffer, 1, (size_t) length, fp) == (size_t) length)
+	{
+		*data = buffer;
+		*size = (size_t) length;
+		result = 0;
+	}
+	else
+		free(buffer);
+
+	fclose(fp);
+	return result;
+}
+
+void host_free( void *ptr )
+{
+	free(ptr);
+}
+
+void host_exit( int code )
+{
+	fflush(stdout);
+	exit(code);
+}
@@ -0,0 +1,64 @@
+#include "test.hh"
+#include <sys/Font.hh>
+#include <sys/host.h>
+#include <mc/stdio.h>
+
+
+using machina::Font;
+
+static const Font *load_font( const char *name )
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", MACHINA_FONTS_DIR, name);
+
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    if (host_read_file(path, &data, &size) != 0) return nullptr;
+    const Font *font = Font::load(data, size);
+    host_free(data);
+    return font;
+}
+
+static int count_pixels( const Font *font, uint32_t code )
+{
+    const uint8_t *glyph = font->getGlyph(code);
+    int count = 0;
+    for (size_t i = 0; i < font->getGlyphWidth() * font->getGlyphHeight(); ++i)
+    {
+        if (glyph[i] > 1) return -1;
+        count += glyph[i];
+    }
+    return count;
+}
+
+TEST(font_load_psf1)
+{
+    const Font *font = load_font("Tamzen8x16.psf");
+    CHECK(font != nullptr);
+    CHECK_EQ(font->getGlyphWidth(), 8);
+    CHECK_EQ(font->getGlyphHeight(), 16);
+    CHECK_EQ(count_pixels(font, ' '), 0);
+    CHECK(count_pixels(font, 'A') > 0);
+    delete font;
+}
+
+TEST(font_load_psf2)
+{
+    const Font *font = load_font("Tamzen10x20.psf");
+    CHECK(font != nullptr);
+    CHECK_EQ(font->getGlyphWidth(), 10);
+    CHECK_EQ(font->getGlyphHeight(), 20);
+    CHECK_EQ(count_pixels(font, ' '), 0);
+    CHECK(count_pixels(font, 'A') > 0);
+    // codes out of range use the first glyph
+    CHECK(font->getGlyph(0x100) == font->getGlyph(0));
+    delete font;
+}
+
+TEST(font_load_invalid)
+{
+    static const uint8_t data[16] = { 0 };
+    CHECK(Font::load(nullptr, 0) == nullptr);
+    CHECK(Font::load(data, 0) == nullptr);
+    CHECK(Font::load(data, sizeof(data)) == nullptr);
+}
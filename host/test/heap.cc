@@ -0,0 +1,65 @@
+#include "test.hh"
+#include <sys/heap.h>
+#include <sys/system.h>
+#include <sys/host.h>
+#include <mc/string.h>
+
+
+TEST(heap_allocate)
+{
+    uint8_t *first = (uint8_t*) heap_allocate(16);
+    uint8_t *second = (uint8_t*) heap_allocate(16);
+    CHECK(first != nullptr && second != nullptr);
+    CHECK(first != second);
+    CHECK((uintptr_t) first < HOST_MEMORY_END);
+
+    // blocks do not overlap
+    memset(first, 0xAA, 16);
+    memset(second, 0x55, 16);
+    for (int i = 0; i < 16; ++i)
+        CHECK(first[i] == 0xAA && second[i] == 0x55);
+
+    heap_free(first);
+    heap_free(second);
+}
+
+TEST(heap_reuse)
+{
+    void *first = heap_allocate(100);
+    CHECK(first != nullptr);
+    heap_free(first);
+    // freed blocks are reused by allocations of the same bucket
+    void *second = heap_allocate(120);
+    CHECK(second == first);
+    // and not by allocations of other buckets
+    void *third = heap_allocate(8);
+    CHECK(third != first);
+    heap_free(second);
+    heap_free(third);
+}
+
+TEST(heap_large)
+{
+    void *ptr = heap_allocate(1024 * 1024);
+    CHECK(ptr != nullptr);
+    memset(ptr, 0, 1024 * 1024);
+    heap_free(ptr);
+
+    // larger than the whole heap
+    CHECK(heap_allocate(SYS_KERNEL_HEAP_SIZE + 1) == nullptr);
+}
+
+TEST(heap_free_invalid)
+{
+    void *ptr = heap_allocate(32);
+    CHECK(ptr != nullptr);
+
+    // pointers not returned by 'heap_allocate' are ignored
+    static uint8_t buffer[64];
+    heap_free(buffer + 16);
+    heap_free(nullptr);
+
+    CHECK(heap_allocate(32) != ptr);
+    heap_free(ptr);
+    CHECK(heap_allocate(32) == ptr);
+}
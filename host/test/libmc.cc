@@ -0,0 +1,90 @@
+#include "test.hh"
+#include <mc/string.h>
+#include <mc/stdio.h>
+
+
+TEST(libmc_strlen)
+{
+    CHECK_EQ(strlen(""), 0);
+    CHECK_EQ(strlen("machina"), 7);
+    CHECK_EQ(strlen(nullptr), 0);
+}
+
+TEST(libmc_strcmp)
+{
+    CHECK_EQ(strcmp("abc", "abc"), 0);
+    CHECK(strcmp("abc", "abd") < 0);
+    CHECK(strcmp("abd", "abc") > 0);
+    CHECK(strcmp("ab", "abc") < 0);
+    CHECK_EQ(strncmp("abcx", "abcy", 3), 0);
+    CHECK(strncmp("abcx", "abcy", 4) < 0);
+    CHECK_EQ(strncmp("abc", "xyz", 0), 0);
+}
+
+TEST(libmc_strcpy)
+{
+    char buffer[8];
+    memset(buffer, 'x', sizeof(buffer));
+    strcpy(buffer, "abc");
+    CHECK(strcmp(buffer, "abc") == 0);
+    CHECK(buffer[4] == 'x');
+
+    // pads with zeros
+    memset(buffer, 'x', sizeof(buffer));
+    strncpy(buffer, "ab", 6);
+    CHECK(buffer[0] == 'a' && buffer[1] == 'b');
+    for (int i = 2; i < 6; ++i) CHECK(buffer[i] == 0);
+    CHECK(buffer[6] == 'x');
+
+    // truncates without null-terminator
+    memset(buffer, 'x', sizeof(buffer));
+    strncpy(buffer, "abcdefgh", 4);
+    CHECK(strncmp(buffer, "abcd", 4) == 0);
+    CHECK(buffer[4] == 'x');
+}
+
+TEST(libmc_memory)
+{
+    static uint8_t source[256];
+    static uint8_t target[256];
+    for (int i = 0; i < 256; ++i) source[i] = (uint8_t) i;
+
+    CHECK(memcpy(target, source, sizeof(source)) == target);
+    for (int i = 0; i < 256; ++i) CHECK(target[i] == i);
+
+    CHECK(memset(target + 1, 0x7F, 10) == target + 1);
+    CHECK(target[0] == 0 && target[1] == 0x7F && target[10] == 0x7F && target[11] == 11);
+
+    memset4(target, 0x5A, 16);
+    for (int i = 0; i < 16; ++i) CHECK(target[i] == 0x5A);
+    CHECK(target[16] == 16);
+}
+
+TEST(libmc_snprintf)
+{
+    char buffer[64];
+    CHECK_EQ(snprintf(buffer, sizeof(buffer), "%d %u %x", -42, 42U, 0xBEEF), 11);
+    CHECK(strcmp(buffer, "-42 42 beef") == 0);
+
+    snprintf(buffer, sizeof(buffer), "[%08X] [%-4d] [%4s]", 0xABCU, 7, "ab");
+    CHECK(strcmp(buffer, "[00000ABC] [7   ] [  ab]") == 0);
+
+    snprintf(buffer, sizeof(buffer), "%lu %lld", 1UL << 40, -(1LL << 40));
+    CHECK(strcmp(buffer, "1099511627776 -1099511627776") == 0);
+
+    // truncated output is still null-terminated
+    CHECK_EQ(snprintf(buffer, 4, "%s", "machina"), 7);
+    CHECK(strcmp(buffer, "mac") == 0);
+}
+
+TEST(libmc_sncatprintf)
+{
+    char buffer[16];
+    buffer[0] = 0;
+    sncatprintf(buffer, sizeof(buffer), "%s", "abc");
+    sncatprintf(buffer, sizeof(buffer), "-%d", 12);
+    CHECK(strcmp(buffer, "abc-12") == 0);
+    // never writes past the buffer
+    sncatprintf(buffer, sizeof(buffer), "%s", "0123456789abcdef");
+    CHECK_EQ(strlen(buffer), sizeof(buffer) - 1);
+}
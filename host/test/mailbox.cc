@@ -0,0 +1,80 @@
+#include "test.hh"
+#include <sys/mailbox.h>
+#include <sys/errors.h>
+#include <sys/system.h>
+
+
+#define TAG_HEADER_WORDS  (sizeof(struct mailbox_tag_header) / 4)
+
+TEST(mailbox_batch_layout)
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+    // the message owns whole cache lines of the storage
+    CHECK_EQ((uintptr_t) batch.message % CACHE_LINE_SIZE, 0);
+    CHECK((uint8_t*) batch.message + MAILBOX_BATCH_SIZE <= (uint8_t*) batch.storage + sizeof(batch.storage));
+
+    struct memory_tag *memory = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_ARM_MEMORY, struct memory_tag);
+    struct mac_tag *mac = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_BOARD_MAC_ADDRESS, struct mac_tag);
+    CHECK(memory != nullptr && mac != nullptr);
+
+    // tags follow each other after the size and the code
+    CHECK_EQ((uint32_t*) memory - batch.message, 2);
+    CHECK_EQ((uint32_t*) mac - (uint32_t*) memory, TAG_HEADER_WORDS + 2);
+    CHECK_EQ(memory->header.id, MAILBOX_TAG_GET_ARM_MEMORY);
+    CHECK_EQ(memory->header.size, 8);
+    CHECK_EQ(memory->header.code, MAILBOX_CODE_REQUEST);
+    CHECK_EQ(mac->header.size, 8);
+
+    // the end tag is included in the size
+    uint32_t size = mailbox_batch_finish(&batch);
+    CHECK_EQ(size, (2 + 2 * (TAG_HEADER_WORDS + 2) + 1) * 4);
+    CHECK_EQ(batch.message[0], size);
+    CHECK_EQ(batch.message[size / 4 - 1], 0);
+}
+
+TEST(mailbox_batch_padding)
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+
+    // value buffers are padded to 32 bits
+    struct mailbox_tag_header *first = mailbox_batch_add(&batch, MAILBOX_TAG_GET_BOARD_MODEL, 5);
+    struct mailbox_tag_header *second = mailbox_batch_add(&batch, MAILBOX_TAG_GET_BOARD_REVISION, 0);
+    CHECK(first != nullptr && second != nullptr);
+    CHECK_EQ(first->size, 8);
+    CHECK_EQ((uint32_t*) second - (uint32_t*) first, TAG_HEADER_WORDS + 2);
+    CHECK_EQ(second->size, 0);
+}
+
+TEST(mailbox_batch_full)
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+
+    // the size, the code, the tag header and the end tag must fit
+    uint32_t size = MAILBOX_BATCH_SIZE - (2 + TAG_HEADER_WORDS + 1) * 4;
+    CHECK(mailbox_batch_add(&batch, MAILBOX_TAG_GET_COMMAND_LINE, size + 4) == nullptr);
+    CHECK(mailbox_batch_add(&batch, MAILBOX_TAG_GET_COMMAND_LINE, size) != nullptr);
+    CHECK(mailbox_batch_add(&batch, MAILBOX_TAG_GET_BOARD_MODEL, 0) == nullptr);
+    CHECK_EQ(mailbox_batch_finish(&batch), MAILBOX_BATCH_SIZE);
+}
+
+TEST(mailbox_batch_submit)
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+    struct memory_tag *arm = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_ARM_MEMORY, struct memory_tag);
+    struct serial_tag *serial = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_BOARD_SERIAL, struct serial_tag);
+    struct memory_tag *vc = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_VC_MEMORY, struct memory_tag);
+
+    // responses are parsed in place
+    CHECK_EQ(mailbox_batch_submit(&batch), EOK);
+    CHECK(mailbox_batch_done(&arm->header));
+    CHECK_EQ(arm->size, HOST_MEMORY_END);
+    CHECK(mailbox_batch_done(&vc->header));
+    CHECK_EQ(vc->base, HOST_MEMORY_END);
+    // not answered by the mock
+    CHECK(!mailbox_batch_done(&serial->header));
+    CHECK(!mailbox_batch_done(nullptr));
+}
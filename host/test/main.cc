@@ -0,0 +1,63 @@
+#include "test.hh"
+#include <sys/pmm.hh>
+#include <sys/host.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+
+static struct test_case *first = nullptr;
+static struct test_case *last = nullptr;
+static bool failed;
+
+void test_add( struct test_case *test )
+{
+    if (last)
+        last->next = test;
+    else
+        first = test;
+    last = test;
+}
+
+void test_fail( const char *file, int line, const char *expr )
+{
+    printf("%s:%d: check failed: %s\n", file, line, expr);
+    failed = true;
+}
+
+void test_fail_value( const char *file, int line, const char *expr, int64_t actual, int64_t expected )
+{
+    printf("%s:%d: check failed: %s (got %lld, expected %lld)\n", file, line, expr,
+        (long long) actual, (long long) expected);
+    failed = true;
+}
+
+static bool test_selected( const char *name, int argc, char **argv )
+{
+    if (argc <= 1) return true;
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], name) == 0) return true;
+    return false;
+}
+
+int main( int argc, char **argv )
+{
+    // every subsystem depends on the physical memory
+    host_pmm_initialize();
+
+    int count = 0;
+    int failures = 0;
+    for (struct test_case *test = first; test; test = test->next)
+    {
+        if (!test_selected(test->name, argc, argv)) continue;
+
+        printf("[ RUN      ] %s\n", test->name);
+        failed = false;
+        test->func();
+        printf("%s %s\n", failed ? "[  FAILED  ]" : "[       OK ]", test->name);
+        ++count;
+        if (failed) ++failures;
+    }
+
+    printf("%d tests, %d failures\n", count, failures);
+    host_exit(failures == 0 && count > 0 ? 0 : 1);
+}
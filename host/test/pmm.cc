@@ -0,0 +1,77 @@
+#include "test.hh"
+#include <sys/pmm.hh>
+#include <sys/system.h>
+#include <sys/host.h>
+
+
+#define HEAP_FRAMES  ((HOST_MEMORY_END - SYS_HEAP_START) / SYS_PAGE_SIZE)
+
+TEST(pmm_initialize)
+{
+    host_pmm_initialize();
+    CHECK_EQ(kern_memory_map.heap.begin, SYS_HEAP_START);
+    CHECK_EQ(kern_memory_map.heap.end, HOST_MEMORY_END);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES);
+}
+
+TEST(pmm_allocate)
+{
+    host_pmm_initialize();
+    uintptr_t first = pmm_allocate(1, PFT_ALLOCATED);
+    CHECK(first != 0);
+    CHECK_EQ(first % SYS_PAGE_SIZE, 0);
+    CHECK(first >= kern_memory_map.heap.begin && first < kern_memory_map.heap.end);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES - 1);
+
+    // frames are allocated in sequence and are writable
+    uintptr_t second = pmm_allocate(4, PFT_ALLOCATED);
+    CHECK_EQ(second, first + SYS_PAGE_SIZE);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES - 5);
+    uint8_t *ptr = (uint8_t*) second;
+    ptr[0] = 0xAA;
+    ptr[4 * SYS_PAGE_SIZE - 1] = 0x55;
+    CHECK(ptr[0] == 0xAA && ptr[4 * SYS_PAGE_SIZE - 1] == 0x55);
+}
+
+TEST(pmm_allocate_invalid)
+{
+    host_pmm_initialize();
+    CHECK_EQ(pmm_allocate(0, PFT_ALLOCATED), 0);
+    // the tag must mark the frames as not free
+    CHECK_EQ(pmm_allocate(1, PFT_FREE), 0);
+    CHECK_EQ(pmm_allocate(1, PFT_DIRTY), 0);
+    CHECK_EQ(pmm_allocate_aligned(1, 4, PFT_FREE), 0);
+    CHECK_EQ(pmm_allocate(HEAP_FRAMES + 1, PFT_ALLOCATED), 0);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES);
+}
+
+TEST(pmm_free)
+{
+    host_pmm_initialize();
+    uintptr_t first = pmm_allocate(2, PFT_ALLOCATED);
+    uintptr_t second = pmm_allocate(2, PFT_ALLOCATED);
+    CHECK(first != 0 && second != 0);
+
+    pmm_free(first, 2);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES - 2);
+    // the released frames are the first ones to be reused
+    CHECK_EQ(pmm_allocate(1, PFT_ALLOCATED), first);
+    CHECK_EQ(pmm_allocate(1, PFT_ALLOCATED), first + SYS_PAGE_SIZE);
+    // not enough room between the allocations
+    CHECK_EQ(pmm_allocate(1, PFT_ALLOCATED), second + 2 * SYS_PAGE_SIZE);
+
+    // addresses out of the memory are ignored
+    pmm_free(HOST_MEMORY_END + SYS_PAGE_SIZE, 1);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES - 5);
+}
+
+TEST(pmm_allocate_aligned)
+{
+    host_pmm_initialize();
+    CHECK(pmm_allocate(1, PFT_ALLOCATED) != 0);
+
+    uintptr_t address = pmm_allocate_aligned(2, 16, PFT_ALLOCATED);
+    CHECK(address != 0);
+    CHECK_EQ(address % (16 * SYS_PAGE_SIZE), 0);
+    CHECK_EQ(pmm_available(), HEAP_FRAMES - 3);
+}
@@ -0,0 +1,65 @@
+/**
+ * Minimal unit test framework for the host build.
+ *
+ *   TEST(heap_reuse)
+ *   {
+ *       void *ptr = heap_allocate(16);
+ *       CHECK(ptr != nullptr);
+ *   }
+ *
+ * Tests run in the order they are defined, sharing the state of the kernel
+ * subsystems. A failed check ends the test. The test runner accepts test
+ * names as arguments to run only some of them.
+ */
+
+#ifndef MACHINA_HOST_TEST_HH
+#define MACHINA_HOST_TEST_HH
+
+
+#include <sys/types.h>
+
+
+struct test_case
+{
+	const char *name;
+	void (*func)();
+	struct test_case *next;
+};
+
+void test_add( struct test_case *test );
+
+void test_fail( const char *file, int line, const char *expr );
+
+void test_fail_value( const char *file, int line, const char *expr, int64_t actual, int64_t expected );
+
+
+#define TEST(name) \
+	static void test_##name(); \
+	__attribute__((constructor)) static void test_add_##name() \
+	{ \
+		static struct test_case test = { #name, test_##name, nullptr }; \
+		test_add(&test); \
+	} \
+	static void test_##name()
+
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { test_fail(__FILE__, __LINE__, #expr); return; } \
+	} while (0)
+
+/**
+ * Check whether two integers are equal, showing both values on failure.
+ */
+#define CHECK_EQ(actual, expected) \
+	do { \
+		int64_t actual_ = (int64_t) (actual); \
+		int64_t expected_ = (int64_t) (expected); \
+		if (actual_ != expected_) \
+		{ \
+			test_fail_value(__FILE__, __LINE__, #actual " == " #expected, actual_, expected_); \
+			return; \
+		} \
+	} while (0)
+
+
+#endif // MACHINA_HOST_TEST_HH
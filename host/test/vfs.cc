@@ -0,0 +1,155 @@
+#include "test.hh"
+#include <sys/vfs.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+
+static char last_write[64];
+
+static int proc_hello( uint8_t *buffer, int size, void *data )
+{
+    char *p = (char*) buffer;
+    p[0] = 0;
+    sncatprintf(p, (size_t) size, "hello %s\n", (const char*) data);
+    return (int) strlen(p);
+}
+
+static int proc_command( const uint8_t *buffer, int size, void *data )
+{
+    (void) data;
+    if (size >= (int) sizeof(last_write)) return ETOOLONG;
+    memcpy(last_write, buffer, (size_t) size);
+    last_write[size] = 0;
+    return size;
+}
+
+static void setup()
+{
+    static bool ready = false;
+    if (ready) return;
+    vfs_initialize();
+    procfs_initialize();
+    vfs_mount("procfs", "none", "/proc", "", 0, nullptr);
+    procfs_register("/hello", proc_hello, (void*) "world");
+    procfs_register_rw("/command", proc_hello, proc_command, (void*) "command");
+    ready = true;
+}
+
+static int read_file( const char *path, char *buffer, size_t size, size_t chunk )
+{
+    struct file *fp = nullptr;
+    int result = vfs_open(path, 0, &fp);
+    if (result < 0) return result;
+
+    // keep room for the null-terminator
+    size_t offset = 0;
+    while (offset < size - 1)
+    {
+        size_t count = (chunk < size - 1 - offset) ? chunk : size - 1 - offset;
+        result = vfs_read(fp, (uint8_t*) buffer + offset, count);
+        if (result <= 0) break;
+        offset += (size_t) result;
+    }
+    buffer[offset] = 0;
+    vfs_close(fp);
+    return (result < 0) ? result : (int) offset;
+}
+
+TEST(vfs_register)
+{
+    setup();
+    static struct filesystem fs;
+    // file systems must have a name and every operation
+    CHECK_EQ(vfs_register(&fs), EINVALID);
+    CHECK_EQ(vfs_register(nullptr), EINVALID);
+
+    struct filesystem procfs;
+    memset(&procfs, 0, sizeof(procfs));
+    strcpy(procfs.type, "procfs");
+    CHECK_EQ(vfs_register(&procfs), EINVALID);
+}
+
+TEST(vfs_lookup)
+{
+    setup();
+    struct mount *proc = nullptr;
+    struct mount *sub = nullptr;
+    CHECK_EQ(vfs_mount("procfs", "none", "/proc/sub", "", 0, &sub), EOK);
+
+    struct mount *mp = nullptr;
+    const char *rest = nullptr;
+    CHECK_EQ(vfs_lookup("/proc/hello", &proc, &rest), EOK);
+    CHECK(strcmp(proc->target, "/proc") == 0);
+    CHECK(strcmp(rest, "/hello") == 0);
+    // the longest mount point wins
+    CHECK_EQ(vfs_lookup("/proc/sub/hello", &mp, &rest), EOK);
+    CHECK(mp == sub);
+    CHECK(strcmp(rest, "/hello") == 0);
+    // a prefix of a path component does not match
+    CHECK_EQ(vfs_lookup("/process/hello", &mp, &rest), ENOENT);
+    CHECK_EQ(vfs_lookup("/dev/null", &mp, &rest), ENOENT);
+
+    // referenced mount points stay mounted
+    CHECK_EQ(vfs_unmount("/proc/sub", 0), EBUSY);
+    vfs_release(sub);
+    CHECK_EQ(vfs_unmount("/proc/sub", 0), EOK);
+    CHECK_EQ(vfs_unmount("/proc/sub", 0), ENOENT);
+    CHECK_EQ(vfs_lookup("/proc/sub/hello", &mp, &rest), EOK);
+    CHECK(mp == proc);
+    vfs_release(mp);
+    vfs_release(proc);
+    CHECK_EQ(proc->refs, 0);
+}
+
+TEST(vfs_read)
+{
+    setup();
+    char buffer[64];
+    CHECK_EQ(read_file("/proc/hello", buffer, sizeof(buffer), sizeof(buffer)), 12);
+    CHECK(strcmp(buffer, "hello world\n") == 0);
+    // small reads give the same content
+    CHECK_EQ(read_file("/proc/hello", buffer, sizeof(buffer), 5), 12);
+    CHECK(strcmp(buffer, "hello world\n") == 0);
+}
+
+TEST(vfs_open_missing)
+{
+    setup();
+    struct file *fp = nullptr;
+    CHECK_EQ(vfs_open("/proc/missing", 0, &fp), ENOENT);
+    CHECK_EQ(vfs_open("/missing", 0, &fp), ENOENT);
+    CHECK_EQ(vfs_open("", 0, &fp), EINVALID);
+    CHECK(fp == nullptr);
+}
+
+TEST(procfs_write)
+{
+    setup();
+    struct file *fp = nullptr;
+    CHECK_EQ(vfs_open("/proc/command", 0, &fp), EOK);
+    CHECK_EQ(vfs_write(fp, (const uint8_t*) "reset", 5), 5);
+    CHECK(strcmp(last_write, "reset") == 0);
+    vfs_close(fp);
+
+    // read-only files
+    CHECK_EQ(vfs_open("/proc/hello", 0, &fp), EOK);
+    CHECK_EQ(vfs_write(fp, (const uint8_t*) "reset", 5), ENOIMP);
+    vfs_close(fp);
+}
+
+TEST(procfs_register)
+{
+    setup();
+    CHECK_EQ(procfs_register("/hello", proc_hello, nullptr), EEXIST);
+    CHECK_EQ(procfs_register("/temporary", proc_hello, (void*) "again"), EOK);
+
+    char buffer[64];
+    CHECK_EQ(read_file("/proc/temporary", buffer, sizeof(buffer), sizeof(buffer)), 12);
+    CHECK(strcmp(buffer, "hello again\n") == 0);
+
+    CHECK_EQ(procfs_unregister("/temporary"), EOK);
+    CHECK_EQ(procfs_unregister("/temporary"), ENOENT);
+    CHECK_EQ(read_file("/proc/temporary", buffer, sizeof(buffer), sizeof(buffer)), ENOENT);
+}
@@ -84,11 +84,69 @@
 #define SOC_MAILBOX_STATUS_EMPTY (0x40000000)
 #define SOC_MAILBOX_STATUS_FULL  (0x80000000)
 
+/*
+ * ARM interrupt controller (GPU interrupts routed to the ARM).
+ */
+#define SOC_ARMCTRL_BASE         (CPU_IO_BASE + 0x0000B200U) // GPU = 0x7E00B200
+#define SOC_ARMCTRL_PENDING_BASIC   (SOC_ARMCTRL_BASE + 0x00U)
+#define SOC_ARMCTRL_PENDING1        (SOC_ARMCTRL_BASE + 0x04U)
+#define SOC_ARMCTRL_PENDING2        (SOC_ARMCTRL_BASE + 0x08U)
+#define SOC_ARMCTRL_FIQ_CONTROL     (SOC_ARMCTRL_BASE + 0x0CU)
+#define SOC_ARMCTRL_ENABLE1         (SOC_ARMCTRL_BASE + 0x10U)
+#define SOC_ARMCTRL_ENABLE2         (SOC_ARMCTRL_BASE + 0x14U)
+#define SOC_ARMCTRL_ENABLE_BASIC    (SOC_ARMCTRL_BASE + 0x18U)
+#define SOC_ARMCTRL_DISABLE1        (SOC_ARMCTRL_BASE + 0x1CU)
+#define SOC_ARMCTRL_DISABLE2        (SOC_ARMCTRL_BASE + 0x20U)
+#define SOC_ARMCTRL_DISABLE_BASIC   (SOC_ARMCTRL_BASE + 0x24U)
+
+/*
+ * ARM local peripherals (per-core timers, mailboxes and interrupt routing).
+ *
+ * For more information, consult the "BCM2836 ARM-local peripherals" manual.
+ */
+
+#define SOC_LOCAL_BASE           ((uintptr_t) 0x40000000U)
+#define SOC_LOCAL_GPU_ROUTING    (SOC_LOCAL_BASE + 0x0CU)
+#define SOC_LOCAL_PMU_ROUTING_SET   (SOC_LOCAL_BASE + 0x10U)
+#define SOC_LOCAL_PMU_ROUTING_CLEAR (SOC_LOCAL_BASE + 0x14U)
+#define SOC_LOCAL_TIMER_INT_CONTROL(core) \
+	(SOC_LOCAL_BASE + 0x40U + 4U * (uintptr_t) (core))
+#define SOC_LOCAL_MAILBOX_INT_CONTROL(core) \
+	(SOC_LOCAL_BASE + 0x50U + 4U * (uintptr_t) (core))
+#define SOC_LOCAL_IRQ_SOURCE(core) \
+	(SOC_LOCAL_BASE + 0x60U + 4U * (uintptr_t) (core))
+// writing '1' bits sets the corresponding bits of the mailbox
+#define SOC_LOCAL_MAILBOX_SET(core, mailbox) \
+	(SOC_LOCAL_BASE + 0x80U + 16U * (uintptr_t) (core) + 4U * (uintptr_t) (mailbox))
+// writing '1' bits clears the corresponding bits of the mailbox
+#define SOC_LOCAL_MAILBOX_CLEAR(core, mailbox) \
+	(SOC_LOCAL_BASE + 0xC0U + 16U * (uintptr_t) (core) + 4U * (uintptr_t) (mailbox))
+
+/* Bits of SOC_LOCAL_TIMER_INT_CONTROL and SOC_LOCAL_IRQ_SOURCE */
+#define SOC_LOCAL_CNTPSIRQ       (1U << 0)
+#define SOC_LOCAL_CNTPNSIRQ      (1U << 1)
+#define SOC_LOCAL_CNTHPIRQ       (1U << 2)
+#define SOC_LOCAL_CNTVIRQ        (1U << 3)
+
+/* Bits of SOC_LOCAL_IRQ_SOURCE */
+#define SOC_LOCAL_MAILBOX0IRQ    (1U << 4)
+#define SOC_LOCAL_MAILBOX1IRQ    (1U << 5)
+#define SOC_LOCAL_MAILBOX2IRQ    (1U << 6)
+#define SOC_LOCAL_MAILBOX3IRQ    (1U << 7)
+#define SOC_LOCAL_GPUIRQ         (1U << 8)
+#define SOC_LOCAL_PMUIRQ         (1U << 9)
+#define SOC_LOCAL_TIMERIRQ       (1U << 11)
+
+/* Enables the IRQ of a mailbox in SOC_LOCAL_MAILBOX_INT_CONTROL */
+#define SOC_LOCAL_MAILBOX_IRQ_ENABLE(mailbox)  (1U << (mailbox))
+
 #define SYS_MEMORY_TOTAL         (1U << 30) // bytes
 #define SYS_FRAME_SIZE           (4096U) // bytes
 #define SYS_FRAME_TOTAL          (SYS_MEMORY_TOTAL / SYS_FRAME_SIZE) // frames
 // TODO: remove
+#ifndef SYS_BITMAP_START
 #define SYS_BITMAP_START         (0x100) // bytes (16 bytes aligned)
+#endif
 // TODO: remove
 #define SYS_BITMAP_SIZE          (SYS_FRAME_TOTAL) // bytes
 // TODO: remove
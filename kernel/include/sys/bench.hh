@@ -0,0 +1,93 @@
+/**
+ * In-kernel microbenchmarks.
+ *
+ * Benchmarks are defined anywhere in the kernel with 'BENCHMARK' and their
+ * descriptors are collected in the '.bench' section:
+ *
+ *   BENCHMARK(heap_allocate)
+ *   {
+ *       for (uint64_t i = 0; i < iterations; ++i)
+ *           heap_free(heap_allocate(64));
+ *       return EOK;
+ *   }
+ *
+ * The runner calibrates the number of iterations so each sample takes at
+ * least BENCH_SAMPLE_NS, then measures BENCH_SAMPLES samples with the generic
+ * timer (nanoseconds) and the PMU cycle counter. Results are written to the
+ * UART and to '/proc/bench' as lines of "key=value" pairs.
+ *
+ * A benchmark returning an error (e.g. ENOENT for a missing device) is
+ * skipped.
+ */
+
+#ifndef MACHINA_BENCH_HH
+#define MACHINA_BENCH_HH
+
+
+#include <sys/types.h>
+
+
+#define BENCH_SAMPLES        101
+#define BENCH_SAMPLE_NS      1000000ULL
+#define BENCH_MAX_ITERATIONS (1ULL << 24)
+
+typedef int (*bench_func_t)( uint64_t iterations );
+
+/**
+ * Called once before the samples of a benchmark, with preemption enabled.
+ */
+typedef int (*bench_setup_t)();
+
+/**
+ * Statistics of the time of one iteration.
+ */
+struct bench_result
+{
+	int status;
+	uint64_t iterations;
+	uint64_t min_ns;
+	uint64_t median_ns;
+	uint64_t p99_ns;
+	uint64_t min_cycles;
+	uint64_t median_cycles;
+	uint64_t p99_cycles;
+};
+
+struct bench
+{
+	const char *name;
+	bench_func_t func;
+	bench_setup_t setup;
+	/**
+	 * Set by the last run (ENODATA if not executed yet).
+	 */
+	struct bench_result result;
+};
+
+#define BENCHMARK(name) \
+	BENCHMARK_SETUP(name, nullptr)
+
+/**
+ * Benchmark with a setup function, which may block and is not measured.
+ */
+#define BENCHMARK_SETUP(name, setup) \
+	static int bench_##name( uint64_t iterations ); \
+	static struct bench bench_desc_##name __attribute__((section(".bench"), used)) = \
+		{ #name, bench_##name, (setup), { ENODATA, 0, 0, 0, 0, 0, 0, 0 } }; \
+	static int bench_##name( uint64_t iterations )
+
+
+/**
+ * Run the benchmark @c name (or every benchmark, if @c name is null). Returns
+ * EBUSY while another run is in progress.
+ */
+int bench_run( const char *name );
+
+/**
+ * Register '/proc/bench' (results of the last run; accepts "run" and
+ * "run <name>").
+ */
+void bench_register();
+
+
+#endif // MACHINA_BENCH_HH
@@ -0,0 +1,54 @@
+#ifndef MACHINA_BOOT_H
+#define MACHINA_BOOT_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Maximum number of boot phases (including the ones recorded by
+ * 'entrypoint.S').
+ */
+#define BOOT_MAX_PHASES    48
+
+/*
+ * Phases timestamped by 'entrypoint.S' in 'kvar_boot_stamps', before
+ * 'kernel_main' is called.
+ */
+#define BOOT_STAMP_ENTRY   0 // first instruction of the kernel
+#define BOOT_STAMP_SETUP   1 // core 0 in EL1, BSS cleared
+#define BOOT_STAMP_CORE1   2 // core 1 parked
+#define BOOT_STAMP_CORE2   3 // core 2 parked
+#define BOOT_STAMP_CORE3   4 // core 3 parked
+#define BOOT_STAMPS        5
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Record the end of the current boot phase, which started when the previous
+ * one ended. Timestamps are read from the generic timer counter, which starts
+ * at reset, so the first phase is the time spent in the firmware.
+ *
+ * Must be called by the core 0, before the boot ends.
+ */
+void boot_phase_done( const char *name );
+
+/**
+ * End the boot, printing the summary of the phases to the UART.
+ */
+void boot_finish();
+
+/**
+ * Register '/proc/boottime'.
+ */
+void boot_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_BOOT_H
@@ -0,0 +1,77 @@
+#ifndef MACHINA_CACHE_H
+#define MACHINA_CACHE_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Maximum number of cache levels described by CLIDR_EL1.
+ */
+#define CACHE_MAX_LEVELS     7
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read the cache geometry (line sizes from CTR_EL0, levels from CLIDR_EL1 and
+ * CCSIDR_EL1) and register the IPI used to flush the caches of other cores.
+ *
+ * Until then, range operations assume 64-byte lines and never use set/way
+ * operations.
+ */
+void cache_initialize();
+
+/**
+ * Smallest data cache line in bytes (CTR_EL0.DminLine).
+ */
+uint32_t cache_line_size();
+
+/**
+ * Write the dirty lines of [addr, addr + size) back to memory, e.g. before a
+ * device reads the buffer with DMA.
+ */
+void cache_clean_range( const void *addr, size_t size );
+
+/**
+ * Discard the lines of [addr, addr + size), e.g. after a device wrote the
+ * buffer with DMA. Both @c addr and @c size must be multiples of
+ * CACHE_LINE_SIZE: whole lines are discarded, so the buffer must not share
+ * them with other data. Returns EARGUMENT, discarding nothing, otherwise.
+ */
+int cache_invalidate_range( void *addr, size_t size );
+
+/**
+ * Clean and then invalidate the lines of [addr, addr + size), for buffers
+ * both read and written by a device.
+ */
+void cache_clean_invalidate_range( const void *addr, size_t size );
+
+/**
+ * Make instructions written to [addr, addr + size) visible to instruction
+ * fetches of every core.
+ */
+void cache_sync_instructions( const void *addr, size_t size );
+
+/*
+ * Whole-cache operations by set/way in the current core, for all levels up
+ * to the point of coherency. Other cores are not affected, and invalidation
+ * discards dirty data: meant for the boot and for power management.
+ */
+void cache_clean_all();
+void cache_invalidate_all();
+void cache_clean_invalidate_all();
+
+/**
+ * Register '/proc/cache'.
+ */
+void cache_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_CACHE_H
@@ -0,0 +1,65 @@
+#ifndef MACHINA_CPUFREQ_H
+#define MACHINA_CPUFREQ_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Period of the on-demand governor, in microseconds.
+ */
+#define CPUFREQ_SAMPLE_US       100000
+
+/**
+ * Load (busy time of the busiest core, in percent) from which the on-demand
+ * governor selects the maximum rate.
+ */
+#define CPUFREQ_UP_THRESHOLD    80
+
+#ifndef CPUFREQ_DEFAULT_GOVERNOR
+#define CPUFREQ_DEFAULT_GOVERNOR  CPUFREQ_PERFORMANCE
+#endif
+
+enum cpufreq_governor
+{
+    /**
+     * Always run at the maximum rate.
+     */
+    CPUFREQ_PERFORMANCE,
+    /**
+     * Scale the rate with the load, measured from the idle time of the cores
+     * (see 'job_idle_ns').
+     */
+    CPUFREQ_ONDEMAND,
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Query the ARM clock range from the firmware and start the default
+ * governor. Returns ENOIMP if the firmware does not report the range.
+ */
+int cpufreq_initialize();
+
+int cpufreq_set_governor( enum cpufreq_governor governor );
+
+/**
+ * Last ARM clock rate confirmed by the firmware, in Hz.
+ */
+uint32_t cpufreq_current();
+
+/**
+ * Register '/proc/cpufreq'. Writing "performance" or "ondemand" to it selects
+ * the governor.
+ */
+void cpufreq_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_CPUFREQ_H
@@ -2,6 +2,7 @@
 #define MACHINA_DEVICE_HH
 
 #include <sys/types.h>
+#include <sys/job.h>
 
 struct device_t;
 struct device_driver_t;
@@ -110,8 +111,59 @@ struct device_t
     device_t *next;
 };
 
+enum device_probe_state
+{
+    PROBE_WAITING,  // registered, dependencies pending
+    PROBE_QUEUED,   // submitted to the job system
+    PROBE_RUNNING,
+    PROBE_DONE
+};
+
+/**
+ * Asynchronous probe of a device.
+ *
+ * Probes run as independent jobs, in any core, once all the probes they
+ * depend on are done. A probe whose dependency failed is not run and fails
+ * with the same error. Dependencies must not form cycles.
+ */
+struct device_probe
+{
+    /**
+     * Unique name, used in the dependencies of other probes.
+     */
+    const char *name;
+    /**
+     * Create and attach the device(s). Returns EOK or an error.
+     */
+    int (*probe)( device_probe *probe );
+    /**
+     * Names of the probes that must be done before this one, terminated by
+     * nullptr (or nullptr if none).
+     */
+    const char *const *depends;
+    system_bus_t *bus;
+    void *arg;
+
+    // managed by the device subsystem
+    device_probe_state state;
+    int result;
+    uint32_t core;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    /**
+     * One while the probe is not done (see @ref job_wait).
+     */
+    struct job_counter done;
+    device_probe *next;
+};
+
+#define DEVICE_PROBE_INITIALIZER(name, probe, depends, bus, arg) \
+    { name, probe, depends, bus, arg, PROBE_WAITING, EOK, 0, 0, 0, { 1 }, nullptr }
+
 /**
- * Initialize the device subsystem.
+ * Initialize the device subsystem: create the buses, register the drivers
+ * and start probing the devices in the background (see
+ * @ref kdev_probe_wait).
  */
 int kdev_initialize();
 
@@ -126,8 +178,41 @@ int kdev_enumerate();
 int kdev_enumerate_bus( system_bus_t *bus );
 
 /**
- * Register a new device driver.
+ * Find the first attached device of the given type.
+ */
+int kdev_find( device_type type, device_t **dev );
+
+/**
+ * Register a new device driver. Drivers are never unregistered, so buses call
+ * them outside RCU read-side sections.
  */
 int kdev_register_driver( device_driver_t *drv );
 
+/**
+ * Register a device probe. Probes registered after @ref kdev_probe_start are
+ * started as soon as their dependencies are done.
+ */
+int kdev_probe_register( device_probe *probe );
+
+/**
+ * Start all the registered probes whose dependencies are done.
+ */
+int kdev_probe_start();
+
+/**
+ * Wait for the probe with the given name, running other jobs meanwhile.
+ * Returns the result of the probe or ENOENT if it is not registered.
+ */
+int kdev_probe_wait( const char *name );
+
+/**
+ * Wait for all the registered probes. Returns the first error, if any.
+ */
+int kdev_probe_wait_all();
+
+/**
+ * Register '/proc/probes'.
+ */
+void kdev_register();
+
 #endif // MACHINA_DEVICE_HH
\ No newline at end of file
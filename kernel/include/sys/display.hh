@@ -4,6 +4,14 @@
 #include <sys/types.h>
 #include <sys/device.hh>
 
+/**
+ * Name of the probe attaching the framebuffer (see @ref kdev_probe_wait).
+ */
+#define KVID_PROBE_NAME  "vc4.fb"
+
+/**
+ * Register the VideoCore driver and the probe of its framebuffer.
+ */
 int kvid_initialize( system_bus_t *bus, device_t **dev, device_driver_t **drv );
 
 #endif // MACHINA_DISPLAY_HH
\ No newline at end of file
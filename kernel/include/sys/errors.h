@@ -14,5 +14,7 @@
 #define EMEMORY                        (-10)
 #define ENOIMP                         (-11)
 #define EARGUMENT                      (-12)
+#define EBUSY                          (-13)
+#define ETIMEOUT                       (-14)
 
 #endif // MACHINA_ERRORS_H
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef MACHINA_FIBER_H
+#define MACHINA_FIBER_H
+
+
+#include <sys/types.h>
+#include <sys/sync.h>
+
+
+/* fiber.state */
+#define FIBER_READY          0x01
+#define FIBER_RUNNING        0x02
+#define FIBER_WAITING        0x03
+#define FIBER_DEAD           0x04
+
+/**
+ * Default stack size for fibers. Besides the fiber itself, the stack must hold
+ * the register frame saved by an IRQ (about 1 KiB).
+ */
+#define FIBER_STACK_SIZE     (4 * 1024)
+
+/**
+ * Callee-saved registers of a suspended fiber. The layout must match
+ * 'fiber.S'.
+ */
+struct fiber_context
+{
+    uint64_t x[12]; // x19-x30
+    uint64_t sp;
+    uint64_t d[8];  // d8-d15
+    uint64_t reserved;
+};
+
+typedef void (*fiber_entry_t)( void *arg );
+
+struct fiber
+{
+    uint32_t id;
+    uint32_t state;
+    uint32_t core;
+    struct fiber_context context;
+    uint8_t *stack;
+    size_t stack_size;
+    fiber_entry_t entry;
+    void *arg;
+    uint64_t switches;
+    /**
+     * Next fiber in the ready queue (or in the waiter list of an event).
+     */
+    struct fiber *next;
+};
+
+/**
+ * Event that fibers can wait for.
+ *
+ * Once signaled, the event stays signaled (and waits return immediately) until
+ * @ref fiber_event_reset is called.
+ */
+struct fiber_event
+{
+    spinlock_t lock;
+    volatile uint32_t signaled;
+    struct fiber *waiters;
+};
+
+#define FIBER_EVENT_INITIALIZER   { SPINLOCK_INITIALIZER, 0, 0 }
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create a fiber in the current core.
+ *
+ * The fiber only runs when @ref fiber_run is called in the same core. If
+ * @c stack_size is zero, @ref FIBER_STACK_SIZE is used.
+ */
+int fiber_create( fiber_entry_t entry, void *arg, size_t stack_size, struct fiber **fiber );
+
+/**
+ * Run the fibers of the current core until all of them terminate.
+ *
+ * Only one execution context per core may run the fiber scheduler at a time.
+ */
+int fiber_run();
+
+/**
+ * Returns the fiber running in the current execution context, or null if the
+ * caller is not a fiber.
+ */
+struct fiber *fiber_current();
+
+/**
+ * Give the core to the next ready fiber.
+ *
+ * Does nothing when the caller is not a fiber, so busy-wait loops can call
+ * it unconditionally.
+ */
+void fiber_yield();
+
+/**
+ * Wait until @c event is signaled.
+ *
+ * A fiber is suspended while waiting; other callers sleep with 'wfe'.
+ */
+void fiber_await( struct fiber_event *event );
+
+/**
+ * Signal @c event, making all fibers waiting for it ready to run.
+ */
+void fiber_event_signal( struct fiber_event *event );
+
+void fiber_event_reset( struct fiber_event *event );
+
+void fiber_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_FIBER_H
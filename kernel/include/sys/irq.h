@@ -0,0 +1,78 @@
+#ifndef MACHINA_IRQ_H
+#define MACHINA_IRQ_H
+
+
+#include <sys/types.h>
+
+
+/*
+ * Interrupt numbers.
+ *
+ * 0-63   GPU peripherals (ARMCTRL pending registers 1 and 2)
+ * 64-71  ARM basic interrupts (ARMCTRL basic pending register)
+ * 96-107 ARM-local interrupts of each core (BCM2836 IRQ source register)
+ */
+#define IRQ_GPU_BASE         0
+#define IRQ_BASIC_BASE       64
+#define IRQ_LOCAL_BASE       96
+#define IRQ_COUNT            108
+
+#define IRQ_GPU(n)           (IRQ_GPU_BASE + (n))
+#define IRQ_BASIC(n)         (IRQ_BASIC_BASE + (n))
+#define IRQ_LOCAL(n)         (IRQ_LOCAL_BASE + (n))
+
+#define IRQ_SYSTEM_TIMER1    IRQ_GPU(1)
+#define IRQ_SYSTEM_TIMER3    IRQ_GPU(3)
+#define IRQ_UART0            IRQ_GPU(57)
+#define IRQ_ARM_TIMER        IRQ_BASIC(0)
+#define IRQ_ARM_MAILBOX      IRQ_BASIC(1)
+#define IRQ_LOCAL_CNTPS      IRQ_LOCAL(0)
+#define IRQ_LOCAL_CNTPNS     IRQ_LOCAL(1)
+#define IRQ_LOCAL_CNTHP      IRQ_LOCAL(2)
+#define IRQ_LOCAL_CNTV       IRQ_LOCAL(3)
+#define IRQ_LOCAL_MAILBOX(m) IRQ_LOCAL(4 + (m))
+#define IRQ_LOCAL_PMU        IRQ_LOCAL(9)
+
+typedef void (*irq_handler_t)( uint32_t irq, void *data );
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Mask every interrupt source and route the GPU interrupts to the core 0.
+ */
+int irq_initialize();
+
+/**
+ * Set the handler of an interrupt. Handlers run with IRQs masked.
+ *
+ * The name is shown in '/proc/interrupts' and must remain valid while the
+ * handler is attached.
+ */
+int irq_attach( uint32_t irq, const char *name, irq_handler_t handler, void *data );
+
+int irq_detach( uint32_t irq );
+
+/**
+ * Unmask an interrupt source. ARM-local interrupts are unmasked only in the
+ * current core.
+ */
+int irq_enable( uint32_t irq );
+
+int irq_disable( uint32_t irq );
+
+/**
+ * Returns whether the current core is running an interrupt handler.
+ */
+bool irq_context();
+
+void irq_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_IRQ_H
@@ -0,0 +1,73 @@
+#ifndef MACHINA_JOB_H
+#define MACHINA_JOB_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Counter tracking the completion of a group of jobs.
+ *
+ * The counter is incremented when a job is submitted and decremented when the
+ * job finishes. The group is complete when the counter reaches zero.
+ */
+struct job_counter
+{
+    volatile int32_t value;
+};
+
+#define JOB_COUNTER_INITIALIZER   { 0 }
+
+typedef void (*job_func_t)( void *arg );
+
+typedef void (*job_range_func_t)( size_t begin, size_t end, void *arg );
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int job_initialize();
+
+/**
+ * Queue a job in the deque of the current core.
+ *
+ * The job may be executed by any core. If @c counter is not null, it is
+ * incremented now and decremented once the job finishes.
+ */
+int job_submit( job_func_t func, void *arg, struct job_counter *counter );
+
+/**
+ * Wait for all jobs tracked by @c counter to finish.
+ *
+ * While waiting, the current core executes pending jobs (from its own deque or
+ * stolen from other cores) instead of spinning.
+ */
+void job_wait( struct job_counter *counter );
+
+/**
+ * Split the range [begin, end) in chunks of at most @c grain elements and
+ * process them in parallel, returning only after all chunks are done.
+ *
+ * If @c grain is zero, the chunk size is chosen from the number of cores.
+ */
+int parallel_for( size_t begin, size_t end, size_t grain, job_range_func_t func, void *arg );
+
+/**
+ * Execute jobs forever. This is the main loop of secondary cores.
+ */
+void job_worker_main();
+
+/**
+ * Time the core spent sleeping for lack of jobs, in nanoseconds.
+ */
+uint64_t job_idle_ns( uint32_t core );
+
+void job_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_JOB_H
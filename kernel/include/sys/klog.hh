@@ -0,0 +1,117 @@
+/**
+ * Binary kernel log.
+ *
+ * Log calls store only the address of the format string and the raw arguments
+ * in a binary record of the kernel log (see 'sys/kmsg.h'); the text is
+ * formatted later, when the record is written to the UART or read from
+ * '/proc/kmsg', or by 'tools/klogdump' from a memory dump and the kernel ELF.
+ * Format strings live in the '.klog' section of the image.
+ *
+ * Levels above KLOG_LEVEL are removed by the preprocessor: their arguments
+ * are not even evaluated.
+ *
+ * Arguments are kept as 64-bit values, so '%s' must only be used with
+ * strings that remain valid (e.g. literals).
+ */
+
+#ifndef MACHINA_KLOG_HH
+#define MACHINA_KLOG_HH
+
+
+#include <sys/types.h>
+#include <sys/kmsg.h>
+
+
+#define KLOG_LEVEL_ERROR     0
+#define KLOG_LEVEL_WARNING   1
+#define KLOG_LEVEL_INFO      2
+#define KLOG_LEVEL_DEBUG     3
+/**
+ * Level of tracepoint records (see 'sys/trace.hh').
+ */
+#define KLOG_LEVEL_TRACE     4
+
+/**
+ * Most verbose level compiled in.
+ */
+#ifndef KLOG_LEVEL
+#define KLOG_LEVEL           KLOG_LEVEL_INFO
+#endif
+
+#define KLOG_MAX_ARGS        KMSG_MAX_ARGS
+
+/**
+ * Format @c format with the raw arguments of a binary record, handing each
+ * conversion to 'snprintf' with the argument converted back to the type
+ * implied by the conversion. Returns the length of the text.
+ */
+size_t klog_format( char *buffer, size_t size, const char *format, const uint64_t *args, uint32_t count );
+
+
+static inline uint64_t klog_arg( bool value ) { return value; }
+static inline uint64_t klog_arg( char value ) { return (uint64_t) (int64_t) value; }
+static inline uint64_t klog_arg( signed char value ) { return (uint64_t) (int64_t) value; }
+static inline uint64_t klog_arg( unsigned char value ) { return value; }
+static inline uint64_t klog_arg( short value ) { return (uint64_t) (int64_t) value; }
+static inline uint64_t klog_arg( unsigned short value ) { return value; }
+static inline uint64_t klog_arg( int value ) { return (uint64_t) (int64_t) value; }
+static inline uint64_t klog_arg( unsigned int value ) { return value; }
+static inline uint64_t klog_arg( long value ) { return (uint64_t) value; }
+static inline uint64_t klog_arg( unsigned long value ) { return value; }
+static inline uint64_t klog_arg( long long value ) { return (uint64_t) value; }
+static inline uint64_t klog_arg( unsigned long long value ) { return value; }
+static inline uint64_t klog_arg( double value )
+{
+	union { double d; uint64_t u; } tmp;
+	tmp.d = value;
+	return tmp.u;
+}
+template<typename T>
+static inline uint64_t klog_arg( T *value ) { return (uint64_t) (uintptr_t) value; }
+
+/*
+ * The last argument is a sentinel added by KLOG_EMIT, so the argument list is
+ * never empty.
+ */
+template<typename... Args>
+static inline void klog_emit( uint32_t level, const char *format, Args... args )
+{
+	const uint64_t values[] = { klog_arg(args)... };
+	kmsg_write_binary(level, format, values, (uint32_t) sizeof...(Args) - 1);
+}
+
+#define KLOG_FIRST(first, ...)  first
+#define KLOG_REST(first, ...)   __VA_ARGS__
+
+#define KLOG_EMIT(level, ...) \
+	do { \
+		static const char klog_format_[] __attribute__((section(".rodata.klog"))) = KLOG_FIRST(__VA_ARGS__, 0); \
+		klog_emit((level), klog_format_, KLOG_REST(__VA_ARGS__, 0)); \
+	} while (0)
+
+#if KLOG_LEVEL >= KLOG_LEVEL_ERROR
+#define klog_error(...)      KLOG_EMIT(KLOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define klog_error(...)      do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_WARNING
+#define klog_warning(...)    KLOG_EMIT(KLOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define klog_warning(...)    do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_INFO
+#define klog_info(...)       KLOG_EMIT(KLOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define klog_info(...)       do { } while (0)
+#endif
+
+#if KLOG_LEVEL >= KLOG_LEVEL_DEBUG
+#define klog_debug(...)      KLOG_EMIT(KLOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define klog_debug(...)      do { } while (0)
+#endif
+
+
+#endif // MACHINA_KLOG_HH
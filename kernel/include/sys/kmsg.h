@@ -0,0 +1,70 @@
+#ifndef MACHINA_KMSG_H
+#define MACHINA_KMSG_H
+
+
+#include <sys/types.h>
+#include <mc/stdarg.h>
+
+
+/**
+ * Records in the ring of each core (must be a power of two).
+ */
+#ifndef KMSG_RECORDS
+#define KMSG_RECORDS       128
+#endif
+
+/**
+ * Maximum length of a record, including the null-terminator. Longer messages
+ * are truncated.
+ */
+#define KMSG_TEXT_SIZE     232
+
+/**
+ * Maximum number of arguments of a binary record.
+ */
+#define KMSG_MAX_ARGS      6
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Append a message to the log of the current core. Never blocks: the message
+ * is dropped (and counted) if the ring is full of records not yet written to
+ * the UART.
+ */
+void kmsg_write( const char *text, size_t length );
+
+void kmsg_print( const char *format, ... );
+
+void kmsg_vprint( const char *format, va_list args );
+
+/**
+ * Append a binary record: only the address of @c format and the raw arguments
+ * are stored, the text is formatted when the record is read (see
+ * 'sys/klog.hh'). The format string must remain valid.
+ */
+void kmsg_write_binary( uint32_t level, const char *format, const uint64_t *args, uint32_t count );
+
+/**
+ * Start writing the log to the UART asynchronously, from a dedicated work
+ * queue, and the timer of the current core that wakes it up for messages
+ * logged by IRQ handlers and lock holders. Until then, every message is
+ * written synchronously.
+ */
+int kmsg_start();
+
+/**
+ * Write every pending record to the UART before returning (e.g. on panic).
+ */
+void kmsg_flush();
+
+void kmsg_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_KMSG_H
@@ -0,0 +1,42 @@
+#ifndef MACHINA_KSYMS_H
+#define MACHINA_KSYMS_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Entry of the kernel symbol table, generated at build time from the function
+ * symbols of 'kernel8.elf' (see 'tools/ksyms/ksyms.sh'). Entries are sorted
+ * by address.
+ */
+struct ksym
+{
+	uint64_t address;
+	const char *name;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Find the function containing @c address.
+ *
+ * Returns null if the address is outside the kernel code or the table is
+ * empty (the first link stage of the kernel has no symbols).
+ */
+const struct ksym *ksyms_lookup( uintptr_t address );
+
+/**
+ * Number of entries in the symbol table.
+ */
+size_t ksyms_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_KSYMS_H
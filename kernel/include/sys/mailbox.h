@@ -2,12 +2,32 @@
 #define MACHINA_MAILBOX_H
 
 #include <sys/types.h>
+#include <sys/system.h>
 
 #define MAILBOX_CODE_REQUEST           (0x00000000U)
 #define MAILBOX_CODE_RESPONSE_OK       (0x80000000U)
 #define MAILBOX_CODE_RESPONSE_PARTIAL  (0x80000001U)
 #define MAILBOX_RESPONSE_BIT           (1U << 31)
 
+/**
+ * Maximum size (in bytes) of a batched property message (whole cache lines).
+ */
+#define MAILBOX_BATCH_SIZE             512
+
+/**
+ * Bytes of whole cache lines covering a message of @c size bytes.
+ */
+#define MAILBOX_SPAN(size) \
+	(((size) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1))
+
+/*
+ * Clock IDs of the clock tags.
+ */
+#define MAILBOX_CLOCK_EMMC             1
+#define MAILBOX_CLOCK_UART             2
+#define MAILBOX_CLOCK_ARM              3
+#define MAILBOX_CLOCK_CORE             4
+
 
 /*--------------------------------------------------------------------------}
 {	                  ENUMERATED MAILBOX CHANNELS							}
@@ -58,6 +78,7 @@ typedef enum {
 	MAILBOX_TAG_GET_MAX_CLOCK_RATE			= 0x00030004,			// Get max clock rate
 	MAILBOX_TAG_GET_MIN_CLOCK_RATE			= 0x00030007,			// Get min clock rate
 	MAILBOX_TAG_GET_TURBO					= 0x00030009,			// Get turbo
+	MAILBOX_TAG_GET_THROTTLED				= 0x00030046,			// Get throttling state
 
 	MAILBOX_TAG_SET_CLOCK_STATE				= 0x00038001,			// Set clock state
 	MAILBOX_TAG_SET_CLOCK_RATE				= 0x00038002,			// Set clock rate
@@ -186,6 +207,61 @@ struct __attribute__((__packed__, aligned(1))) clock_rate_tag
 	uint32_t rate;
 };
 
+// MAILBOX_TAG_SET_CLOCK_RATE
+struct __attribute__((__packed__, aligned(1))) clock_set_rate_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t id;          // IN/OUT
+	uint32_t rate;        // IN/OUT
+	uint32_t skip_turbo;  // IN: do not change the turbo state
+};
+
+// MAILBOX_TAG_GET_TEMPERATURE
+struct __attribute__((__packed__, aligned(1))) temperature_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t id;     // IN/OUT
+	uint32_t value;  // thousandths of a degree Celsius
+};
+
+// MAILBOX_TAG_GET_THROTTLED
+struct __attribute__((__packed__, aligned(1))) throttled_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t value;
+};
+
+// MAILBOX_TAG_SET_PHYSICAL_WIDTH_HEIGHT and MAILBOX_TAG_SET_VIRTUAL_WIDTH_HEIGHT
+struct __attribute__((__packed__, aligned(1))) fb_size_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t width;   // IN/OUT
+	uint32_t height;  // IN/OUT
+};
+
+// MAILBOX_TAG_SET_VIRTUAL_OFFSET
+struct __attribute__((__packed__, aligned(1))) fb_offset_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t x;  // IN/OUT
+	uint32_t y;  // IN/OUT
+};
+
+// MAILBOX_TAG_SET_COLOUR_DEPTH and MAILBOX_TAG_GET_PITCH
+struct __attribute__((__packed__, aligned(1))) fb_value_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t value;  // IN/OUT
+};
+
+// MAILBOX_TAG_ALLOCATE_FRAMEBUFFER
+struct __attribute__((__packed__, aligned(1))) fb_allocate_tag
+{
+	struct mailbox_tag_header header;
+	uint32_t base;  // IN: alignment, OUT: bus address
+	uint32_t size;
+};
+
 struct __attribute__((__packed__, aligned(1))) mailbox_message
 {
 	uint32_t size;
@@ -203,10 +279,153 @@ struct __attribute__((__packed__, aligned(1))) mailbox_message
 	uint8_t end[4]; // end tag
 };
 
+struct mailbox_request;
+
+/**
+ * Called when the reply of a request arrives, possibly in an interrupt
+ * handler. Must not block.
+ *
+ * The request is already marked as done: from then on it belongs to the
+ * callback, which may release it or submit it again. Waiters may return
+ * before the callback does.
+ */
+typedef void (*mailbox_callback_t)( struct mailbox_request *request );
+
+/**
+ * Asynchronous mailbox request (see @ref mailbox_submit).
+ */
+struct mailbox_request
+{
+	MAILBOX_CHANNEL channel;
+	/**
+	 * Address of the message (aligned to CACHE_LINE_SIZE) or, if @c size is
+	 * zero, the value to send (the lowest 4 bits are replaced by the channel).
+	 */
+	uint32_t addr;
+	/**
+	 * Bytes of the message shared with the VideoCore. The lines covering them
+	 * (MAILBOX_SPAN) are cleaned from the data cache before the request and
+	 * invalidated after the reply, so they must hold nothing else.
+	 */
+	uint32_t size;
+	mailbox_callback_t callback;
+	void *arg;
+
+	// managed by the driver
+	uint32_t response;  // reply without the channel
+	volatile uint32_t done;
+	uint64_t start_ns;
+	struct mailbox_request *next;
+};
+
+/**
+ * Property message with several tags, sent in a single round trip.
+ *
+ * Tags are appended with @ref mailbox_batch_add and the responses are parsed
+ * in place after @ref mailbox_batch_submit. The structure holds a pointer to
+ * its own storage and must not be copied.
+ */
+struct mailbox_batch
+{
+	/**
+	 * Message inside 'storage', aligned to a cache line and spanning
+	 * MAILBOX_BATCH_SIZE bytes of it: size, code, tags and the end tag.
+	 */
+	uint32_t *message;
+	/**
+	 * Words used by the message so far, without the end tag.
+	 */
+	uint32_t length;
+	uint32_t storage[(MAILBOX_BATCH_SIZE + CACHE_LINE_SIZE) / 4];
+};
+
+/**
+ * Append a tag to a batch using one of the tag structures (e.g. 'memory_tag').
+ */
+#define mailbox_batch_add_tag(batch, tag, type) \
+	((type*) mailbox_batch_add((batch), (tag), sizeof(type) - sizeof(struct mailbox_tag_header)))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Start an empty property message.
+ */
+void mailbox_batch_init( struct mailbox_batch *batch );
+
+/**
+ * Append a tag whose value buffer has @c size bytes (the largest of the
+ * request and the response), initialized with zeros. The caller fills the
+ * request in the returned tag, which also receives the response.
+ *
+ * Returns nullptr if the message is full.
+ */
+struct mailbox_tag_header *mailbox_batch_add( struct mailbox_batch *batch, uint32_t tag, uint32_t size );
+
+/**
+ * Append the end tag and update the size of the message. Returns the size of
+ * the message in bytes.
+ *
+ * Called by @ref mailbox_batch_submit.
+ */
+uint32_t mailbox_batch_finish( struct mailbox_batch *batch );
+
+/**
+ * Send the message to the VideoCore and wait for the response. Returns EOK
+ * if the firmware processed the message; each tag must still be checked
+ * with @ref mailbox_batch_done.
+ */
+int mailbox_batch_submit( struct mailbox_batch *batch );
+
+/**
+ * Start sending the message without waiting for the response: the callback
+ * (if any) is called and @c request is marked as done when it arrives (see
+ * @ref mailbox_wait). The batch and the request must remain valid until then.
+ */
+int mailbox_batch_start( struct mailbox_batch *batch, struct mailbox_request *request,
+	mailbox_callback_t callback, void *arg );
+
+/**
+ * Returns EOK if the firmware processed the message or EINVALID otherwise.
+ */
+int mailbox_batch_status( const struct mailbox_batch *batch );
+
+/**
+ * Check whether the firmware answered the tag.
+ */
+bool mailbox_batch_done( const struct mailbox_tag_header *tag );
+
+/**
+ * Queue a request in its channel and send it to the VideoCore, without
+ * waiting for the reply. Replies are matched with the requests of their
+ * channel in order, so channels can be used concurrently.
+ *
+ * The request must remain valid until it is done.
+ */
+int mailbox_submit( struct mailbox_request *request );
+
+/**
+ * Wait for the reply of a request. Returns ETIMEOUT if @c timeout_us (if not
+ * zero) microseconds elapse first; the request is still pending then.
+ */
+int mailbox_wait( struct mailbox_request *request, uint64_t timeout_us );
+
+/**
+ * Collect the replies in the mailbox IRQ instead of polling in the waiting
+ * cores. Requires the interrupt controller.
+ */
+int mailbox_start();
+
+/**
+ * Register '/proc/mailbox'.
+ */
+void mailbox_register();
+
+/**
+ * Synchronous round trip of the message at @c addr, which must be aligned to
+ * CACHE_LINE_SIZE and fit in its cache line.
+ */
 bool mailbox_send( MAILBOX_CHANNEL channel, uint32_t addr );
 
 //bool mailbox_write( MAILBOX_CHANNEL channel, uint32_t addr );
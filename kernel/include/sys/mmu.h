@@ -0,0 +1,76 @@
+#ifndef MACHINA_MMU_H
+#define MACHINA_MMU_H
+
+/*
+ * Identity mapping of the physical address space.
+ *
+ * With the MMU disabled every data access is Device-nGnRnE: nothing is cached
+ * and the exclusive accesses used by the locks are not guaranteed to work. The
+ * tables map the RAM as Normal write-back memory, the peripherals as Device
+ * memory and the VideoCore memory (e.g. the framebuffer) as Normal
+ * non-cacheable memory, in 2MB blocks.
+ *
+ * This header is included by 'entrypoint.S': the constants must remain plain
+ * expressions.
+ */
+
+/**
+ * Attribute indexes in MAIR_EL1.
+ */
+#define MMU_ATTR_DEVICE      0  // Device-nGnRnE
+#define MMU_ATTR_NORMAL      1  // Normal, inner and outer write-back
+#define MMU_ATTR_NORMAL_NC   2  // Normal, inner and outer non-cacheable
+
+#define MMU_MAIR \
+	((0x00 << (MMU_ATTR_DEVICE * 8)) | (0xFF << (MMU_ATTR_NORMAL * 8)) | (0x44 << (MMU_ATTR_NORMAL_NC * 8)))
+
+/**
+ * TCR_EL1: 4GB of virtual addresses in TTBR0 (T0SZ = 32) with the 4KB
+ * granule, table walks write-back cacheable in the inner shareable domain,
+ * and no walks through TTBR1 (EPD1).
+ */
+#define MMU_TCR \
+	(32 | (1 << 8) | (1 << 10) | (3 << 12) | (1 << 23))
+
+/**
+ * Size of the blocks of the second level.
+ */
+#define MMU_BLOCK_SIZE       0x200000
+
+
+#ifndef __ASSEMBLER__
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Build the tables and enable the MMU of the current core. Must be called by
+ * core 0 before taking any lock, after 'cache_initialize' and while the other
+ * cores are parked.
+ */
+void mmu_initialize();
+
+/**
+ * Enable the MMU of the current core with the tables built by
+ * 'mmu_initialize' (from 'entrypoint.S'). Uses no stack.
+ */
+void mmu_enable();
+
+/**
+ * Map the whole 2MB blocks of [base, base + size) as Normal non-cacheable
+ * memory, for memory shared with the VideoCore without cache maintenance.
+ * Must be called before the other cores are released.
+ */
+int mmu_map_uncached( uintptr_t base, size_t size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ASSEMBLER__
+
+
+#endif // MACHINA_MMU_H
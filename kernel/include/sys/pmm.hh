@@ -20,6 +20,7 @@
 
 #include <sys/types.h>
 #include <sys/compiler.h>
+#include <sys/mailbox.h>
 
 /**
  * @brief Codes for physical frame types.
@@ -66,7 +67,11 @@ struct memory_map_t
  */
 extern memory_map_t kern_memory_map;
 
-void pmm_initialize();
+/**
+ * Initialize the physical memory manager with the ARM and VideoCore memory
+ * splits reported by the firmware (queried by the boot mailbox batch).
+ */
+void pmm_initialize( const struct memory_tag *arm, const struct memory_tag *vc );
 
 uintptr_t pmm_allocate( size_t count, frame_type_t tag );
 
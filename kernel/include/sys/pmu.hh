@@ -0,0 +1,144 @@
+/**
+ * Cortex-A53 performance monitors.
+ *
+ * Every core counts cycles (PMCCNTR_EL0) and a fixed set of events in its six
+ * event counters. Code regions are measured with @ref pmu_scope:
+ *
+ *   static struct pmu_region region = PMU_REGION_INITIALIZER("heap");
+ *   ...
+ *   {
+ *       pmu_scope scope(&region);
+ *       // measured code
+ *   }
+ *
+ * Totals per core and per region are shown in '/proc/pmu'. Writing
+ * "sample <event> <period>" to it turns the last counter into an overflow
+ * sampler that feeds the profiler histogram (see 'sys/profile.h') every
+ * @c period events; "sample off" restores it.
+ */
+
+#ifndef MACHINA_PMU_HH
+#define MACHINA_PMU_HH
+
+
+#include <sys/types.h>
+#include <sys/system.h>
+#include <sys/smp.h>
+
+
+/*
+ * Common architectural events (see the Cortex-A53 TRM, section 12.9).
+ */
+#define PMU_EVENT_L1I_REFILL        0x01
+#define PMU_EVENT_L1I_TLB_REFILL    0x02
+#define PMU_EVENT_L1D_REFILL        0x03
+#define PMU_EVENT_L1D_ACCESS        0x04
+#define PMU_EVENT_L1D_TLB_REFILL    0x05
+#define PMU_EVENT_INST_RETIRED      0x08
+#define PMU_EVENT_BR_MIS_PRED       0x10
+#define PMU_EVENT_CPU_CYCLES        0x11
+#define PMU_EVENT_L2D_REFILL        0x17
+
+/*
+ * Event counters.
+ */
+#define PMU_INSTRUCTIONS     0
+#define PMU_L1D_REFILLS      1
+#define PMU_TLB_REFILLS      2
+#define PMU_L1I_REFILLS      3
+#define PMU_L2D_REFILLS      4
+/**
+ * Counts branch mispredictions, unless it is used for overflow sampling.
+ */
+#define PMU_SAMPLER          5
+#define PMU_COUNTERS         6
+
+struct pmu_counters
+{
+	uint64_t cycles;
+	uint64_t events[PMU_COUNTERS];
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) pmu_region_core
+{
+	uint64_t calls;
+	/**
+	 * Scopes ended in another core (not counted).
+	 */
+	uint64_t migrated;
+	struct pmu_counters total;
+};
+
+/**
+ * Named set of totals of measured regions. Regions are listed in '/proc/pmu'
+ * after their first measurement.
+ */
+struct pmu_region
+{
+	const char *name;
+	struct pmu_region_core cores[SYS_CPU_CORES];
+	volatile uint32_t listed;
+	struct pmu_region *next;
+};
+
+#define PMU_REGION_INITIALIZER(name)  { (name), {}, 0, nullptr }
+
+
+/**
+ * Attach the overflow interrupt and enable the counters of the current core.
+ */
+int pmu_initialize();
+
+/**
+ * Enable the counters of the current core. Called by each core at start up.
+ */
+void pmu_enable();
+
+/**
+ * Read the raw counters of the current core. Event counters have 32 bits.
+ */
+void pmu_snapshot( struct pmu_counters *counters );
+
+/**
+ * Read the 64-bit totals of the current core since it enabled its counters.
+ */
+void pmu_read( struct pmu_counters *counters );
+
+/**
+ * Add the events since @c start (a snapshot taken in @c core) to @c region.
+ */
+void pmu_region_add( struct pmu_region *region, uint32_t core, const struct pmu_counters *start );
+
+/**
+ * Use the sampler counter to sample every @c period occurrences of @c event
+ * in all cores, or restore it if @c event is zero.
+ */
+int pmu_sample( uint32_t event, uint32_t period );
+
+void pmu_register();
+
+/**
+ * Measure the lifetime of the object.
+ */
+struct pmu_scope
+{
+	pmu_scope( struct pmu_region *region ) : region(region), core(smp_core_id())
+	{
+		pmu_snapshot(&start);
+	}
+
+	~pmu_scope()
+	{
+		pmu_region_add(region, core, &start);
+	}
+
+	pmu_scope( const pmu_scope& ) = delete;
+	pmu_scope &operator=( const pmu_scope& ) = delete;
+
+	struct pmu_region *region;
+	uint32_t core;
+	struct pmu_counters start;
+};
+
+
+#endif // MACHINA_PMU_HH
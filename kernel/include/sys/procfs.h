@@ -9,6 +9,12 @@
 //typedef int (*procfunc_t)( struct file *fp, void *data );
 typedef int (*procfunc_t)( uint8_t *buffer, int size, void *data );
 
+/**
+ * Called for each write to the file. Returns the amount of bytes consumed or
+ * a negative error code.
+ */
+typedef int (*procwrite_t)( const uint8_t *buffer, int size, void *data );
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,6 +24,11 @@ int procfs_initialize();
 
 int procfs_register( const char *name, procfunc_t func, void *data );
 
+/**
+ * Register a file that also accepts writes.
+ */
+int procfs_register_rw( const char *name, procfunc_t func, procwrite_t write, void *data );
+
 int procfs_unregister( const char *name );
 
 #ifdef __cplusplus
@@ -0,0 +1,70 @@
+#ifndef MACHINA_PROFILE_H
+#define MACHINA_PROFILE_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Sampling rate of each core. A prime keeps samples from locking step with
+ * the timer wheel and other periodic work.
+ */
+#ifndef PROFILE_HZ
+#define PROFILE_HZ        997
+#endif
+
+/**
+ * Number of functions in the report of '/proc/profile'.
+ */
+#define PROFILE_TOP       20
+
+/**
+ * Bytes of code covered by each counter of the histogram (one instruction).
+ */
+#define PROFILE_GRANULE   4
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocate the histogram, if not allocated yet. Must be called before
+ * another source calls @ref profile_sample.
+ */
+int profile_prepare();
+
+/**
+ * Count a sample of the instruction at @c pc. Called in IRQ context by the
+ * sampling sources.
+ */
+void profile_sample( uint64_t pc );
+
+/**
+ * Start sampling the interrupted instruction of every core. The histogram is
+ * kept between runs until @ref profile_reset is called.
+ */
+int profile_start();
+
+/**
+ * Stop sampling in every core.
+ */
+int profile_stop();
+
+/**
+ * Clear the histogram.
+ */
+void profile_reset();
+
+/**
+ * Register '/proc/profile' (top functions; accepts "start", "stop" and
+ * "reset") and '/proc/profile_raw' (non-zero counters by address).
+ */
+void profile_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_PROFILE_H
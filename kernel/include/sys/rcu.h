@@ -0,0 +1,101 @@
+#ifndef MACHINA_RCU_H
+#define MACHINA_RCU_H
+
+
+#include <sys/types.h>
+#include <sys/task.h>
+
+
+/**
+ * Load a pointer protected by RCU. Must be used inside a read-side section.
+ *
+ * This is a plain load: the address dependency orders the accesses made
+ * through the returned pointer.
+ */
+#define rcu_dereference(p)        (*(__typeof__(p) volatile *) &(p))
+
+/**
+ * Publish a pointer protected by RCU. Everything written to the new object
+ * before this call is visible to readers that see the new pointer.
+ */
+#define rcu_assign_pointer(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+struct rcu_head;
+
+typedef void (*rcu_func_t)( struct rcu_head *head );
+
+/**
+ * Embedded in objects released with @ref rcu_call.
+ */
+struct rcu_head
+{
+    struct rcu_head *next;
+    rcu_func_t func;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Begin a read-side section. Sections can be nested and must not block.
+ */
+static inline void rcu_read_lock()
+{
+    task_preempt_disable();
+}
+
+static inline void rcu_read_unlock()
+{
+    task_preempt_enable();
+}
+
+/**
+ * Wait until every read-side section in progress finishes.
+ */
+void rcu_synchronize();
+
+/**
+ * Call @c func once every read-side section in progress finishes.
+ */
+void rcu_call( struct rcu_head *head, rcu_func_t func );
+
+/**
+ * Report that the current core is outside any read-side section.
+ */
+void rcu_quiescent();
+
+/**
+ * Start tracking the quiescent states of the current core.
+ */
+void rcu_online();
+
+/**
+ * Mark the current core as idle (always quiescent) before it sleeps, and
+ * clear the mark when it wakes up.
+ */
+void rcu_idle_enter();
+void rcu_idle_exit();
+
+/**
+ * Called by the IRQ dispatcher: handlers of an idle core may use read-side
+ * sections.
+ */
+void rcu_irq_enter();
+void rcu_irq_exit();
+
+/**
+ * Invoke the callbacks whose grace period is over. Called by idle cores, which
+ * are woken up periodically while callbacks are waiting.
+ */
+void rcu_poll();
+
+void rcu_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_RCU_H
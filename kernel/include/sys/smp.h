@@ -0,0 +1,123 @@
+#ifndef MACHINA_SMP_H
+#define MACHINA_SMP_H
+
+
+#include <sys/types.h>
+#include <sys/system.h>
+
+
+/*
+ * Types of inter-processor interrupts. Each type is a bit in the mailbox 0 of
+ * the target core, so pending messages of the same type are coalesced.
+ */
+#define IPI_WAKEUP               0
+#define IPI_RESCHEDULE           1
+#define IPI_CALL_FUNCTION        2
+#define IPI_TLB_SHOOTDOWN        3
+#define IPI_CACHE_DRAIN          4
+#define IPI_CACHE_FLUSH          5   // see 'cache.h'
+#define IPI_TYPES                32
+
+typedef void (*ipi_handler_t)( uint32_t type );
+
+typedef void (*smp_func_t)( void *arg );
+
+/**
+ * Function call request for another core.
+ *
+ * The memory must remain valid until the call is done (see
+ * @ref smp_call_done).
+ */
+struct smp_call
+{
+	smp_func_t func;
+	void *arg;
+	volatile uint32_t done;
+	struct smp_call *next;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the index of the current CPU core (0 to SYS_CPU_CORES - 1).
+ */
+static inline uint32_t smp_core_id()
+{
+	uint64_t value;
+	__asm__ volatile ("mrs %0, mpidr_el1" : "=r" (value));
+	return (uint32_t) (value & 0x3);
+}
+
+/**
+ * Returns the number of CPU cores brought up by the entry point.
+ */
+uint32_t smp_cores();
+
+/**
+ * Release the secondary cores (parked by the entry point) into the kernel.
+ *
+ * Each secondary core starts executing @c kernel_secondary_main. The subsystems
+ * used by secondary cores must be initialized before calling this function.
+ */
+int smp_initialize();
+
+/**
+ * Set the handler for IPIs of the given type. Handlers run in IRQ context in
+ * the target core.
+ */
+int smp_ipi_register( uint32_t type, ipi_handler_t handler );
+
+/**
+ * Send an IPI to the core @c core.
+ *
+ * If @c wait is true, returns only after the handler finished in the target
+ * core (the handler is guaranteed to run after this call started).
+ */
+int smp_ipi_send( uint32_t core, uint32_t type, bool wait );
+
+/**
+ * Send an IPI to all online cores except the current one.
+ */
+int smp_ipi_broadcast( uint32_t type, bool wait );
+
+/**
+ * Handle the pending IPIs of the current core. Must be called with IRQs
+ * masked.
+ */
+void smp_ipi_dispatch();
+
+/**
+ * Execute @c func in the core @c core and wait for it to return.
+ */
+int smp_call_function( uint32_t core, smp_func_t func, void *arg );
+
+/**
+ * Queue @c call for execution in the core @c core and return immediately.
+ */
+int smp_call_function_async( uint32_t core, struct smp_call *call );
+
+bool smp_call_done( const struct smp_call *call );
+
+void smp_call_wait( struct smp_call *call );
+
+/**
+ * Invalidate the TLBs of all online cores.
+ */
+void smp_tlb_shootdown();
+
+/**
+ * Make all online cores complete their outstanding memory accesses.
+ */
+void smp_cache_drain();
+
+void smp_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_SMP_H
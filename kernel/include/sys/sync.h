@@ -2,20 +2,22 @@
 #define MACHINA_SYNC_H
 
 
+#include <sys/types.h>
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+#if (RPIGEN == 1)
+
 #define	sync_enableInterrupts()	\
 	asm volatile ("cpsie i")
 
 #define	sync_disableInterrupts() \
 	asm volatile ("cpsid i")
 
-
-#if (RPIGEN == 1)
-
 #define sync_dataSyncBarrier() \
 	asm volatile ("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory")
 
@@ -28,7 +30,13 @@ extern "C" {
 #define sync_instMemBarrier() \
 	sync_instSyncBarrier()
 
-#else
+#elif (RPIGEN == 2)
+
+#define	sync_enableInterrupts()	\
+	asm volatile ("cpsie i")
+
+#define	sync_disableInterrupts() \
+	asm volatile ("cpsid i")
 
 #define sync_dataSyncBarrier() \
 	asm volatile ("dsb" ::: "memory")
@@ -42,12 +50,157 @@ extern "C" {
 #define sync_instMemBarrier() \
 	asm volatile ("isb" ::: "memory")
 
+#else
+
+#define	sync_enableInterrupts()	\
+	__asm__ volatile ("msr daifclr, #2" ::: "memory")
+
+#define	sync_disableInterrupts() \
+	__asm__ volatile ("msr daifset, #2" ::: "memory")
+
+#define sync_dataSyncBarrier() \
+	__asm__ volatile ("dsb sy" ::: "memory")
+
+#define sync_dataMemBarrier() \
+	__asm__ volatile ("dmb sy" ::: "memory")
+
+#define sync_instSyncBarrier() \
+	__asm__ volatile ("isb" ::: "memory")
+
+#define sync_instMemBarrier() \
+	__asm__ volatile ("isb" ::: "memory")
+
 #endif
 
+/**
+ * Wake up every core waiting in @ref sync_waitEvent.
+ */
+#define sync_sendEvent() \
+	__asm__ volatile ("sev" ::: "memory")
+
+/**
+ * Put the current core in low power state until some core executes
+ * @ref sync_sendEvent (or any other wake up event occurs).
+ */
+#define sync_waitEvent() \
+	__asm__ volatile ("wfe" ::: "memory")
+
+/**
+ * Prevent the compiler from reordering memory accesses across this point.
+ */
+#define sync_compilerBarrier() \
+	__asm__ volatile ("" ::: "memory")
+
+
+/*
+ * Preemption control of the scheduler (see 'sys/task.h'), declared here
+ * since the scheduler itself uses these locks.
+ */
+void task_preempt_disable();
+void task_preempt_enable();
+
+/**
+ * Simple test-and-set spin lock.
+ *
+ * Cores waiting for the lock sleep in 'wfe' and are woken up by the 'sev'
+ * issued in @ref spin_unlock.
+ *
+ * The current task is not preempted while it holds the lock, so other tasks
+ * of the core never spin on a lock whose owner is not running. The 'raw'
+ * variants leave preemption alone; they are meant for code running with IRQs
+ * masked, which can not be preempted anyway.
+ *
+ * Exclusive accesses (used by the atomic builtins) only work in memory mapped
+ * as normal cacheable; QEMU does not enforce that, but the real hardware does.
+ */
+typedef struct
+{
+	volatile uint32_t value;
+} spinlock_t;
+
+#define SPINLOCK_INITIALIZER   { 0 }
+
+static inline void spin_lock_raw( spinlock_t *lock )
+{
+	while (__atomic_exchange_n(&lock->value, 1U, __ATOMIC_ACQUIRE) != 0)
+	{
+		while (__atomic_load_n(&lock->value, __ATOMIC_RELAXED) != 0)
+			sync_waitEvent();
+	}
+}
+
+static inline bool spin_trylock_raw( spinlock_t *lock )
+{
+	return __atomic_exchange_n(&lock->value, 1U, __ATOMIC_ACQUIRE) == 0;
+}
+
+static inline void spin_unlock_raw( spinlock_t *lock )
+{
+	__atomic_store_n(&lock->value, 0U, __ATOMIC_RELEASE);
+	sync_dataSyncBarrier();
+	sync_sendEvent();
+}
+
+static inline void spin_lock( spinlock_t *lock )
+{
+	task_preempt_disable();
+	spin_lock_raw(lock);
+}
+
+static inline bool spin_trylock( spinlock_t *lock )
+{
+	task_preempt_disable();
+	if (spin_trylock_raw(lock)) return true;
+	task_preempt_enable();
+	return false;
+}
+
+static inline void spin_unlock( spinlock_t *lock )
+{
+	spin_unlock_raw(lock);
+	task_preempt_enable();
+}
+
+/**
+ * Mask IRQs in the current core and returns the previous mask state.
+ */
+static inline uint64_t sync_saveInterrupts()
+{
+	uint64_t flags;
+	__asm__ volatile ("mrs %0, daif" : "=r" (flags) :: "memory");
+	sync_disableInterrupts();
+	return flags;
+}
+
+/**
+ * Restore the IRQ mask state saved by @ref sync_saveInterrupts.
+ */
+static inline void sync_restoreInterrupts( uint64_t flags )
+{
+	__asm__ volatile ("msr daif, %0" :: "r" (flags) : "memory");
+}
+
+/**
+ * Acquire the lock with IRQs masked in the current core. This must be used
+ * for locks also acquired by interrupt handlers.
+ */
+static inline uint64_t spin_lock_irqsave( spinlock_t *lock )
+{
+	uint64_t flags = sync_saveInterrupts();
+	spin_lock_raw(lock);
+	return flags;
+}
+
+static inline void spin_unlock_irqrestore( spinlock_t *lock, uint64_t flags )
+{
+	spin_unlock_raw(lock);
+	sync_restoreInterrupts(flags);
+}
+
 
 #ifdef __cplusplus
 }
 #endif
 
 
-#endif // MACHINA_SYNC_H
\ No newline at end of file
+#endif // MACHINA_SYNC_H
@@ -52,6 +52,14 @@
  */
 #define SYS_EXCEPT_STACK_SIZE     (8 * SYS_PAGE_SIZE) // 32 KiB
 
+/**
+ * @brief Size of the data cache lines of the Cortex-A53.
+ *
+ * Per-core data is aligned to it to avoid false sharing, and buffers shared
+ * with the VideoCore or DMA masters must cover whole lines.
+ */
+#define CACHE_LINE_SIZE           64
+
 
 #if (RPIGEN == 1)
 
@@ -0,0 +1,202 @@
+#ifndef MACHINA_TASK_H
+#define MACHINA_TASK_H
+
+
+#include <sys/types.h>
+
+
+#define TASK_MAX_NAME        23
+
+/* task.state */
+#define TASK_READY           0x01
+#define TASK_RUNNING         0x02
+#define TASK_BLOCKED         0x03
+#define TASK_DEAD            0x04
+
+/*
+ * Task priorities. Ready tasks with higher priority (lower value) always run
+ * before the ones with lower priority; tasks with the same priority share the
+ * core in round-robin.
+ */
+#define TASK_PRIO_HIGH       0
+#define TASK_PRIO_NORMAL     1
+#define TASK_PRIO_LOW        2
+#define TASK_PRIORITIES      3
+
+/**
+ * Frequency of the scheduler tick.
+ */
+#define TASK_TICK_HZ         1000
+
+/**
+ * Default stack size for kernel threads.
+ */
+#define TASK_STACK_SIZE      (16 * 1024)
+
+/**
+ * Register context saved on the task stack by the exception entry (or by
+ * a voluntary switch). The layout must match 'exception.S'.
+ */
+struct task_context
+{
+    uint64_t x[31];
+    uint64_t elr;
+    uint64_t spsr;
+    uint64_t fpcr;
+    uint64_t fpsr;
+    uint64_t reserved;
+    uint64_t q[64]; // q0-q31
+};
+
+typedef void (*task_entry_t)( void *arg );
+
+struct task
+{
+    uint32_t id;
+    char name[TASK_MAX_NAME + 1];
+    uint32_t state;
+    uint32_t priority;
+    uint32_t core;
+    /**
+     * Saved context while the task is not running.
+     */
+    struct task_context *context;
+    uint8_t *stack;
+    size_t stack_size;
+    task_entry_t entry;
+    void *arg;
+    /**
+     * Remaining scheduler ticks before the task is preempted.
+     */
+    uint32_t slice;
+    uint64_t switches;
+    uint64_t ticks;
+    /**
+     * Next task in the run queue (or in the dead list).
+     */
+    struct task *next;
+    /**
+     * Next task in the list of all tasks.
+     */
+    struct task *all_next;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize the scheduler data structures. Must be called once, before
+ * @ref task_start.
+ */
+int task_initialize();
+
+/**
+ * Start the scheduler in the current core.
+ *
+ * The current execution context becomes a task: in the core 0 it is the
+ * "main" task, in the other cores it is the idle task. The timer wheel of the
+ * core is started and IRQs are unmasked.
+ */
+int task_start();
+
+/**
+ * Create a kernel thread.
+ *
+ * The new task runs in the core @c core (or in the current core, if @c core
+ * is negative) and starts ready to run.
+ */
+int task_create(
+    const char *name,
+    task_entry_t entry,
+    void *arg,
+    uint32_t priority,
+    int core,
+    struct task **task );
+
+struct task *task_current();
+
+/**
+ * Give up the rest of the time slice.
+ */
+void task_yield();
+
+/**
+ * Disable the preemption of the current task. Calls can be nested; the task
+ * must not block until preemption is enabled again. Also called by
+ * @ref spin_lock for as long as the lock is held.
+ */
+void task_preempt_disable();
+
+/**
+ * Enable the preemption disabled by @ref task_preempt_disable, switching to
+ * another task if a reschedule was requested meanwhile.
+ */
+void task_preempt_enable();
+
+/**
+ * Whether the current context may be preempted: not an IRQ handler, IRQs
+ * unmasked and preemption enabled. Such a context holds no spin lock, so it
+ * may call into the scheduler (e.g. @ref task_wake).
+ */
+bool task_preemptible();
+
+/**
+ * Block the current task until @ref task_wake is called.
+ *
+ * Callers that wait on a condition must set the state to TASK_BLOCKED (with
+ * @ref task_prepare_block) before testing the condition, so a concurrent wake
+ * up is never lost.
+ */
+void task_block();
+
+/**
+ * Mark the current task as blocked without giving up the core.
+ */
+void task_prepare_block();
+
+/**
+ * Revert @ref task_prepare_block when the condition is already satisfied.
+ */
+void task_cancel_block();
+
+/**
+ * Block the current task for at least @c us microseconds.
+ *
+ * Returns EINVALID if the current context can not block (IRQ handlers, the
+ * idle task or preemption disabled).
+ */
+int task_sleep( uint64_t us );
+
+/**
+ * Make a blocked task ready to run.
+ */
+void task_wake( struct task *task );
+
+/**
+ * Terminate the current task.
+ */
+void task_exit() __attribute__((noreturn));
+
+/**
+ * Release the tasks terminated in the current core. Called by the idle loop,
+ * once the switch away from them is complete.
+ */
+void task_reap();
+
+/**
+ * Called by the IRQ dispatcher before returning from an IRQ. Returns the
+ * context to be restored, which belongs to another task if a reschedule was
+ * requested.
+ */
+struct task_context *task_irq_exit( struct task_context *frame );
+
+void task_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_TASK_H
@@ -1,8 +1,8 @@
 /**
- * Provides access to BCM2835 system timer.
+ * Monotonic clock and timer events.
  *
- * For more information, consult the "BCM2835 ARM Peripherals" manual
- * on page 172.
+ * The clock is backed by the ARM generic timer, falling back to the BCM2835
+ * system timer (see the "BCM2835 ARM Peripherals" manual on page 172).
  */
 
 #ifndef MACHINA_TIMER_HH
@@ -13,17 +13,122 @@
 #include <sys/bcm2837.h>
 
 
+/**
+ * Clock source: a free-running counter and the conversion of its cycles to
+ * nanoseconds, computed as (cycles * mult) >> shift.
+ */
 struct timer_t
 {
+	const char *name;
 	uint64_t (*now)();
+	uint64_t frequency;
+	uint64_t mult;
+	uint32_t shift;
+	/**
+	 * The registered clock source with the highest rating is used.
+	 */
+	uint32_t rating;
+};
+
+/**
+ * Resolution of the timer wheel.
+ */
+#define TIMER_WHEEL_HZ       1000
+
+struct timer_event;
+
+typedef void (*timer_func_t)( struct timer_event *event );
+
+/**
+ * One-shot or periodic timer.
+ *
+ * The callback runs in IRQ context, in the core the timer was scheduled.
+ */
+struct timer_event
+{
+	timer_func_t func;
+	void *arg;
+	/**
+	 * Expiration in wheel ticks.
+	 */
+	uint64_t expires;
+	/**
+	 * Exact expiration and period in generic timer counter ticks.
+	 */
+	uint64_t deadline;
+	uint64_t period;
+	uint32_t core;
+	/**
+	 * Wheel slot plus one while the timer is pending, zero otherwise (and
+	 * while its callback runs). Events due but not processed yet have a
+	 * private marker instead.
+	 */
+	uint32_t slot;
+	struct timer_event *next;
+	struct timer_event *prev;
 };
 
+#define TIMER_EVENT_INITIALIZER(func, arg) \
+	{ (func), (arg), 0, 0, 0, 0, 0, nullptr, nullptr }
+
 
 void timer_initialize();
 void timer_terminate();
-void timer_register( struct timer_t &timer );
+
+/**
+ * Register a clock source, computing its conversion factors. The clock source
+ * is selected if its rating is higher than the current one; the monotonic
+ * clock continues from the value it had.
+ */
+void timer_register_clock( struct timer_t &timer );
+
+/**
+ * Returns the current value of the clock source.
+ */
+uint64_t timer_cycles();
+
+uint64_t timer_cycles_to_ns( uint64_t cycles );
+
+/**
+ * Monotonic clock in nanoseconds.
+ */
+uint64_t timer_ns();
+
+/**
+ * Monotonic clock in microseconds.
+ */
 uint64_t timer_tick();
+
+/**
+ * Wait for @c us microseconds. Tasks sleep on a timer event when possible;
+ * other callers sleep in 'wfe' (see 'sys/wait.h').
+ */
 void timer_wait( uint64_t us );
 
+/**
+ * Start the timer wheel of the current core. Does nothing if the generic timer
+ * frequency is not set (timer events are not available then).
+ */
+void timer_enable();
+
+/**
+ * Schedule @c event to expire after @c delay_us microseconds and then every
+ * @c period_us microseconds (if not zero). A pending event is rescheduled.
+ */
+int timer_schedule( struct timer_event *event, uint64_t delay_us, uint64_t period_us );
+
+/**
+ * Cancel a pending event. Returns ENOENT if the event is not pending. The
+ * callback may still be running in the core of the event.
+ */
+int timer_cancel( struct timer_event *event );
+
+bool timer_pending( const struct timer_event *event );
+
+/**
+ * Register '/proc/timers'.
+ */
+void timer_register();
+
 
 #endif // MACHINA_TIMER_HH
\ No newline at end of file
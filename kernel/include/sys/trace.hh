@@ -0,0 +1,123 @@
+/**
+ * Static tracepoints.
+ *
+ * Each 'trace_event' site is a single NOP while its tracepoint is disabled.
+ * Enabling the tracepoint patches the NOP into a branch to the code that
+ * writes a binary record (see 'sys/klog.hh') to the trace ring of the core.
+ * The rings are flight recorders, apart from the kernel log: the newest
+ * records overwrite the oldest ones.
+ *
+ * Tracepoints are listed, enabled and disabled through '/proc/tracepoints'
+ * and the records are read from '/proc/trace':
+ *
+ *   enable <name>     enable every site of the tracepoint
+ *   disable <name>    disable every site of the tracepoint
+ *   enable all        (or 'disable all')
+ */
+
+#ifndef MACHINA_TRACE_HH
+#define MACHINA_TRACE_HH
+
+
+#include <sys/types.h>
+#include <sys/klog.hh>
+
+
+/**
+ * Records in the ring of each core (must be a power of two).
+ */
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS        256
+#endif
+
+/**
+ * Layout shared with 'tools/klogdump'.
+ */
+struct trace_record
+{
+	/**
+	 * Index of the record plus one once published, zero while being written.
+	 */
+	volatile uint64_t seq;
+	const char *format;
+	/**
+	 * Clock source cycles (see 'timer_cycles').
+	 */
+	uint64_t timestamp;
+	uint8_t level;
+	uint8_t core;
+	uint8_t count;
+	uint8_t reserved[5];
+	uint64_t args[KLOG_MAX_ARGS];
+};
+
+/**
+ * Tracepoint descriptor, placed in the '.trace.points' section.
+ */
+struct trace_point
+{
+	const char *name;
+	const char *format;
+	volatile uint32_t enabled;
+	uint32_t reserved;
+	volatile uint64_t hits;
+};
+
+/**
+ * Patchable instruction of a tracepoint, placed in the '.trace.sites' section
+ * by 'trace_event'.
+ */
+struct trace_site
+{
+	uint64_t code;
+	uint64_t target;
+	struct trace_point *point;
+};
+
+
+void trace_write( struct trace_point *point, const uint64_t *args, uint32_t count );
+
+/**
+ * Enable or disable every site of the tracepoints named @c name (or every
+ * tracepoint, if @c name is "all").
+ */
+int trace_set( const char *name, bool enable );
+
+void trace_register();
+
+
+/*
+ * The last argument is a sentinel added by 'trace_event'.
+ */
+template<typename... Args>
+static inline void trace_emit( struct trace_point *point, Args... args )
+{
+	const uint64_t values[] = { klog_arg(args)... };
+	trace_write(point, values, (uint32_t) sizeof...(Args) - 1);
+}
+
+/**
+ * Trace an event with the given format and arguments (same rules of the
+ * binary kernel log). Arguments are only evaluated when the tracepoint is
+ * enabled.
+ */
+#define trace_event(name, ...) \
+	do { \
+		__label__ trace_enabled_; \
+		static const char trace_format_[] __attribute__((section(".rodata.klog"))) = KLOG_FIRST(__VA_ARGS__, 0); \
+		static struct trace_point trace_point_ __attribute__((section(".trace.points"), used)) = \
+			{ #name, trace_format_, 0, 0, 0 }; \
+		__asm__ goto ( \
+			"1: nop\n\t" \
+			".pushsection .trace.sites, \"aw\"\n\t" \
+			".balign 8\n\t" \
+			".quad 1b, %l[trace_enabled_], %c0\n\t" \
+			".popsection" \
+			:: "i" (&trace_point_) :: trace_enabled_); \
+		break; \
+	trace_enabled_: \
+		trace_emit(&trace_point_, KLOG_REST(__VA_ARGS__, 0)); \
+	} while (0)
+
+
+#endif // MACHINA_TRACE_HH
@@ -10,12 +10,38 @@ extern "C" {
 #endif
 
 void uart_init();
+
+/**
+ * Switch to interrupt-driven transmission and reception. Requires the IRQ
+ * subsystem to be initialized.
+ */
+int uart_start();
+
 void uart_putc( uint8_t c );
 //void uart_puts( const char *str );
 void uart_puts( const char *str );
 void uart_print( const char *format, ... );
 uint8_t uart_getc();
 
+/**
+ * Queue up to @c count bytes for transmission without waiting. Returns the
+ * amount of bytes queued.
+ */
+int uart_write( const uint8_t *data, size_t count );
+
+/**
+ * Read up to @c count received bytes without waiting. Returns the amount of
+ * bytes read.
+ */
+int uart_read( uint8_t *data, size_t count );
+
+/**
+ * Wait until every queued byte is transmitted.
+ */
+void uart_flush();
+
+void uart_register();
+
 #ifdef __cplusplus
 }
 #endif
@@ -55,6 +55,7 @@ struct mount
     gid_t gid;
     uint32_t mode;
     void *fsdata; // fylesystem-specific data
+    uint32_t refs; // references from 'vfs_lookup' (e.g. open files)
     struct mount *next;
 };
 
@@ -170,8 +171,14 @@ int vfs_mount(
 
 int vfs_unmount( const char *target, uint32_t flags );
 
+/*
+ * Find the mount point of a path. The mount point cannot be unmounted until
+ * the reference is dropped with 'vfs_release'.
+ */
 int vfs_lookup( const char *name, struct mount **mp, const char **rest);
 
+void vfs_release( struct mount *mp );
+
 int vfs_open( const char *name, uint32_t flags, struct file **fp );
 
 int vfs_close( struct file *fp );
@@ -0,0 +1,46 @@
+#ifndef MACHINA_WAIT_H
+#define MACHINA_WAIT_H
+
+
+#include <sys/types.h>
+
+
+/**
+ * Bit of the generic timer counter whose transitions generate the event
+ * stream. Waiting cores wake up every 2^(WAIT_EVENT_STREAM_BIT + 1) counter
+ * cycles (about 53 us at 19.2 MHz) to poll devices without interrupts.
+ */
+#ifndef WAIT_EVENT_STREAM_BIT
+#define WAIT_EVENT_STREAM_BIT  9
+#endif
+
+typedef bool (*wait_cond_t)( void *arg );
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Give up the core for a while: switch to another fiber or sleep in 'wfe'
+ * until an event (a 'sev', an interrupt or the event stream) arrives. Fibers
+ * only switch when the caller may be preempted (see 'task_preemptible'), so
+ * callers may hold spin locks of any kind.
+ *
+ * Callers poll their condition again after each call.
+ */
+void wait_relax();
+
+/**
+ * Wait until @c cond returns true, calling @ref wait_relax between tests.
+ *
+ * Returns ETIMEOUT if @c timeout_us (if not zero) microseconds elapse first.
+ */
+int wait_until( wait_cond_t cond, void *arg, uint64_t timeout_us );
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_WAIT_H
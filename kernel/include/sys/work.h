@@ -0,0 +1,108 @@
+#ifndef MACHINA_WORK_H
+#define MACHINA_WORK_H
+
+
+#include <sys/types.h>
+#include <sys/sync.h>
+
+
+struct work;
+struct task;
+
+typedef void (*work_func_t)( struct work *work );
+
+/**
+ * Deferred work item.
+ *
+ * Usually embedded in the object it works on. An item can be queued again
+ * once its function started running.
+ */
+struct work
+{
+    work_func_t func;
+    void *arg;
+    volatile uint32_t pending;
+    /**
+     * Time (in microseconds) when the item was queued.
+     */
+    uint64_t queued_at;
+    struct work *next;
+};
+
+#define WORK_INITIALIZER(func, arg)   { (func), (arg), 0, 0, 0 }
+
+struct work_stats
+{
+    uint64_t queued;
+    uint64_t executed;
+    uint32_t backlog;
+    uint32_t max_backlog;
+    /**
+     * Time (in microseconds) between queueing and execution.
+     */
+    uint64_t total_latency;
+    uint64_t max_latency;
+};
+
+/**
+ * Queue of work items executed by a dedicated kernel thread. Work functions
+ * may block.
+ */
+struct workqueue
+{
+    char name[24];
+    spinlock_t lock;
+    struct work *head;
+    struct work *tail;
+    struct task *worker;
+    struct work_stats stats;
+    struct workqueue *next;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int work_initialize();
+
+/**
+ * Queue a work item to run in the current core when the current IRQ returns.
+ * Outside IRQ context the item runs before this function returns. Work
+ * functions run with IRQs masked and must not block.
+ *
+ * Returns EEXIST if the item is already pending.
+ */
+int softirq_raise( struct work *work );
+
+/**
+ * Execute pending softirq work items of the current core. Called in the exit
+ * path of IRQs, with IRQs masked. Items beyond the budget of a call are left
+ * for the next IRQ, raised on the current core with an IPI.
+ */
+void softirq_process();
+
+/**
+ * Create a work queue served by a new kernel thread in the core @c core (or
+ * in the current core, if @c core is negative).
+ */
+int workqueue_create( const char *name, uint32_t priority, int core, struct workqueue **wq );
+
+/**
+ * Queue a work item in @c wq. Returns EEXIST if the item is already pending.
+ */
+int work_queue( struct workqueue *wq, struct work *work );
+
+/**
+ * Queue a work item in the system work queue of the current core.
+ */
+int work_schedule( struct work *work );
+
+void work_register();
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // MACHINA_WORK_H
@@ -0,0 +1,189 @@
+/*
+ * Microbenchmark runner (see 'sys/bench.hh').
+ *
+ * Each sample runs with preemption disabled, so it is not split between cores
+ * and other tasks do not add to it (interrupts still do, which is what the p99
+ * shows). Preemption is enabled between samples and during the setup.
+ */
+
+#include <sys/bench.hh>
+#include <sys/pmu.hh>
+#include <sys/timer.hh>
+#include <sys/task.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<bench> "
+
+// from 'kernel.ld'
+extern "C" struct bench __begin_bench[];
+extern "C" struct bench __end_bench[];
+
+/*
+ * Set while a run is in progress: runs are not nested nor concurrent (samples
+ * are static to keep them out of the task stack).
+ */
+static volatile uint32_t bench_running = 0;
+
+static uint64_t bench_ns[BENCH_SAMPLES];
+static uint64_t bench_cycles[BENCH_SAMPLES];
+
+static void bench_sort( uint64_t *values, size_t count )
+{
+    for (size_t i = 1; i < count; ++i)
+    {
+        uint64_t value = values[i];
+        size_t j = i;
+        for (; j > 0 && values[j - 1] > value; --j)
+            values[j] = values[j - 1];
+        values[j] = value;
+    }
+}
+
+/*
+ * Run @c iterations iterations, returning the elapsed time and cycles.
+ */
+static int bench_sample( struct bench *bench, uint64_t iterations, uint64_t &ns, uint64_t &cycles )
+{
+    struct pmu_counters start, end;
+    task_preempt_disable();
+    pmu_snapshot(&start);
+    uint64_t begin = timer_cycles();
+    int result = bench->func(iterations);
+    uint64_t elapsed = timer_cycles() - begin;
+    pmu_snapshot(&end);
+    task_preempt_enable();
+
+    ns = timer_cycles_to_ns(elapsed);
+    cycles = end.cycles - start.cycles;
+    return result;
+}
+
+static int bench_execute( struct bench *bench )
+{
+    struct bench_result &result = bench->result;
+    memset(&result, 0, sizeof(result));
+
+    // may block (e.g. waiting for a device), so it is not measured
+    if (bench->setup)
+    {
+        result.status = bench->setup();
+        if (result.status != EOK) return result.status;
+    }
+
+    // double the iterations until a sample is long enough for the timer
+    uint64_t iterations = 1;
+    uint64_t ns, cycles;
+    while (true)
+    {
+        result.status = bench_sample(bench, iterations, ns, cycles);
+        if (result.status != EOK) return result.status;
+        if (ns >= BENCH_SAMPLE_NS || iterations >= BENCH_MAX_ITERATIONS) break;
+        iterations *= 2;
+    }
+    result.iterations = iterations;
+
+    for (size_t i = 0; i < BENCH_SAMPLES; ++i)
+    {
+        result.status = bench_sample(bench, iterations, ns, cycles);
+        if (result.status != EOK) return result.status;
+        bench_ns[i] = ns / iterations;
+        bench_cycles[i] = cycles / iterations;
+    }
+
+    bench_sort(bench_ns, BENCH_SAMPLES);
+    bench_sort(bench_cycles, BENCH_SAMPLES);
+    result.min_ns = bench_ns[0];
+    result.median_ns = bench_ns[BENCH_SAMPLES / 2];
+    result.p99_ns = bench_ns[BENCH_SAMPLES * 99 / 100];
+    result.min_cycles = bench_cycles[0];
+    result.median_cycles = bench_cycles[BENCH_SAMPLES / 2];
+    result.p99_cycles = bench_cycles[BENCH_SAMPLES * 99 / 100];
+    return EOK;
+}
+
+static void bench_format( char *p, size_t ps, const struct bench *bench )
+{
+    const struct bench_result &result = bench->result;
+    if (result.status != EOK)
+    {
+        sncatprintf(p, ps, "name=%s status=%d\n", bench->name, result.status);
+        return;
+    }
+    sncatprintf(p, ps, "name=%s iterations=%lu min_ns=%lu median_ns=%lu p99_ns=%lu min_cycles=%lu median_cycles=%lu p99_cycles=%lu\n",
+        bench->name,
+        result.iterations,
+        result.min_ns,
+        result.median_ns,
+        result.p99_ns,
+        result.min_cycles,
+        result.median_cycles,
+        result.p99_cycles);
+}
+
+int bench_run( const char *name )
+{
+    int found = 0;
+
+    if (__atomic_exchange_n(&bench_running, 1U, __ATOMIC_ACQUIRE) != 0) return EBUSY;
+    for (struct bench *bench = __begin_bench; bench < __end_bench; ++bench)
+    {
+        if (name && strcmp(bench->name, name) != 0) continue;
+        ++found;
+
+        char line[256];
+        line[0] = 0;
+        bench_execute(bench);
+        bench_format(line, sizeof(line), bench);
+        uart_print(LOG_TITLE "%s", line);
+    }
+    // end marker for scripts reading the UART (see 'tools/qemubench')
+    uart_print(LOG_TITLE "done count=%d\n", found);
+    __atomic_store_n(&bench_running, 0U, __ATOMIC_RELEASE);
+
+    return (found > 0) ? EOK : ENOENT;
+}
+
+static int proc_bench( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    for (struct bench *bench = __begin_bench; bench < __end_bench; ++bench)
+        bench_format(p, ps, bench);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+/*
+ * Accepts "run" and "run <name>".
+ */
+static int proc_bench_write( const uint8_t *buffer, int size, void * /* data */ )
+{
+    char line[64];
+    int length = size;
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' ')) --length;
+    if (length >= (int) sizeof(line)) return EARGUMENT;
+    memcpy(line, buffer, (size_t) length);
+    line[length] = 0;
+
+    int result;
+    if (strcmp(line, "run") == 0)
+        result = bench_run(nullptr);
+    else
+    if (strncmp(line, "run ", 4) == 0)
+        result = bench_run(line + 4);
+    else
+        result = EARGUMENT;
+    return (result == EOK) ? size : result;
+}
+
+void bench_register()
+{
+    procfs_register_rw("/bench", proc_bench, proc_bench_write, nullptr);
+}
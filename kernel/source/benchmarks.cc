@@ -0,0 +1,120 @@
+/*
+ * Kernel microbenchmarks (see 'sys/bench.hh').
+ */
+
+#include <sys/bench.hh>
+#include <sys/pmm.hh>
+#include <sys/heap.h>
+#include <sys/vfs.h>
+#include <sys/device.hh>
+#include <sys/display.hh>
+#include <sys/cache.h>
+#include <sys/system.h>
+#include <sys/errors.h>
+#include <mc/string.h>
+
+#define BENCH_COPY_SIZE      4096
+
+/*
+ * Area redrawn by the display benchmark.
+ */
+#define BENCH_DRAW_WIDTH     640
+#define BENCH_DRAW_HEIGHT    480
+#define BENCH_DRAW_DEPTH     2
+
+BENCHMARK(pmm_allocate)
+{
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        uintptr_t frame = pmm_allocate(1, PFT_ALLOCATED);
+        if (frame == 0) return EMEMORY;
+        pmm_free(frame, 1);
+    }
+    return EOK;
+}
+
+BENCHMARK(heap_allocate)
+{
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        void *block = heap_allocate(64);
+        if (block == nullptr) return EMEMORY;
+        heap_free(block);
+    }
+    return EOK;
+}
+
+BENCHMARK(memcpy_4k)
+{
+    static uint8_t source[BENCH_COPY_SIZE] __attribute__((aligned(SYS_PAGE_SIZE)));
+    static uint8_t target[BENCH_COPY_SIZE] __attribute__((aligned(SYS_PAGE_SIZE)));
+
+    for (uint64_t i = 0; i < iterations; ++i)
+        memcpy(target, source, BENCH_COPY_SIZE);
+    return EOK;
+}
+
+/*
+ * Cache maintenance of a DMA-sized buffer (by address, below the set/way
+ * threshold).
+ */
+BENCHMARK(cache_clean_invalidate_4k)
+{
+    static uint8_t buffer[BENCH_COPY_SIZE] __attribute__((aligned(SYS_PAGE_SIZE)));
+
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        buffer[i % BENCH_COPY_SIZE] = (uint8_t) i;
+        cache_clean_invalidate_range(buffer, BENCH_COPY_SIZE);
+    }
+    return EOK;
+}
+
+BENCHMARK(vfs_open_read)
+{
+    uint8_t buffer[64];
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        struct file *fp = nullptr;
+        int result = vfs_open("/proc/sysname", 0, &fp);
+        if (result != EOK) return result;
+        result = vfs_read(fp, buffer, sizeof(buffer));
+        vfs_close(fp);
+        if (result < 0) return result;
+    }
+    return EOK;
+}
+
+static device_t *display_dev = nullptr;
+static uint8_t *display_pixels = nullptr;
+
+static int display_setup()
+{
+    // the framebuffer is attached in the background
+    int result = kdev_probe_wait(KVID_PROBE_NAME);
+    if (result != EOK) return result;
+    result = kdev_find(DEV_TYPE_VIDEO, &display_dev);
+    if (result != EOK) return result;
+
+    if (display_pixels == nullptr)
+    {
+        display_pixels = (uint8_t*) heap_allocate(BENCH_DRAW_WIDTH * BENCH_DRAW_HEIGHT * BENCH_DRAW_DEPTH);
+        if (display_pixels == nullptr) return EMEMORY;
+        memset(display_pixels, 0x55, BENCH_DRAW_WIDTH * BENCH_DRAW_HEIGHT * BENCH_DRAW_DEPTH);
+    }
+    return EOK;
+}
+
+/*
+ * Screen refresh: copy a frame to the display.
+ */
+BENCHMARK_SETUP(display_draw, display_setup)
+{
+    const video_api &api = display_dev->driver->dev_api.video;
+    for (uint64_t i = 0; i < iterations; ++i)
+    {
+        int result = api.draw(display_dev, display_pixels, BENCH_DRAW_WIDTH, BENCH_DRAW_HEIGHT, 0, 0, BENCH_DRAW_WIDTH * BENCH_DRAW_DEPTH);
+        if (result != EOK) return result;
+    }
+    return EOK;
+}
@@ -0,0 +1,185 @@
+/*
+ * Boot-phase timing.
+ *
+ * The entry point timestamps its own steps (see 'entrypoint.S') and
+ * 'kernel_main' marks the end of each initialization phase. Timestamps are
+ * raw values of the physical counter of the generic timer, which is usable
+ * before the timer subsystem and counts from reset.
+ */
+
+#include <sys/boot.h>
+#include <sys/procfs.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<boot> "
+
+/**
+ * Number of phases named in the summary as the slowest ones.
+ */
+#define BOOT_SLOWEST     3
+
+#define BOOT_REPORT_SIZE 4096
+
+struct boot_phase
+{
+    const char *name;
+    /**
+     * Counter value at the end of the phase.
+     */
+    uint64_t end;
+};
+
+// from 'entrypoint.S'
+extern "C" uint64_t kvar_boot_stamps[BOOT_STAMPS];
+
+static const char *STAMP_NAMES[BOOT_STAMPS] =
+{
+    "firmware",
+    "entry (EL2 to EL1, BSS)",
+    "core 1 wake-up",
+    "core 2 wake-up",
+    "core 3 wake-up",
+};
+
+static struct boot_phase phases[BOOT_MAX_PHASES];
+
+/*
+ * Written only by the core 0 during the boot; published with release
+ * semantics for readers of '/proc/boottime'.
+ */
+static uint32_t phase_count = 0;
+
+static uint32_t phases_dropped = 0;
+
+static bool boot_finished = false;
+
+static inline uint64_t boot_counter()
+{
+    uint64_t value;
+    __asm__ volatile ("isb; mrs %0, cntpct_el0" : "=r" (value) :: "memory");
+    return value;
+}
+
+static inline uint64_t boot_frequency()
+{
+    uint64_t value;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r" (value));
+    return value;
+}
+
+static void boot_append( const char *name, uint64_t end )
+{
+    if (phase_count == BOOT_MAX_PHASES)
+    {
+        ++phases_dropped;
+        return;
+    }
+    phases[phase_count].name = name;
+    phases[phase_count].end = end;
+    __atomic_store_n(&phase_count, phase_count + 1, __ATOMIC_RELEASE);
+}
+
+void boot_phase_done( const char *name )
+{
+    uint64_t now = boot_counter();
+    if (boot_finished) return;
+
+    // the first phases come from the entry point
+    if (phase_count == 0)
+    {
+        for (uint32_t i = 0; i < BOOT_STAMPS; ++i)
+            boot_append(STAMP_NAMES[i], kvar_boot_stamps[i]);
+    }
+    boot_append(name, now);
+}
+
+static uint64_t boot_to_us( uint64_t cycles, uint64_t frequency )
+{
+    if (frequency == 0) return 0;
+    return cycles * 1000000ULL / frequency;
+}
+
+/*
+ * Duration of the phase in counter ticks.
+ */
+static uint64_t boot_duration( uint32_t index )
+{
+    uint64_t start = (index == 0) ? 0 : phases[index - 1].end;
+    // phases skipped by the entry point (should not happen)
+    return (phases[index].end < start) ? 0 : phases[index].end - start;
+}
+
+static int proc_boottime( uint8_t *buffer, int size, void *data )
+{
+    (void) data;
+
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    uint32_t count = __atomic_load_n(&phase_count, __ATOMIC_ACQUIRE);
+    uint64_t frequency = boot_frequency();
+    uint64_t total = (count > 0) ? phases[count - 1].end : 0;
+
+    sncatprintf(p, ps, "Phase                          Start (us)  Duration (us)  Share\n");
+    sncatprintf(p, ps, "-----------------------------  ----------  -------------  -----\n");
+
+    uint64_t start = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint64_t duration = boot_duration(i);
+        sncatprintf(p, ps, "%-29s  %10lu  %13lu  %4lu%%\n",
+            phases[i].name,
+            boot_to_us(start, frequency),
+            boot_to_us(duration, frequency),
+            (total == 0) ? 0UL : duration * 100 / total);
+        start += duration;
+    }
+
+    sncatprintf(p, ps, "\n%s: %lu us (counter at %lu Hz)\n",
+        boot_finished ? "Total" : "Total so far", boot_to_us(total, frequency), frequency);
+
+    // the slowest phases, in decreasing order
+    uint32_t slowest[BOOT_SLOWEST];
+    uint32_t slowest_count = 0;
+    for (; slowest_count < BOOT_SLOWEST && slowest_count < count; ++slowest_count)
+    {
+        uint32_t best = count;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            bool taken = false;
+            for (uint32_t j = 0; j < slowest_count; ++j) taken |= slowest[j] == i;
+            if (!taken && (best == count || boot_duration(i) > boot_duration(best))) best = i;
+        }
+        slowest[slowest_count] = best;
+    }
+    if (slowest_count > 0)
+    {
+        sncatprintf(p, ps, "Slowest:");
+        for (uint32_t i = 0; i < slowest_count; ++i)
+            sncatprintf(p, ps, "%s %s", (i == 0) ? "" : ",", phases[slowest[i]].name);
+        sncatprintf(p, ps, "\n");
+    }
+    if (phases_dropped > 0)
+        sncatprintf(p, ps, "Dropped: %d phases\n", phases_dropped);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void boot_finish()
+{
+    boot_finished = true;
+
+    static char report[BOOT_REPORT_SIZE];
+    proc_boottime((uint8_t*) report, sizeof(report), nullptr);
+    uart_puts(LOG_TITLE "Boot phases\n");
+    uart_puts(report);
+}
+
+void boot_register()
+{
+    procfs_register("/boottime", proc_boottime, nullptr);
+}
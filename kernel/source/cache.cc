@@ -0,0 +1,284 @@
+/*
+ * Cache maintenance.
+ *
+ * Range operations work by virtual address on every line of the range; the
+ * line size comes from CTR_EL0. Operations by address are broadcast to the
+ * inner shareable domain, so they also reach the lines held by other cores.
+ *
+ * Above the total size of the data caches, walking the range costs more than
+ * walking the caches: clean operations then use set/way operations in every
+ * core instead (IPI_CACHE_FLUSH). Invalidation always works by address,
+ * since set/way would also discard unrelated dirty lines.
+ */
+
+#include <sys/cache.h>
+#include <sys/smp.h>
+#include <sys/irq.h>
+#include <sys/procfs.h>
+#include <sys/system.h>
+#include <sys/errors.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+/*
+ * Cache types of CLIDR_EL1.
+ */
+#define CACHE_TYPE_NONE          0
+#define CACHE_TYPE_INSTRUCTION   1
+#define CACHE_TYPE_DATA          2
+#define CACHE_TYPE_SEPARATE      3
+#define CACHE_TYPE_UNIFIED       4
+
+enum cache_op
+{
+    CACHE_OP_CLEAN,
+    CACHE_OP_INVALIDATE,
+    CACHE_OP_CLEAN_INVALIDATE
+};
+
+struct cache_level
+{
+    uint32_t type;
+    uint32_t line_size;  // bytes
+    uint32_t ways;
+    uint32_t sets;
+};
+
+static uint32_t dline_size = CACHE_LINE_SIZE;
+static uint32_t iline_size = CACHE_LINE_SIZE;
+
+static struct cache_level levels[CACHE_MAX_LEVELS];
+
+/*
+ * Levels up to the point of coherency (CLIDR_EL1.LoC).
+ */
+static uint32_t level_count = 0;
+
+/*
+ * Ranges from this size (in bytes) are cleaned by set/way; zero until the
+ * geometry is known.
+ */
+static size_t setway_threshold = 0;
+
+static uint32_t cache_log2( uint32_t value )
+{
+    uint32_t result = 0;
+    while ((1U << result) < value) ++result;
+    return result;
+}
+
+static void cache_setway_level( enum cache_op op, uint32_t level )
+{
+    const struct cache_level &info = levels[level];
+    if (info.type < CACHE_TYPE_DATA) return;
+
+    uint32_t way_shift = 32 - cache_log2(info.ways);
+    uint32_t set_shift = cache_log2(info.line_size);
+    for (uint32_t way = 0; way < info.ways; ++way)
+    {
+        // a direct mapped cache has no way field
+        uint64_t way_bits = (info.ways > 1) ? (uint64_t) way << way_shift : 0;
+        for (uint32_t set = 0; set < info.sets; ++set)
+        {
+            uint64_t value = way_bits | ((uint64_t) set << set_shift) | (level << 1);
+            switch (op)
+            {
+                case CACHE_OP_CLEAN:
+                    __asm__ volatile ("dc csw, %0" :: "r" (value) : "memory");
+                    break;
+                case CACHE_OP_INVALIDATE:
+                    __asm__ volatile ("dc isw, %0" :: "r" (value) : "memory");
+                    break;
+                case CACHE_OP_CLEAN_INVALIDATE:
+                    __asm__ volatile ("dc cisw, %0" :: "r" (value) : "memory");
+                    break;
+            }
+        }
+    }
+}
+
+/*
+ * Set/way operation on the levels [first, last) of the current core. Levels
+ * are processed from the innermost one, so cleaned lines are not written to
+ * an outer level already done.
+ */
+static void cache_setway( enum cache_op op, uint32_t first, uint32_t last )
+{
+    for (uint32_t level = first; level < last && level < level_count; ++level)
+        cache_setway_level(op, level);
+    __asm__ volatile ("dsb sy" ::: "memory");
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+static void cache_ipi_flush( uint32_t /* type */ )
+{
+    // the outer levels are shared and done by the sender
+    cache_setway(CACHE_OP_CLEAN_INVALIDATE, 0, 1);
+}
+
+/*
+ * Whether the range is better cleaned by set/way. Waiting for other cores is
+ * not possible in interrupt handlers.
+ */
+static bool cache_use_setway( size_t size )
+{
+    return setway_threshold != 0 && size >= setway_threshold && !irq_context();
+}
+
+static void cache_flush_cores()
+{
+    // the first level of other cores, then every level of this one
+    smp_ipi_broadcast(IPI_CACHE_FLUSH, true);
+    cache_setway(CACHE_OP_CLEAN_INVALIDATE, 0, level_count);
+}
+
+void cache_initialize()
+{
+    uint64_t ctr;
+    __asm__ volatile ("mrs %0, ctr_el0" : "=r" (ctr));
+    dline_size = 4U << ((ctr >> 16) & 0xF);
+    iline_size = 4U << (ctr & 0xF);
+
+    uint64_t clidr;
+    __asm__ volatile ("mrs %0, clidr_el1" : "=r" (clidr));
+    uint32_t loc = (uint32_t) (clidr >> 24) & 0x7;
+
+    size_t total = 0;
+    level_count = 0;
+    for (uint32_t level = 0; level < loc && level < CACHE_MAX_LEVELS; ++level)
+    {
+        struct cache_level &info = levels[level];
+        memset(&info, 0, sizeof(info));
+        info.type = (uint32_t) (clidr >> (level * 3)) & 0x7;
+        ++level_count;
+        if (info.type < CACHE_TYPE_DATA) continue;
+
+        // select the data (or unified) cache of the level
+        uint64_t ccsidr;
+        __asm__ volatile ("msr csselr_el1, %1; isb; mrs %0, ccsidr_el1"
+            : "=r" (ccsidr) : "r" ((uint64_t) level << 1) : "memory");
+        info.line_size = 16U << (ccsidr & 0x7);
+        info.ways = (uint32_t) ((ccsidr >> 3) & 0x3FF) + 1;
+        info.sets = (uint32_t) ((ccsidr >> 13) & 0x7FFF) + 1;
+        total += (size_t) info.line_size * info.ways * info.sets;
+    }
+
+    smp_ipi_register(IPI_CACHE_FLUSH, cache_ipi_flush);
+    setway_threshold = total;
+}
+
+uint32_t cache_line_size()
+{
+    return dline_size;
+}
+
+void cache_clean_range( const void *addr, size_t size )
+{
+    if (size == 0) return;
+    if (cache_use_setway(size))
+    {
+        cache_flush_cores();
+        return;
+    }
+
+    uintptr_t end = (uintptr_t) addr + size;
+    for (uintptr_t line = (uintptr_t) addr & ~((uintptr_t) dline_size - 1); line < end; line += dline_size)
+        __asm__ volatile ("dc cvac, %0" :: "r" (line) : "memory");
+    __asm__ volatile ("dsb sy" ::: "memory");
+}
+
+int cache_invalidate_range( void *addr, size_t size )
+{
+    // partial lines would lose the data around the buffer
+    if ((((uintptr_t) addr | size) & (CACHE_LINE_SIZE - 1)) != 0) return EARGUMENT;
+    if (size == 0) return EOK;
+
+    uintptr_t end = (uintptr_t) addr + size;
+    for (uintptr_t line = (uintptr_t) addr; line < end; line += dline_size)
+        __asm__ volatile ("dc ivac, %0" :: "r" (line) : "memory");
+    __asm__ volatile ("dsb sy" ::: "memory");
+    return EOK;
+}
+
+void cache_clean_invalidate_range( const void *addr, size_t size )
+{
+    if (size == 0) return;
+    if (cache_use_setway(size))
+    {
+        cache_flush_cores();
+        return;
+    }
+
+    uintptr_t end = (uintptr_t) addr + size;
+    for (uintptr_t line = (uintptr_t) addr & ~((uintptr_t) dline_size - 1); line < end; line += dline_size)
+        __asm__ volatile ("dc civac, %0" :: "r" (line) : "memory");
+    __asm__ volatile ("dsb sy" ::: "memory");
+}
+
+void cache_sync_instructions( const void *addr, size_t size )
+{
+    if (size == 0) return;
+
+    uintptr_t end = (uintptr_t) addr + size;
+    for (uintptr_t line = (uintptr_t) addr & ~((uintptr_t) dline_size - 1); line < end; line += dline_size)
+        __asm__ volatile ("dc cvau, %0" :: "r" (line) : "memory");
+    __asm__ volatile ("dsb ish" ::: "memory");
+    for (uintptr_t line = (uintptr_t) addr & ~((uintptr_t) iline_size - 1); line < end; line += iline_size)
+        __asm__ volatile ("ic ivau, %0" :: "r" (line) : "memory");
+    __asm__ volatile ("dsb ish" ::: "memory");
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+void cache_clean_all()
+{
+    cache_setway(CACHE_OP_CLEAN, 0, level_count);
+}
+
+void cache_invalidate_all()
+{
+    cache_setway(CACHE_OP_INVALIDATE, 0, level_count);
+}
+
+void cache_clean_invalidate_all()
+{
+    cache_setway(CACHE_OP_CLEAN_INVALIDATE, 0, level_count);
+}
+
+static const char *CACHE_TYPES[] = { "none", "instruction", "data", "separate", "unified" };
+
+static int proc_cache( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Level  Type         Line  Ways  Sets   Size (KB)\n");
+    sncatprintf(p, ps, "-----  -----------  ----  ----  -----  ---------\n");
+    for (uint32_t i = 0; i < level_count; ++i)
+    {
+        const struct cache_level &info = levels[i];
+        const char *type = (info.type <= CACHE_TYPE_UNIFIED) ? CACHE_TYPES[info.type] : "?";
+        if (info.type < CACHE_TYPE_DATA)
+        {
+            sncatprintf(p, ps, "L%-4d  %-11s\n", i + 1, type);
+            continue;
+        }
+        sncatprintf(p, ps, "L%-4d  %-11s  %-4d  %-4d  %-5d  %9d\n",
+            i + 1,
+            type,
+            info.line_size,
+            info.ways,
+            info.sets,
+            info.line_size * info.ways * info.sets / 1024);
+    }
+    sncatprintf(p, ps, "\nMinimum line: %d bytes (data), %d bytes (instruction)\n", dline_size, iline_size);
+    sncatprintf(p, ps, "Set/way from: %lu KB\n", setway_threshold / 1024);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void cache_register()
+{
+    procfs_register("/cache", proc_cache, nullptr);
+}
@@ -0,0 +1,305 @@
+/*
+ * ARM clock scaling through the firmware clock-rate tags.
+ *
+ * The firmware boots the cores below their maximum rate. The performance
+ * governor requests the maximum once; the on-demand governor samples the
+ * idle time of every core and requests a rate proportional to the load of
+ * the busiest one, or the maximum above CPUFREQ_UP_THRESHOLD. Rate changes
+ * are sent asynchronously (see 'mailbox_batch_start'), so the sampling timer
+ * never waits for the firmware.
+ */
+
+#include <sys/cpufreq.h>
+#include <sys/mailbox.h>
+#include <sys/timer.hh>
+#include <sys/job.h>
+#include <sys/work.h>
+#include <sys/smp.h>
+#include <sys/system.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE            "<cpufreq> "
+
+#define CPUFREQ_MHZ          1000000U
+
+/*
+ * Bits of the value of MAILBOX_TAG_GET_THROTTLED; the same bits shifted by
+ * 16 tell whether the condition happened since the boot.
+ */
+#define THROTTLED_UNDERVOLTAGE  (1U << 0)
+#define THROTTLED_CAPPED        (1U << 1)
+#define THROTTLED_ACTIVE        (1U << 2)
+#define THROTTLED_SOFT_LIMIT    (1U << 3)
+
+static const char *GOVERNOR_NAMES[] = { "performance", "ondemand" };
+
+static bool cpufreq_available = false;
+
+static enum cpufreq_governor governor = CPUFREQ_DEFAULT_GOVERNOR;
+
+static uint32_t min_hz = 0;
+static uint32_t max_hz = 0;
+
+/*
+ * Rate confirmed by the firmware and last rate requested.
+ */
+static uint32_t current_hz = 0;
+static uint32_t target_hz = 0;
+
+static uint64_t transitions = 0;
+
+/*
+ * Load (in percent) of the last sample of the on-demand governor.
+ */
+static uint32_t last_load = 0;
+
+static uint64_t sample_ns = 0;
+static uint64_t sample_idle_ns[SYS_CPU_CORES];
+
+/*
+ * Single rate change in flight: the sampler skips its decision while the
+ * previous one is pending.
+ */
+static volatile uint32_t request_busy = 0;
+static struct mailbox_batch request_batch;
+static struct mailbox_request request;
+static struct clock_set_rate_tag *request_tag;
+
+static void cpufreq_sample( struct timer_event *event );
+
+static struct timer_event sampler = TIMER_EVENT_INITIALIZER(cpufreq_sample, nullptr);
+
+static int cpufreq_request( uint32_t rate );
+
+/*
+ * Request the maximum rate when the governor changed to performance while a
+ * request was pending.
+ */
+static void cpufreq_reselect( struct work * /* work */ )
+{
+    if (governor == CPUFREQ_PERFORMANCE && __atomic_load_n(&target_hz, __ATOMIC_RELAXED) != max_hz)
+        cpufreq_request(max_hz);
+}
+
+static struct work reselect = WORK_INITIALIZER(cpufreq_reselect, nullptr);
+
+static void cpufreq_request_done( struct mailbox_request * /* request */ )
+{
+    if (mailbox_batch_status(&request_batch) == EOK && mailbox_batch_done(&request_tag->header))
+    {
+        if (request_tag->rate != current_hz) ++transitions;
+        __atomic_store_n(&current_hz, request_tag->rate, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&request_busy, 0U, __ATOMIC_RELEASE);
+
+    // the governor changed while the request was pending: the request is
+    // sent again from a work queue, not from the mailbox completion
+    if (governor == CPUFREQ_PERFORMANCE && __atomic_load_n(&target_hz, __ATOMIC_RELAXED) != max_hz)
+        work_schedule(&reselect);
+}
+
+/*
+ * Request a new rate without waiting for the firmware. Returns EEXIST while
+ * the previous request is pending.
+ */
+static int cpufreq_request( uint32_t rate )
+{
+    if (__atomic_exchange_n(&request_busy, 1U, __ATOMIC_ACQUIRE) != 0) return EEXIST;
+
+    mailbox_batch_init(&request_batch);
+    request_tag = mailbox_batch_add_tag(&request_batch, MAILBOX_TAG_SET_CLOCK_RATE, struct clock_set_rate_tag);
+    if (request_tag == nullptr)
+    {
+        __atomic_store_n(&request_busy, 0U, __ATOMIC_RELEASE);
+        return EMEMORY;
+    }
+    request_tag->id = MAILBOX_CLOCK_ARM;
+    request_tag->rate = rate;
+    request_tag->skip_turbo = 0;
+
+    __atomic_store_n(&target_hz, rate, __ATOMIC_RELAXED);
+    int result = mailbox_batch_start(&request_batch, &request, cpufreq_request_done, nullptr);
+    if (result != EOK) __atomic_store_n(&request_busy, 0U, __ATOMIC_RELEASE);
+    return result;
+}
+
+static void cpufreq_sample( struct timer_event * /* event */ )
+{
+    uint64_t now = timer_ns();
+    uint64_t elapsed = now - sample_ns;
+    sample_ns = now;
+    if (elapsed == 0) return;
+
+    // load of the busiest core
+    uint32_t load = 0;
+    for (uint32_t i = 0; i < smp_cores() && i < SYS_CPU_CORES; ++i)
+    {
+        uint64_t idle = job_idle_ns(i);
+        uint64_t delta = idle - sample_idle_ns[i];
+        sample_idle_ns[i] = idle;
+        if (delta > elapsed) delta = elapsed;
+        uint32_t core_load = (uint32_t) (100 - delta * 100 / elapsed);
+        if (core_load > load) load = core_load;
+    }
+    last_load = load;
+
+    uint32_t rate = max_hz;
+    if (load < CPUFREQ_UP_THRESHOLD)
+    {
+        rate = min_hz + (uint32_t) ((uint64_t) (max_hz - min_hz) * load / 100);
+        rate = rate / CPUFREQ_MHZ * CPUFREQ_MHZ;
+        if (rate < min_hz) rate = min_hz;
+    }
+    if (rate != __atomic_load_n(&target_hz, __ATOMIC_RELAXED))
+        cpufreq_request(rate);
+}
+
+int cpufreq_set_governor( enum cpufreq_governor value )
+{
+    if (!cpufreq_available) return ENOIMP;
+    if (value != CPUFREQ_PERFORMANCE && value != CPUFREQ_ONDEMAND) return EARGUMENT;
+
+    governor = value;
+    if (governor == CPUFREQ_PERFORMANCE)
+    {
+        timer_cancel(&sampler);
+        last_load = 0;
+        // a pending request selects the maximum once done
+        int result = cpufreq_request(max_hz);
+        return (result == EEXIST) ? EOK : result;
+    }
+
+    sample_ns = timer_ns();
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        sample_idle_ns[i] = job_idle_ns(i);
+    return timer_schedule(&sampler, CPUFREQ_SAMPLE_US, CPUFREQ_SAMPLE_US);
+}
+
+int cpufreq_initialize()
+{
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+    struct clock_rate_tag *min = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_MIN_CLOCK_RATE, struct clock_rate_tag);
+    struct clock_rate_tag *max = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_MAX_CLOCK_RATE, struct clock_rate_tag);
+    struct clock_rate_tag *rate = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_CLOCK_RATE, struct clock_rate_tag);
+    if (min == nullptr || max == nullptr || rate == nullptr) return EMEMORY;
+    min->id = max->id = rate->id = MAILBOX_CLOCK_ARM;
+
+    int result = mailbox_batch_submit(&batch);
+    if (result != EOK) return result;
+    if (!mailbox_batch_done(&min->header) || !mailbox_batch_done(&max->header) || max->rate == 0)
+    {
+        uart_puts(LOG_TITLE "ARM clock range not reported by the firmware\n");
+        return ENOIMP;
+    }
+
+    min_hz = (min->rate <= max->rate) ? min->rate : max->rate;
+    max_hz = max->rate;
+    current_hz = target_hz = mailbox_batch_done(&rate->header) ? rate->rate : 0;
+    cpufreq_available = true;
+    uart_print(LOG_TITLE "ARM clock %d MHz (%d - %d MHz)\n",
+        current_hz / CPUFREQ_MHZ, min_hz / CPUFREQ_MHZ, max_hz / CPUFREQ_MHZ);
+
+    return cpufreq_set_governor(governor);
+}
+
+uint32_t cpufreq_current()
+{
+    return __atomic_load_n(&current_hz, __ATOMIC_RELAXED);
+}
+
+static void cpufreq_print_throttled( char *p, size_t ps, uint32_t value )
+{
+    if ((value & 0xFU) == 0)
+    {
+        sncatprintf(p, ps, " no");
+    }
+    else
+    {
+        if (value & THROTTLED_UNDERVOLTAGE) sncatprintf(p, ps, " under-voltage");
+        if (value & THROTTLED_CAPPED) sncatprintf(p, ps, " capped");
+        if (value & THROTTLED_ACTIVE) sncatprintf(p, ps, " throttled");
+        if (value & THROTTLED_SOFT_LIMIT) sncatprintf(p, ps, " soft-limit");
+    }
+}
+
+static int proc_cpufreq( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    if (!cpufreq_available)
+    {
+        sncatprintf(p, ps, "Not available\n");
+        return (int) (strlen(p) * sizeof(char));
+    }
+
+    // the firmware may run the clock below the requested rate
+    struct mailbox_batch batch;
+    mailbox_batch_init(&batch);
+    struct clock_rate_tag *rate = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_CLOCK_RATE, struct clock_rate_tag);
+    struct temperature_tag *temperature = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_TEMPERATURE, struct temperature_tag);
+    struct throttled_tag *throttled = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_THROTTLED, struct throttled_tag);
+    if (rate == nullptr || temperature == nullptr || throttled == nullptr) return EMEMORY;
+    rate->id = MAILBOX_CLOCK_ARM;
+    temperature->id = 0;
+    bool answered = mailbox_batch_submit(&batch) == EOK;
+
+    sncatprintf(p, ps, "Governor: %s (available: %s %s)\n",
+        GOVERNOR_NAMES[governor], GOVERNOR_NAMES[CPUFREQ_PERFORMANCE], GOVERNOR_NAMES[CPUFREQ_ONDEMAND]);
+    sncatprintf(p, ps, "Range: %d - %d MHz\n", min_hz / CPUFREQ_MHZ, max_hz / CPUFREQ_MHZ);
+    sncatprintf(p, ps, "Requested: %d MHz%s\n", target_hz / CPUFREQ_MHZ,
+        __atomic_load_n(&request_busy, __ATOMIC_ACQUIRE) ? " (pending)" : "");
+    if (answered && mailbox_batch_done(&rate->header))
+        sncatprintf(p, ps, "Current: %d MHz\n", rate->rate / CPUFREQ_MHZ);
+    else
+        sncatprintf(p, ps, "Current: %d MHz (last confirmed)\n", cpufreq_current() / CPUFREQ_MHZ);
+    if (governor == CPUFREQ_ONDEMAND)
+        sncatprintf(p, ps, "Load: %d%%\n", last_load);
+    sncatprintf(p, ps, "Transitions: %lu\n", transitions);
+    if (answered && mailbox_batch_done(&temperature->header))
+        sncatprintf(p, ps, "Temperature: %d.%d C\n", temperature->value / 1000, temperature->value % 1000 / 100);
+    if (answered && mailbox_batch_done(&throttled->header))
+    {
+        sncatprintf(p, ps, "Throttled:");
+        cpufreq_print_throttled(p, ps, throttled->value);
+        sncatprintf(p, ps, "\nThrottled since boot:");
+        cpufreq_print_throttled(p, ps, throttled->value >> 16);
+        sncatprintf(p, ps, "\n");
+    }
+    else
+        sncatprintf(p, ps, "Throttled: unknown\n");
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+static int proc_cpufreq_write( const uint8_t *buffer, int size, void * /* data */ )
+{
+    char command[16];
+    int length = size;
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' ')) --length;
+    if (length >= (int) sizeof(command)) return EARGUMENT;
+    memcpy(command, buffer, (size_t) length);
+    command[length] = 0;
+
+    int result;
+    if (strcmp(command, GOVERNOR_NAMES[CPUFREQ_PERFORMANCE]) == 0)
+        result = cpufreq_set_governor(CPUFREQ_PERFORMANCE);
+    else
+    if (strcmp(command, GOVERNOR_NAMES[CPUFREQ_ONDEMAND]) == 0)
+        result = cpufreq_set_governor(CPUFREQ_ONDEMAND);
+    else
+        result = EARGUMENT;
+    return (result == EOK) ? size : result;
+}
+
+void cpufreq_register()
+{
+    procfs_register_rw("/cpufreq", proc_cpufreq, proc_cpufreq_write, nullptr);
+}
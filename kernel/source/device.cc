@@ -2,12 +2,33 @@
 #include <sys/uart.h>
 #include <sys/device.hh>
 #include <sys/heap.h>
+#include <sys/sync.h>
+#include <sys/rcu.h>
+#include <sys/trace.hh>
+#include <sys/job.h>
+#include <sys/smp.h>
+#include <sys/timer.hh>
+#include <sys/procfs.h>
 #include <mc/stdio.h>
 #include <mc/string.h>
 
+/*
+ * Lists read without locks (see 'rcu.h'); writers are serialized by
+ * 'kdev_lock'.
+ */
 static system_bus_t *bus_list = nullptr;
 static device_driver_t *driver_list = nullptr;
 
+static spinlock_t kdev_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Probes in registration order. Appended under 'kdev_lock' and never removed,
+ * so readers walk the list without locks.
+ */
+static device_probe *probe_list = nullptr;
+
+static bool probes_started = false;
+
 static system_bus_t *kdev_create_bus( const char *name )
 {
     system_bus_t *bus = (system_bus_t*) heap_allocate( sizeof(system_bus_t) + strlen(name) + 1 );
@@ -33,18 +54,31 @@ static int local_bus_attach(system_bus_t *bus, device_t *dev)
     // attach the driver
     if (dev->driver == nullptr)
     {
-        // try to find a compatible driver
-        device_driver_t *drv = driver_list;
-        for (;result != EOK && drv; drv = drv->next)
+        // try to find a compatible driver; drivers are never unregistered,
+        // so each one remains valid outside the read-side section, where
+        // 'attach' may block
+        rcu_read_lock();
+        device_driver_t *drv = rcu_dereference(driver_list);
+        rcu_read_unlock();
+        while (result != EOK && drv)
+        {
             result = drv->attach(drv, dev);
+            rcu_read_lock();
+            drv = rcu_dereference(drv->next);
+            rcu_read_unlock();
+        }
         if (result != EOK)
             return result;
     }
 
     // append the device
+    spin_lock(&kdev_lock);
     dev->next = bus->devices;
-    bus->devices = dev;
+    rcu_assign_pointer(bus->devices, dev);
+    spin_unlock(&kdev_lock);
 
+    trace_event(device_attach, "device_attach device=%p vendor=%x product=%x\n",
+        dev, dev->id_vendor, dev->id_product);
     return EOK;
 }
 
@@ -71,10 +105,15 @@ static system_bus_t *kdev_create_local_bus()
     bus->remove = local_bus_remove;
     bus->suspend = local_bus_suspend;
     bus->resume = local_bus_resume;
-    bus->next = bus_list;
     bus->devices = nullptr;
+
+    spin_lock(&kdev_lock);
+    bus->next = bus_list;
+    rcu_assign_pointer(bus_list, bus);
+    spin_unlock(&kdev_lock);
+
     puts("Created bus \"local\"\n");
-    return bus_list = bus;
+    return bus;
 }
 
 //
@@ -93,23 +132,29 @@ int kdev_initialize()
         device_driver_t *drv;
         result = kvid_initialize(bus, &dev, &drv);
     }
+    // the drivers only register their probes: attach the devices in the
+    // background
+    kdev_probe_start();
     return result;
 }
 
 int kdev_enumerate()
 {
-    system_bus_t *bus = bus_list;
+    rcu_read_lock();
+    system_bus_t *bus = rcu_dereference(bus_list);
     while (bus)
     {
         kdev_enumerate_bus(bus);
-        bus = bus->next;
+        bus = rcu_dereference(bus->next);
     }
+    rcu_read_unlock();
     return EOK;
 }
 
 int kdev_enumerate_bus( system_bus_t *bus )
 {
-    device_t *dev = bus->devices;
+    rcu_read_lock();
+    device_t *dev = rcu_dereference(bus->devices);
     while (dev)
     {
         uart_print("[%s.%d] [%04X:%04X] %s (%s)\n",
@@ -119,26 +164,245 @@ int kdev_enumerate_bus( system_bus_t *bus )
             dev->id_vendor,
             dev->name,
             dev->driver->name);
-        dev = dev->next;
+        dev = rcu_dereference(dev->next);
     }
+    rcu_read_unlock();
     return EOK;
 }
 
+int kdev_find( device_type type, device_t **dev )
+{
+    if (dev == nullptr) return EARGUMENT;
+
+    int result = ENOENT;
+    rcu_read_lock();
+    system_bus_t *bus = rcu_dereference(bus_list);
+    for (; bus && result != EOK; bus = rcu_dereference(bus->next))
+    {
+        device_t *tmp = rcu_dereference(bus->devices);
+        for (; tmp; tmp = rcu_dereference(tmp->next))
+        {
+            if (tmp->driver == nullptr || tmp->driver->dev_type != type) continue;
+            *dev = tmp;
+            result = EOK;
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return result;
+}
+
 int kdev_register_driver( device_driver_t *drv )
 {
     if (drv == nullptr) return EARGUMENT;
 
+    spin_lock(&kdev_lock);
     // check whether the driver is already registered
     device_driver_t *tmp = driver_list;
     while (tmp)
     {
         if (tmp == drv || strcmp(tmp->name, drv->name) == 0)
+        {
+            spin_unlock(&kdev_lock);
             return EEXIST;
+        }
         tmp = tmp->next;
     }
     // include the driver
     drv->next = driver_list;
-    driver_list = drv;
+    rcu_assign_pointer(driver_list, drv);
+    spin_unlock(&kdev_lock);
 
     return EOK;
-}
\ No newline at end of file
+}
+
+//
+// Probes
+//
+
+static device_probe *kdev_probe_find( const char *name )
+{
+    device_probe *probe = __atomic_load_n(&probe_list, __ATOMIC_ACQUIRE);
+    for (; probe; probe = __atomic_load_n(&probe->next, __ATOMIC_ACQUIRE))
+    {
+        if (strcmp(probe->name, name) == 0) return probe;
+    }
+    return nullptr;
+}
+
+/*
+ * Returns 1 while any dependency is pending, EOK when all of them succeeded
+ * or the error of the first one that failed (ENOENT if not registered).
+ */
+static int kdev_probe_dependencies( device_probe *probe )
+{
+    if (probe->depends == nullptr) return EOK;
+
+    for (const char *const *name = probe->depends; *name; ++name)
+    {
+        device_probe *dep = kdev_probe_find(*name);
+        if (dep == nullptr) return ENOENT;
+        if (__atomic_load_n(&dep->state, __ATOMIC_ACQUIRE) != PROBE_DONE) return 1;
+        if (dep->result != EOK) return dep->result;
+    }
+    return EOK;
+}
+
+static void kdev_probe_schedule( device_probe *probe );
+
+static void kdev_probe_finish( device_probe *probe, int result )
+{
+    probe->result = result;
+    __atomic_store_n(&probe->state, PROBE_DONE, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&probe->done.value, 1, __ATOMIC_RELEASE);
+    // wake up the cores sleeping in 'job_wait'
+    sync_sendEvent();
+
+    // start the probes depending on this one
+    device_probe *tmp = __atomic_load_n(&probe_list, __ATOMIC_ACQUIRE);
+    for (; tmp; tmp = __atomic_load_n(&tmp->next, __ATOMIC_ACQUIRE))
+        kdev_probe_schedule(tmp);
+}
+
+static void kdev_probe_job( void *arg )
+{
+    device_probe *probe = (device_probe*) arg;
+
+    probe->core = smp_core_id();
+    probe->start_ns = timer_ns();
+    __atomic_store_n(&probe->state, PROBE_RUNNING, __ATOMIC_RELAXED);
+
+    int result = probe->probe(probe);
+
+    probe->end_ns = timer_ns();
+    trace_event(device_probe, "device_probe name=%s result=%d ns=%lu\n",
+        probe->name, result, probe->end_ns - probe->start_ns);
+    if (result != EOK)
+        uart_print("Probe \"%s\" failed with error %d\n", probe->name, result);
+    kdev_probe_finish(probe, result);
+}
+
+static void kdev_probe_schedule( device_probe *probe )
+{
+    if (!__atomic_load_n(&probes_started, __ATOMIC_ACQUIRE)) return;
+    if (__atomic_load_n(&probe->state, __ATOMIC_ACQUIRE) != PROBE_WAITING) return;
+
+    int result = kdev_probe_dependencies(probe);
+    if (result > 0) return;
+
+    // dependencies finishing at the same time may both get here
+    device_probe_state expected = PROBE_WAITING;
+    if (!__atomic_compare_exchange_n(&probe->state, &expected, PROBE_QUEUED, false,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+
+    if (result != EOK)
+    {
+        // dependencies failed: do not probe
+        kdev_probe_finish(probe, result);
+        return;
+    }
+    // run in the caller if the job queue is full
+    if (job_submit(kdev_probe_job, probe, nullptr) != EOK)
+        kdev_probe_job(probe);
+}
+
+int kdev_probe_register( device_probe *probe )
+{
+    if (probe == nullptr || probe->name == nullptr || probe->probe == nullptr)
+        return EARGUMENT;
+
+    spin_lock(&kdev_lock);
+    // check whether the probe is already registered
+    device_probe **tail = &probe_list;
+    for (; *tail; tail = &(*tail)->next)
+    {
+        if (*tail == probe || strcmp((*tail)->name, probe->name) == 0)
+        {
+            spin_unlock(&kdev_lock);
+            return EEXIST;
+        }
+    }
+    probe->state = PROBE_WAITING;
+    probe->result = EOK;
+    probe->done.value = 1;
+    probe->next = nullptr;
+    __atomic_store_n(tail, probe, __ATOMIC_RELEASE);
+    spin_unlock(&kdev_lock);
+
+    kdev_probe_schedule(probe);
+    return EOK;
+}
+
+int kdev_probe_start()
+{
+    __atomic_store_n(&probes_started, true, __ATOMIC_RELEASE);
+
+    device_probe *probe = __atomic_load_n(&probe_list, __ATOMIC_ACQUIRE);
+    for (; probe; probe = __atomic_load_n(&probe->next, __ATOMIC_ACQUIRE))
+        kdev_probe_schedule(probe);
+    return EOK;
+}
+
+int kdev_probe_wait( const char *name )
+{
+    if (name == nullptr) return EARGUMENT;
+    // nothing would ever complete the probe
+    if (!__atomic_load_n(&probes_started, __ATOMIC_ACQUIRE)) return EINVALID;
+
+    device_probe *probe = kdev_probe_find(name);
+    if (probe == nullptr) return ENOENT;
+    job_wait(&probe->done);
+    return probe->result;
+}
+
+int kdev_probe_wait_all()
+{
+    if (!__atomic_load_n(&probes_started, __ATOMIC_ACQUIRE)) return EINVALID;
+
+    int result = EOK;
+    device_probe *probe = __atomic_load_n(&probe_list, __ATOMIC_ACQUIRE);
+    for (; probe; probe = __atomic_load_n(&probe->next, __ATOMIC_ACQUIRE))
+    {
+        job_wait(&probe->done);
+        if (result == EOK) result = probe->result;
+    }
+    return result;
+}
+
+static const char *PROBE_STATES[] = { "waiting", "queued", "running", "done" };
+
+static int proc_probes( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Probe             State    Core  Start (us)  Duration (us)  Result\n");
+    sncatprintf(p, ps, "----------------  -------  ----  ----------  -------------  ------\n");
+    device_probe *probe = __atomic_load_n(&probe_list, __ATOMIC_ACQUIRE);
+    for (; probe; probe = __atomic_load_n(&probe->next, __ATOMIC_ACQUIRE))
+    {
+        device_probe_state state = __atomic_load_n(&probe->state, __ATOMIC_ACQUIRE);
+        if (state == PROBE_DONE)
+        {
+            sncatprintf(p, ps, "%-16s  %-7s  %-4d  %10lu  %13lu  %d\n",
+                probe->name,
+                PROBE_STATES[state],
+                probe->core,
+                probe->start_ns / 1000,
+                (probe->end_ns - probe->start_ns) / 1000,
+                probe->result);
+        }
+        else
+            sncatprintf(p, ps, "%-16s  %-7s\n", probe->name, PROBE_STATES[state]);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void kdev_register()
+{
+    procfs_register("/probes", proc_probes, nullptr);
+}
@@ -7,6 +7,8 @@
 #include <mc/string.h>
 #include <sys/uart.h>
 #include <sys/heap.h>
+#include <sys/trace.hh>
+#include <sys/pmu.hh>
 #ifndef __arm__
 #include <iostream>
 #include <cstdlib>
@@ -14,27 +16,6 @@
 
 #define LOG_TITLE  "<display> "
 
-struct __attribute__((__packed__, aligned(4))) vc4_fb_info
-{
-	uint32_t width;           // width of the physical display
-	uint32_t height;          // height of the physical display
-	uint32_t virtual_width;   // width of the virtual framebuffer
-	uint32_t virtual_height;  // height of the virtual framebuffer
-	uint32_t pitch;           // pitch (bytes per line, filled by GPU)
-	uint32_t depth;           // depth (bits per pixel)
-	uint32_t offset_x;        // X offset of the virtual framebuffer
-	uint32_t offset_y;        // Y offset of the virtual framebuffer
-	uint32_t buffer_ptr;      // framebuffer address (filled by GPU)
-	uint32_t buffer_size;    // framebuffer size (in bytes, filled by GPU)
-};
-
-/*
- * We use a global variable because we need a 16-bytes aligned storage.
- *
- * PS: 'aligned' attribute should/could not work in local variables.
- */
-//static __attribute((aligned (16))) vc4_fb_info req;
-
 struct kvid_devinternals
 {
 	uint8_t *buffer;
@@ -60,16 +41,17 @@ static int constexpr kdev_strlen( const char* str )
     return *str ? 1 + kdev_strlen(str + 1) : 0;
 }
 
-void kernel_panic( const char *path, int line );
-
 static int kvid_api_clear( device_t *dev, uint32_t color )
 {
 	return ENOIMP;
 }
 
+static struct pmu_region kvid_region = PMU_REGION_INITIALIZER("display");
+
 static int kvid_api_draw( device_t *dev, void *pixels, int width, int height, int x, int y, int pitch )
 {
 	if (dev == nullptr || pixels == nullptr) return EARGUMENT;
+	pmu_scope scope(&kvid_region);
 	auto &internals = *((kvid_devinternals*) dev->internals);
 
 	if (x < 0 || x + width >= (int32_t) internals.width ||
@@ -85,6 +67,7 @@ static int kvid_api_draw( device_t *dev, void *pixels, int width, int height, in
 		src += pitch;
 		dst += internals.pitch;
 	}
+	trace_event(display_draw, "display_draw x=%d y=%d width=%d\n", x, y, width);
 	return EOK;
 }
 
@@ -98,37 +81,49 @@ static int kvid_drv_attach(device_driver_t *drv, device_t *dev)
 	static kvid_devinternals int_device;
 	uart_puts(LOG_TITLE "Initializing device\n");
 
-	STACK_STRUCT_ALIGNED(req, sizeof(vc4_fb_info), 16, vc4_fb_info);
-
 	int_device.width = 800;   // find out native resolution
 	int_device.height = 600;  // find out native resolution
 	int_device.depth = 16;
 	int_device.pitch = 0;
 
-	req.virtual_width = req.width = int_device.width;
-	req.virtual_height = req.height = int_device.height;
-	req.pitch = int_device.pitch;
-	req.depth = int_device.depth;
-	req.offset_x = 0;
-	req.offset_y = 0;
-	req.buffer_ptr = 0;
-	req.buffer_size = 0;
-
-	// TODO: this is deprecated! should use mailbox tags instead
-	// https://github.com/raspberrypi/firmware/wiki/Mailbox-framebuffer-interface
-	if (!mailbox_send(MB_CHANNEL_FB, (uint32_t) (uintptr_t) &req))
-		kernel_panic(__FILE__, __LINE__);
-
-	int_device.buffer = (uint8_t*) (uintptr_t) ( req.buffer_ptr & 0x3FFFFFFF );
-	int_device.buffer_size = req.buffer_size;
-	int_device.pitch = req.pitch;
+	// set the mode and allocate the framebuffer in a single round trip
+	struct mailbox_batch batch;
+	mailbox_batch_init(&batch);
+	fb_size_tag *physical = mailbox_batch_add_tag(&batch, MAILBOX_TAG_SET_PHYSICAL_WIDTH_HEIGHT, fb_size_tag);
+	fb_size_tag *virt = mailbox_batch_add_tag(&batch, MAILBOX_TAG_SET_VIRTUAL_WIDTH_HEIGHT, fb_size_tag);
+	fb_offset_tag *offset = mailbox_batch_add_tag(&batch, MAILBOX_TAG_SET_VIRTUAL_OFFSET, fb_offset_tag);
+	fb_value_tag *depth = mailbox_batch_add_tag(&batch, MAILBOX_TAG_SET_COLOUR_DEPTH, fb_value_tag);
+	fb_allocate_tag *allocate = mailbox_batch_add_tag(&batch, MAILBOX_TAG_ALLOCATE_FRAMEBUFFER, fb_allocate_tag);
+	fb_value_tag *pitch = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_PITCH, fb_value_tag);
+	if (physical == nullptr || virt == nullptr || offset == nullptr || depth == nullptr || allocate == nullptr || pitch == nullptr)
+		return EMEMORY;
+	physical->width = int_device.width;
+	physical->height = int_device.height;
+	virt->width = int_device.width;
+	virt->height = int_device.height;
+	offset->x = offset->y = 0;
+	depth->value = (uint32_t) int_device.depth;
+	allocate->base = 16; // alignment
+
+	int result = mailbox_batch_submit(&batch);
+	if (result != EOK) return result;
+	if (!mailbox_batch_done(&allocate->header) || !mailbox_batch_done(&pitch->header) || allocate->base == 0)
+		return EINVALID;
+
+	int_device.width = (int32_t) physical->width;
+	int_device.height = (int32_t) physical->height;
+	int_device.depth = (int32_t) depth->value;
+	int_device.buffer = (uint8_t*) (uintptr_t) ( allocate->base & 0x3FFFFFFF );
+	int_device.buffer_size = allocate->size;
+	int_device.pitch = (int32_t) pitch->value;
+	int_device.pixel_size = int_device.depth / 8;
 	dev->internals = &int_device;
 	dev->name = DEV_NAME;
 	dev->vendor = DEV_VENDOR;
 	dev->driver = &def_driver;
 	dev->iobase = nullptr; // VC4 uses mailboxes
 
-	uart_print("%s %dx%d at 0x%08x\n", DEV_NAME, req.width, req.height, int_device.buffer);
+	uart_print("%s %dx%d at 0x%08x\n", DEV_NAME, int_device.width, int_device.height, int_device.buffer);
 
 	return EOK;
 }
@@ -187,6 +182,17 @@ int kvid_create_driver( system_bus_t *bus )
 	return EOK;
 }
 
+/*
+ * The framebuffer allocation blocks on a mailbox round trip: attach the device
+ * in the background.
+ */
+static int kvid_probe( device_probe *probe )
+{
+	return kvid_create_device(probe->bus);
+}
+
+static device_probe def_probe = DEVICE_PROBE_INITIALIZER(KVID_PROBE_NAME, kvid_probe, nullptr, nullptr, nullptr);
+
 int kvid_initialize( system_bus_t *bus, device_t **dev, device_driver_t **drv )
 {
 	if (bus == nullptr || dev == nullptr || drv == nullptr) return EARGUMENT;
@@ -195,8 +201,8 @@ int kvid_initialize( system_bus_t *bus, device_t **dev, device_driver_t **drv )
 	if (result) return result;
 	result = kdev_register_driver(&def_driver);
 	if (result) return result;
-	result = kvid_create_device(bus);
-	return result;
+	def_probe.bus = bus;
+	return kdev_probe_register(&def_probe);
 }
 
 #if 0
@@ -0,0 +1,289 @@
+/*
+ * Cooperative fibers.
+ *
+ * Fibers are bound to the core they were created in and are scheduled by
+ * 'fiber_run', which keeps switching between the ready fibers of the core
+ * until all of them terminate. A fiber only gives up the core by calling
+ * 'fiber_yield' or 'fiber_await', so switches save just the callee-saved
+ * registers (see 'fiber.S').
+ *
+ * The execution context running the scheduler (a kernel thread or the boot
+ * context) may still be preempted; its fibers are suspended with it.
+ */
+
+#include <sys/fiber.h>
+#include <sys/task.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/heap.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) fiber_core
+{
+    spinlock_t lock;
+    struct fiber *head;
+    struct fiber *tail;
+    /**
+     * Number of fibers of this core which did not terminate yet.
+     */
+    uint32_t count;
+    struct fiber *current;
+    /**
+     * Execution context running the scheduler and its saved registers.
+     */
+    bool running;
+    struct task *owner;
+    struct fiber_context main;
+    uint64_t created;
+    uint64_t switches;
+    uint64_t waits;
+};
+
+static struct fiber_core cores[SYS_CPU_CORES];
+
+static uint32_t fiber_counter = 0;
+
+// from 'fiber.S'
+extern "C" void fiber_switch( struct fiber_context *from, struct fiber_context *to );
+extern "C" void fiber_entry_stub();
+
+static void fiber_enqueue( struct fiber_core &core, struct fiber *fiber )
+{
+    fiber->next = nullptr;
+    if (core.tail)
+        core.tail->next = fiber;
+    else
+        core.head = fiber;
+    core.tail = fiber;
+}
+
+static struct fiber *fiber_dequeue( struct fiber_core &core )
+{
+    struct fiber *fiber = core.head;
+    if (fiber == nullptr) return nullptr;
+    core.head = fiber->next;
+    if (core.head == nullptr) core.tail = nullptr;
+    fiber->next = nullptr;
+    return fiber;
+}
+
+/*
+ * Make a fiber ready to run, possibly from another core.
+ */
+static void fiber_ready( struct fiber *fiber )
+{
+    struct fiber_core &core = cores[fiber->core];
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    fiber->state = FIBER_READY;
+    fiber_enqueue(core, fiber);
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    // the scheduler may be sleeping because all fibers are waiting
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+}
+
+/*
+ * Give the core back to the scheduler.
+ */
+static void fiber_suspend( struct fiber_core &core, struct fiber *fiber )
+{
+    fiber_switch(&fiber->context, &core.main);
+}
+
+extern "C" void fiber_trampoline( struct fiber *fiber )
+{
+    fiber->entry(fiber->arg);
+
+    struct fiber_core &core = cores[fiber->core];
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    fiber->state = FIBER_DEAD;
+    --core.count;
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    // the scheduler releases the stack after the switch
+    fiber_suspend(core, fiber);
+}
+
+int fiber_create( fiber_entry_t entry, void *arg, size_t stack_size, struct fiber **fiber )
+{
+    if (entry == nullptr) return EARGUMENT;
+    if (stack_size == 0) stack_size = FIBER_STACK_SIZE;
+
+    struct fiber *tmp = (struct fiber*) heap_allocate(sizeof(struct fiber));
+    if (tmp == nullptr) return EMEMORY;
+    memset(tmp, 0, sizeof(*tmp));
+
+    tmp->stack = (uint8_t*) heap_allocate(stack_size);
+    if (tmp->stack == nullptr)
+    {
+        heap_free(tmp);
+        return EMEMORY;
+    }
+    tmp->stack_size = stack_size;
+    tmp->id = __atomic_add_fetch(&fiber_counter, 1, __ATOMIC_RELAXED);
+    tmp->core = smp_core_id();
+    tmp->entry = entry;
+    tmp->arg = arg;
+
+    // the first switch "returns" to 'fiber_entry_stub' with the fiber in 'x19'
+    uintptr_t top = ((uintptr_t) tmp->stack + stack_size) & ~((uintptr_t) 0xF);
+    tmp->context.x[0] = (uint64_t) (uintptr_t) tmp;
+    tmp->context.x[11] = (uint64_t) (uintptr_t) fiber_entry_stub;
+    tmp->context.sp = (uint64_t) top;
+
+    struct fiber_core &core = cores[tmp->core];
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    ++core.count;
+    ++core.created;
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    if (fiber) *fiber = tmp;
+    fiber_ready(tmp);
+    return EOK;
+}
+
+int fiber_run()
+{
+    struct fiber_core &core = cores[smp_core_id()];
+    if (core.running) return EEXIST;
+    core.running = true;
+    core.owner = task_current();
+
+    while (true)
+    {
+        uint64_t flags = spin_lock_irqsave(&core.lock);
+        struct fiber *fiber = fiber_dequeue(core);
+        uint32_t count = core.count;
+        if (fiber) fiber->state = FIBER_RUNNING;
+        spin_unlock_irqrestore(&core.lock, flags);
+
+        if (fiber == nullptr)
+        {
+            if (count == 0) break;
+            // every fiber is waiting for an event
+            sync_waitEvent();
+            continue;
+        }
+
+        core.current = fiber;
+        ++core.switches;
+        ++fiber->switches;
+        fiber_switch(&core.main, &fiber->context);
+        core.current = nullptr;
+
+        if (fiber->state == FIBER_DEAD)
+        {
+            heap_free(fiber->stack);
+            heap_free(fiber);
+        }
+    }
+
+    core.owner = nullptr;
+    core.running = false;
+    return EOK;
+}
+
+struct fiber *fiber_current()
+{
+    struct fiber_core &core = cores[smp_core_id()];
+    if (!core.running || core.owner != task_current()) return nullptr;
+    return core.current;
+}
+
+void fiber_yield()
+{
+    struct fiber *fiber = fiber_current();
+    if (fiber == nullptr) return;
+
+    fiber_ready(fiber);
+    fiber_suspend(cores[fiber->core], fiber);
+}
+
+void fiber_await( struct fiber_event *event )
+{
+    if (event == nullptr) return;
+
+    struct fiber *fiber = fiber_current();
+    if (fiber == nullptr)
+    {
+        while (__atomic_load_n(&event->signaled, __ATOMIC_ACQUIRE) == 0)
+            sync_waitEvent();
+        return;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&event->lock);
+    if (event->signaled)
+    {
+        spin_unlock_irqrestore(&event->lock, flags);
+        return;
+    }
+    fiber->state = FIBER_WAITING;
+    fiber->next = event->waiters;
+    event->waiters = fiber;
+    spin_unlock_irqrestore(&event->lock, flags);
+
+    struct fiber_core &core = cores[fiber->core];
+    ++core.waits;
+    fiber_suspend(core, fiber);
+}
+
+void fiber_event_signal( struct fiber_event *event )
+{
+    if (event == nullptr) return;
+
+    uint64_t flags = spin_lock_irqsave(&event->lock);
+    __atomic_store_n(&event->signaled, 1U, __ATOMIC_RELEASE);
+    struct fiber *waiters = event->waiters;
+    event->waiters = nullptr;
+    spin_unlock_irqrestore(&event->lock, flags);
+
+    while (waiters)
+    {
+        struct fiber *next = waiters->next;
+        fiber_ready(waiters);
+        waiters = next;
+    }
+
+    // wake up callers of 'fiber_await' which are not fibers
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+}
+
+void fiber_event_reset( struct fiber_event *event )
+{
+    if (event == nullptr) return;
+    __atomic_store_n(&event->signaled, 0U, __ATOMIC_RELEASE);
+}
+
+static int proc_fibers( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Core  Active      Created     Switches    Waits\n");
+    sncatprintf(p, ps, "----  ----------  ----------  ----------  ----------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        const struct fiber_core &core = cores[i];
+        sncatprintf(p, ps, "%-4d  %-10d  %-10lu  %-10lu  %-10lu\n",
+            i,
+            core.count,
+            core.created,
+            core.switches,
+            core.waits);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void fiber_register()
+{
+    procfs_register("/fibers", proc_fibers, nullptr);
+}
@@ -18,8 +18,11 @@
 #include <sys/heap.h>
 #include <sys/pmm.hh>
 #include <sys/procfs.h>
+#include <sys/trace.hh>
+#include <sys/pmu.hh>
 #include <sys/system.h>
 #include <sys/types.h>
+#include <sys/sync.h>
 #include <mc/stdio.h>
 #include <mc/string.h>
 
@@ -121,20 +124,31 @@ static size_t heap_offset;
  */
 static size_t heap_end;
 
+/**
+ * @brief Lock protecting the buckets and the Heap offset.
+ */
+static spinlock_t heap_lock = SPINLOCK_INITIALIZER;
+
 
 void kernel_panic( const char *path, int line );
 
 void heap_initialize()
 {
-	heap_start = heap_offset = (size_t) pmm_allocate(HEAP_SIZE / SYS_PAGE_SIZE, PFT_FREE);
+	heap_start = heap_offset = (size_t) pmm_allocate(HEAP_SIZE / SYS_PAGE_SIZE, PFT_ALLOCATED);
 	if (heap_start == 0) kernel_panic(__FILE__, __LINE__);
 	heap_end = heap_offset + HEAP_SIZE;
 	uart_print("Initializing memmory allocator with heap of %d MB\n", HEAP_SIZE / 1024 / 1024);
 }
 
+/**
+ * @brief Hardware counters of allocations and releases.
+ */
+static struct pmu_region heap_region = PMU_REGION_INITIALIZER("heap");
+
 void *heap_allocate( size_t size )
 {
 	if (heap_offset == 0) heap_initialize();
+	pmu_scope scope(&heap_region);
 
 	// we have to take into account the extra bytes for a block header
 	size += BLOCK_INFO_SIZE;
@@ -146,6 +160,8 @@ void *heap_allocate( size_t size )
 
 	size = bucket->size;
 
+	spin_lock(&heap_lock);
+
 	// look for some free block in the bucket
 	struct block_info_t *block = bucket->entries;
 	if (block != NULL)
@@ -157,7 +173,11 @@ void *heap_allocate( size_t size )
 	else
 	{
 		// check whether we have available memory
-		if ( heap_offset + bucket->size > heap_end ) return NULL;
+		if ( heap_offset + bucket->size > heap_end )
+		{
+			spin_unlock(&heap_lock);
+			return NULL;
+		}
 
 		// fill the block information
 		block = (struct block_info_t *) heap_offset;
@@ -170,11 +190,15 @@ void *heap_allocate( size_t size )
 	if (bucket->count > bucket->peak)
 		bucket->peak = bucket->count;
 
+	spin_unlock(&heap_lock);
+	trace_event(heap_allocate, "heap_allocate size=%lu address=%p\n", size, &block->next);
 	return &block->next;
 }
 
 void heap_free( void *address )
 {
+	pmu_scope scope(&heap_region);
+
 	// we need to be sure that the given address is from a valid allocation
 	if (address < (void*) heap_start || address >= (void*) heap_end) return;
 	// check the block information (more validations :)
@@ -183,10 +207,14 @@ void heap_free( void *address )
 		block->bucket >= MAX_BUCKETS)
 		return;
 
+	trace_event(heap_free, "heap_free address=%p\n", address);
+
 	// put the block in the free list of the corresponding bucket
 	struct bucket_info_t *bucket = &heap_buckets[block->bucket];
+	spin_lock(&heap_lock);
 	block->next = bucket->entries;
 	bucket->entries = block;
+	spin_unlock(&heap_lock);
 }
 
 static int proc_heap( uint8_t *buffer, int size, void * /* data */ )
@@ -0,0 +1,349 @@
+/*
+ * Interrupt dispatch.
+ *
+ * Every IRQ starts in the BCM2836 per-core controller: its source register
+ * tells which ARM-local interrupts are pending and whether the BCM2835 ARMCTRL
+ * (the controller of GPU peripherals) has pending interrupts too. Pending
+ * bits are mapped to IRQ numbers (see 'sys/irq.h') and dispatched through a
+ * table indexed by number.
+ */
+
+#include <sys/irq.h>
+#include <sys/task.h>
+#include <sys/work.h>
+#include <sys/rcu.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/sysio.h>
+#include <sys/bcm2837.h>
+#include <sys/system.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <sys/klog.hh>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<irq> "
+
+/*
+ * Valid bits of the local IRQ source register (the bit 10 is unused).
+ */
+#define IRQ_LOCAL_SOURCES  (0xBFFU)
+
+struct irq_entry
+{
+    irq_handler_t handler;
+    void *data;
+    const char *name;
+    uint64_t count[SYS_CPU_CORES];
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) irq_core
+{
+    uint32_t depth;
+    uint64_t spurious;
+};
+
+static struct irq_entry irq_table[IRQ_COUNT];
+
+static struct irq_core cores[SYS_CPU_CORES];
+
+/*
+ * Interrupts enabled in the ARMCTRL (pending 1, pending 2 and basic pending).
+ * The pending registers also report sources we did not enable.
+ */
+static uint32_t irq_enabled[3];
+
+static spinlock_t irq_lock = SPINLOCK_INITIALIZER;
+
+void kernel_panic( const char *path, int line );
+
+static void irq_handle( uint32_t core, uint32_t irq )
+{
+    struct irq_entry &entry = irq_table[irq];
+    ++entry.count[core];
+    if (entry.handler)
+        entry.handler(irq, entry.data);
+    else
+    {
+        // nobody is listening: mask the source to avoid an interrupt storm
+        ++cores[core].spurious;
+        irq_disable(irq);
+        klog_warning("IRQ %d has no handler, masked in core %d\n", irq, core);
+    }
+}
+
+static void irq_handle_bits( uint32_t core, uint32_t base, uint32_t bits )
+{
+    while (bits)
+    {
+        uint32_t bit = (uint32_t) __builtin_ctz(bits);
+        bits &= bits - 1;
+        irq_handle(core, base + bit);
+    }
+}
+
+static void irq_dispatch_gpu( uint32_t core )
+{
+    uint32_t basic = GET32(SOC_ARMCTRL_PENDING_BASIC) & 0xFFU & irq_enabled[2];
+    uint32_t pending1 = GET32(SOC_ARMCTRL_PENDING1) & irq_enabled[0];
+    uint32_t pending2 = GET32(SOC_ARMCTRL_PENDING2) & irq_enabled[1];
+
+    if (basic == 0 && pending1 == 0 && pending2 == 0)
+    {
+        ++cores[core].spurious;
+        return;
+    }
+    irq_handle_bits(core, IRQ_BASIC_BASE, basic);
+    irq_handle_bits(core, IRQ_GPU_BASE, pending1);
+    irq_handle_bits(core, IRQ_GPU_BASE + 32, pending2);
+}
+
+/*
+ * Called by 'exception.S' for every IRQ. Returns the context to be restored.
+ */
+extern "C" struct task_context *kernel_irq_dispatch( struct task_context *frame )
+{
+    uint32_t id = smp_core_id();
+    struct irq_core &core = cores[id];
+
+    ++core.depth;
+    rcu_irq_enter();
+    uint32_t source = GET32(SOC_LOCAL_IRQ_SOURCE(id)) & IRQ_LOCAL_SOURCES;
+    if (source == 0) ++core.spurious;
+    while (source)
+    {
+        uint32_t bit = (uint32_t) __builtin_ctz(source);
+        source &= source - 1;
+        if ((1U << bit) == SOC_LOCAL_GPUIRQ)
+            irq_dispatch_gpu(id);
+        else
+            irq_handle(id, IRQ_LOCAL(bit));
+    }
+    // deferred work of the handlers (still in IRQ context, so it can not
+    // block)
+    softirq_process();
+    rcu_irq_exit();
+    --core.depth;
+
+    // the scheduler may switch to another task in the exit path
+    return task_irq_exit(frame);
+}
+
+/*
+ * Called by 'exception.S' for synchronous exceptions (type 0), FIQs (type 1)
+ * and SErrors (type 2), none of which the kernel is able to handle.
+ */
+extern "C" void kernel_exception_dump( struct task_context *frame, uint32_t type )
+{
+    static const char *TYPES[] = { "Synchronous exception", "FIQ", "SError" };
+
+    uint64_t esr, far;
+    asm volatile ("mrs %0, esr_el1" : "=r" (esr));
+    asm volatile ("mrs %0, far_el1" : "=r" (far));
+
+    uart_print(LOG_TITLE "%s in core %d\n", TYPES[type % 3], smp_core_id());
+    uart_print("  ESR: %016lx (EC=%02x ISS=%07x)\n", esr, (uint32_t) (esr >> 26) & 0x3F, (uint32_t) esr & 0x1FFFFFF);
+    uart_print("  ELR: %016lx\n", frame->elr);
+    uart_print("  FAR: %016lx\n", far);
+    uart_print(" SPSR: %016lx\n", frame->spsr);
+    for (uint32_t i = 0; i < 31; i += 2)
+    {
+        if (i == 30)
+            uart_print("  x30: %016lx\n", frame->x[30]);
+        else
+            uart_print("  x%-2d: %016lx  x%-2d: %016lx\n", i, frame->x[i], i + 1, frame->x[i + 1]);
+    }
+
+    kernel_panic(__FILE__, __LINE__);
+}
+
+int irq_initialize()
+{
+    memset(irq_table, 0, sizeof(irq_table));
+    memset(cores, 0, sizeof(cores));
+
+    // mask everything in the ARMCTRL
+    PUT32(SOC_ARMCTRL_DISABLE1, 0xFFFFFFFFU);
+    PUT32(SOC_ARMCTRL_DISABLE2, 0xFFFFFFFFU);
+    PUT32(SOC_ARMCTRL_DISABLE_BASIC, 0xFFU);
+    PUT32(SOC_ARMCTRL_FIQ_CONTROL, 0);
+    irq_enabled[0] = irq_enabled[1] = irq_enabled[2] = 0;
+
+    // GPU interrupts are delivered to the core 0 as IRQ
+    PUT32(SOC_LOCAL_GPU_ROUTING, 0);
+    PUT32(SOC_LOCAL_PMU_ROUTING_CLEAR, 0xFFU);
+
+    uart_print(LOG_TITLE "Initialized dispatch table with %d entries\n", IRQ_COUNT);
+    return EOK;
+}
+
+int irq_attach( uint32_t irq, const char *name, irq_handler_t handler, void *data )
+{
+    if (irq >= IRQ_COUNT || handler == nullptr) return EARGUMENT;
+
+    uint64_t flags = spin_lock_irqsave(&irq_lock);
+    struct irq_entry &entry = irq_table[irq];
+    if (entry.handler)
+    {
+        spin_unlock_irqrestore(&irq_lock, flags);
+        return EEXIST;
+    }
+    entry.data = data;
+    entry.name = name;
+    entry.handler = handler;
+    spin_unlock_irqrestore(&irq_lock, flags);
+    return EOK;
+}
+
+int irq_detach( uint32_t irq )
+{
+    if (irq >= IRQ_COUNT) return EARGUMENT;
+
+    uint64_t flags = spin_lock_irqsave(&irq_lock);
+    struct irq_entry &entry = irq_table[irq];
+    if (entry.handler == nullptr)
+    {
+        spin_unlock_irqrestore(&irq_lock, flags);
+        return ENOENT;
+    }
+    entry.handler = nullptr;
+    entry.data = nullptr;
+    entry.name = nullptr;
+    spin_unlock_irqrestore(&irq_lock, flags);
+    return EOK;
+}
+
+static int irq_set_local( uint32_t irq, bool enable )
+{
+    uint32_t id = smp_core_id();
+    uint32_t bit = irq - IRQ_LOCAL_BASE;
+    uintptr_t reg;
+    uint32_t mask;
+
+    if (bit < 4)
+    {
+        reg = SOC_LOCAL_TIMER_INT_CONTROL(id);
+        mask = 1U << bit;
+    }
+    else
+    if (bit < 8)
+    {
+        reg = SOC_LOCAL_MAILBOX_INT_CONTROL(id);
+        mask = SOC_LOCAL_MAILBOX_IRQ_ENABLE(bit - 4);
+    }
+    else
+    if ((1U << bit) == SOC_LOCAL_PMUIRQ)
+    {
+        uintptr_t routing = enable ? SOC_LOCAL_PMU_ROUTING_SET : SOC_LOCAL_PMU_ROUTING_CLEAR;
+        PUT32(routing, 1U << id);
+        return EOK;
+    }
+    else
+        return ENOIMP;
+
+    uint32_t value = GET32(reg);
+    value = enable ? (value | mask) : (value & ~mask);
+    PUT32(reg, value);
+    return EOK;
+}
+
+static int irq_set( uint32_t irq, bool enable )
+{
+    if (irq >= IRQ_COUNT) return EARGUMENT;
+
+    int result = EOK;
+    uint64_t flags = spin_lock_irqsave(&irq_lock);
+    if (irq >= IRQ_LOCAL_BASE)
+        result = irq_set_local(irq, enable);
+    else
+    {
+        uint32_t index, bit;
+        uintptr_t reg;
+        if (irq >= IRQ_BASIC_BASE)
+        {
+            if (irq - IRQ_BASIC_BASE >= 8) result = EARGUMENT;
+            index = 2;
+            bit = irq - IRQ_BASIC_BASE;
+            reg = enable ? SOC_ARMCTRL_ENABLE_BASIC : SOC_ARMCTRL_DISABLE_BASIC;
+        }
+        else
+        {
+            index = irq / 32;
+            bit = irq % 32;
+            if (index == 0)
+                reg = enable ? SOC_ARMCTRL_ENABLE1 : SOC_ARMCTRL_DISABLE1;
+            else
+                reg = enable ? SOC_ARMCTRL_ENABLE2 : SOC_ARMCTRL_DISABLE2;
+        }
+
+        if (result == EOK)
+        {
+            // writing zeros has no effect in both enable and disable registers
+            PUT32(reg, 1U << bit);
+            if (enable)
+                irq_enabled[index] |= 1U << bit;
+            else
+                irq_enabled[index] &= ~(1U << bit);
+        }
+    }
+    spin_unlock_irqrestore(&irq_lock, flags);
+    return result;
+}
+
+int irq_enable( uint32_t irq )
+{
+    return irq_set(irq, true);
+}
+
+int irq_disable( uint32_t irq )
+{
+    return irq_set(irq, false);
+}
+
+bool irq_context()
+{
+    return cores[smp_core_id()].depth > 0;
+}
+
+static int proc_interrupts( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    uint32_t count = smp_cores();
+
+    sncatprintf(p, ps, "IRQ  ");
+    for (uint32_t i = 0; i < count; ++i)
+        sncatprintf(p, ps, "Core%-8d", i);
+    sncatprintf(p, ps, "Name\n");
+
+    for (uint32_t irq = 0; irq < IRQ_COUNT; ++irq)
+    {
+        const struct irq_entry &entry = irq_table[irq];
+        bool used = entry.handler != nullptr;
+        for (uint32_t i = 0; i < count && !used; ++i)
+            used = entry.count[i] != 0;
+        if (!used) continue;
+
+        sncatprintf(p, ps, "%-3d  ", irq);
+        for (uint32_t i = 0; i < count; ++i)
+            sncatprintf(p, ps, "%-10lu  ", entry.count[i]);
+        sncatprintf(p, ps, "%s\n", entry.name ? entry.name : "-");
+    }
+
+    sncatprintf(p, ps, "SPU  ");
+    for (uint32_t i = 0; i < count; ++i)
+        sncatprintf(p, ps, "%-10lu  ", cores[i].spurious);
+    sncatprintf(p, ps, "Spurious interrupts\n");
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void irq_register()
+{
+    procfs_register("/interrupts", proc_interrupts, nullptr);
+}
@@ -0,0 +1,350 @@
+/*
+ * Work-stealing job runtime.
+ *
+ * Every core owns a Chase-Lev deque: the owner pushes and pops jobs at the
+ * bottom while other cores steal from the top. Jobs are short, run to
+ * completion and may be executed by any core.
+ *
+ * Reference: "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (Lê, Pop, Cohen, Zappa Nardelli; PPoPP 2013).
+ */
+
+#include <sys/job.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/rcu.h>
+#include <sys/task.h>
+#include <sys/system.h>
+#include <sys/procfs.h>
+#include <sys/timer.hh>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/stdlib.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<job> "
+
+/*
+ * Number of entries in each deque (must be a power of two). Each core also
+ * owns the same amount of job slots, so a push never finds a full deque.
+ */
+#define JOB_DEQUE_SIZE   256
+#define JOB_DEQUE_MASK   (JOB_DEQUE_SIZE - 1)
+#define JOB_POOL_SIZE    JOB_DEQUE_SIZE
+
+struct job
+{
+    job_func_t func;
+    job_range_func_t range;
+    void *arg;
+    size_t begin;
+    size_t end;
+    struct job_counter *counter;
+    volatile uint32_t busy;
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) job_deque
+{
+    volatile int64_t top;    // modified by thieves
+    uint8_t padding[CACHE_LINE_SIZE - sizeof(int64_t)];
+    volatile int64_t bottom; // modified by the owner
+    struct job *entries[JOB_DEQUE_SIZE];
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) job_stats
+{
+    uint64_t submitted;
+    uint64_t executed;
+    uint64_t steals;
+    uint64_t steal_failures;
+    uint64_t idle;
+    uint64_t idle_ns;  // time sleeping without jobs
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) job_core
+{
+    struct job_deque deque;
+    struct job pool[JOB_POOL_SIZE];
+    size_t next;
+    struct job_stats stats;
+};
+
+static struct job_core cores[SYS_CPU_CORES];
+
+static bool deque_push( struct job_deque &dq, struct job *job )
+{
+    int64_t b = __atomic_load_n(&dq.bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&dq.top, __ATOMIC_ACQUIRE);
+    if (b - t >= JOB_DEQUE_SIZE) return false;
+
+    __atomic_store_n(&dq.entries[b & JOB_DEQUE_MASK], job, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&dq.bottom, b + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static struct job *deque_pop( struct job_deque &dq )
+{
+    int64_t b = __atomic_load_n(&dq.bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&dq.bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&dq.top, __ATOMIC_RELAXED);
+
+    if (t > b)
+    {
+        // empty deque
+        __atomic_store_n(&dq.bottom, b + 1, __ATOMIC_RELAXED);
+        return nullptr;
+    }
+
+    struct job *job = __atomic_load_n(&dq.entries[b & JOB_DEQUE_MASK], __ATOMIC_RELAXED);
+    if (t == b)
+    {
+        // last entry: we are racing against thieves
+        if (!__atomic_compare_exchange_n(&dq.top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            job = nullptr;
+        __atomic_store_n(&dq.bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static struct job *deque_steal( struct job_deque &dq, bool &lost )
+{
+    int64_t t = __atomic_load_n(&dq.top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&dq.bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return nullptr;
+
+    struct job *job = __atomic_load_n(&dq.entries[t & JOB_DEQUE_MASK], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq.top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        lost = true;
+        return nullptr;
+    }
+    return job;
+}
+
+static void job_execute( struct job_core &core, struct job *job )
+{
+    if (job->range)
+        job->range(job->begin, job->end, job->arg);
+    else
+        job->func(job->arg);
+
+    // the slot may be reused as soon as 'busy' is cleared
+    struct job_counter *counter = job->counter;
+    __atomic_store_n(&job->busy, 0U, __ATOMIC_RELEASE);
+    if (counter) __atomic_sub_fetch(&counter->value, 1, __ATOMIC_RELEASE);
+    ++core.stats.executed;
+
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+}
+
+/*
+ * Execute one pending job, looking first in the deque of the current core
+ * and then trying to steal from the other cores.
+ */
+static bool job_run_next( uint32_t id )
+{
+    struct job_core &core = cores[id];
+
+    // the owner side of the deque must not be interrupted by other tasks
+    // running in this core
+    uint64_t flags = sync_saveInterrupts();
+    struct job *job = deque_pop(core.deque);
+    sync_restoreInterrupts(flags);
+
+    if (job == nullptr)
+    {
+        uint32_t count = smp_cores();
+        for (uint32_t i = 1; i < count && job == nullptr; ++i)
+        {
+            bool lost = false;
+            job = deque_steal(cores[(id + i) % count].deque, lost);
+            if (job)
+                ++core.stats.steals;
+            else
+            if (lost)
+                ++core.stats.steal_failures;
+        }
+    }
+    if (job == nullptr) return false;
+
+    job_execute(core, job);
+    return true;
+}
+
+static struct job *job_allocate( uint32_t id )
+{
+    struct job_core &core = cores[id];
+
+    while (true)
+    {
+        uint64_t flags = sync_saveInterrupts();
+        struct job *job = &core.pool[core.next & (JOB_POOL_SIZE - 1)];
+        if (__atomic_load_n(&job->busy, __ATOMIC_ACQUIRE) == 0)
+        {
+            ++core.next;
+            job->busy = 1;
+            sync_restoreInterrupts(flags);
+            return job;
+        }
+        sync_restoreInterrupts(flags);
+
+        // the oldest slot is still in use; help until it is released
+        if (!job_run_next(id)) sync_waitEvent();
+    }
+}
+
+static int job_enqueue(
+    job_func_t func,
+    job_range_func_t range,
+    void *arg,
+    size_t begin,
+    size_t end,
+    struct job_counter *counter )
+{
+    uint32_t id = smp_core_id();
+    struct job_core &core = cores[id];
+
+    struct job *job = job_allocate(id);
+    job->func = func;
+    job->range = range;
+    job->arg = arg;
+    job->begin = begin;
+    job->end = end;
+    job->counter = counter;
+    if (counter) __atomic_add_fetch(&counter->value, 1, __ATOMIC_RELAXED);
+
+    uint64_t flags = sync_saveInterrupts();
+    ++core.stats.submitted;
+    bool pushed = deque_push(core.deque, job);
+    sync_restoreInterrupts(flags);
+    if (!pushed)
+    {
+        job_execute(core, job);
+        return EOK;
+    }
+
+    // wake up idle cores
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+    return EOK;
+}
+
+int job_initialize()
+{
+    memset(cores, 0, sizeof(cores));
+    uart_print(LOG_TITLE "Initialized %d job deques with %d entries\n", SYS_CPU_CORES, JOB_DEQUE_SIZE);
+    return EOK;
+}
+
+/*
+ * Sleep until the next event, accounting the time as idle.
+ */
+static void job_sleep( uint32_t id )
+{
+    uint64_t start = timer_ns();
+    sync_waitEvent();
+    struct job_stats &stats = cores[id].stats;
+    ++stats.idle;
+    // read by other cores (see 'job_idle_ns')
+    __atomic_store_n(&stats.idle_ns, stats.idle_ns + timer_ns() - start, __ATOMIC_RELAXED);
+}
+
+int job_submit( job_func_t func, void *arg, struct job_counter *counter )
+{
+    if (func == nullptr) return EARGUMENT;
+    return job_enqueue(func, nullptr, arg, 0, 0, counter);
+}
+
+void job_wait( struct job_counter *counter )
+{
+    if (counter == nullptr) return;
+
+    uint32_t id = smp_core_id();
+    while (__atomic_load_n(&counter->value, __ATOMIC_ACQUIRE) > 0)
+    {
+        if (!job_run_next(id))
+            job_sleep(id);
+    }
+}
+
+int parallel_for( size_t begin, size_t end, size_t grain, job_range_func_t func, void *arg )
+{
+    if (func == nullptr || end < begin) return EARGUMENT;
+
+    size_t count = end - begin;
+    if (count == 0) return EOK;
+    if (grain == 0)
+    {
+        // a few chunks per core allow stealing to balance uneven work
+        size_t chunks = smp_cores() * 4;
+        grain = (count + chunks - 1) / chunks;
+    }
+
+    struct job_counter counter = JOB_COUNTER_INITIALIZER;
+    // the first chunk is executed by the current core
+    size_t first = begin + min(grain, count);
+    for (size_t i = first; i < end; i += min(grain, end - i))
+        job_enqueue(nullptr, func, arg, i, i + min(grain, end - i), &counter);
+
+    func(begin, first, arg);
+    job_wait(&counter);
+    return EOK;
+}
+
+void job_worker_main()
+{
+    uint32_t id = smp_core_id();
+    while (true)
+    {
+        if (!job_run_next(id))
+        {
+            task_reap();
+            rcu_poll();
+            // the idle loop is a quiescent state, even while sleeping
+            rcu_idle_enter();
+            job_sleep(id);
+            rcu_idle_exit();
+        }
+    }
+}
+
+uint64_t job_idle_ns( uint32_t core )
+{
+    if (core >= SYS_CPU_CORES) return 0;
+    return __atomic_load_n(&cores[core].stats.idle_ns, __ATOMIC_RELAXED);
+}
+
+static int proc_jobs( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Core  Submitted   Executed    Steals      Failed      Idle        Idle (ms)\n");
+    sncatprintf(p, ps, "----  ----------  ----------  ----------  ----------  ----------  ----------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        const struct job_stats &stats = cores[i].stats;
+        sncatprintf(p, ps, "%-4d  %-10lu  %-10lu  %-10lu  %-10lu  %-10lu  %-10lu\n",
+            i,
+            stats.submitted,
+            stats.executed,
+            stats.steals,
+            stats.steal_failures,
+            stats.idle,
+            stats.idle_ns / 1000000);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void job_register()
+{
+    procfs_register("/jobs", proc_jobs, nullptr);
+}
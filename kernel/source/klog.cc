@@ -0,0 +1,111 @@
+/*
+ * Binary kernel log (see 'sys/klog.hh').
+ *
+ * The records are stored and read by the kernel log ('kmsg.cc') and the
+ * tracepoints ('trace.cc'); this is the deferred formatting shared by both.
+ */
+
+#include <sys/klog.hh>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+static bool klog_is_modifier( char c )
+{
+    static const char MODIFIERS[] = "-+ #0123456789.hlzjt";
+    for (const char *m = MODIFIERS; *m; ++m)
+        if (*m == c) return true;
+    return false;
+}
+
+size_t klog_format( char *p, size_t ps, const char *format, const uint64_t *args, uint32_t count )
+{
+    if (ps == 0) return 0;
+    uint32_t arg = 0;
+    size_t used = 0;
+    p[0] = 0;
+
+    while (*format && used + 1 < ps)
+    {
+        if (*format != '%')
+        {
+            p[used++] = *format++;
+            p[used] = 0;
+            continue;
+        }
+        if (format[1] == '%')
+        {
+            p[used++] = '%';
+            p[used] = 0;
+            format += 2;
+            continue;
+        }
+
+        // copy the conversion specification
+        char spec[16];
+        size_t len = 0;
+        bool wide = false;
+        spec[len++] = *format++;
+        while (*format && klog_is_modifier(*format))
+        {
+            if (*format == 'l' || *format == 'z' || *format == 'j' || *format == 't') wide = true;
+            if (len < sizeof(spec) - 2) spec[len++] = *format;
+            ++format;
+        }
+        char conversion = *format;
+        if (conversion == 0) break;
+        ++format;
+        spec[len++] = conversion;
+        spec[len] = 0;
+
+        uint64_t value = (arg < count) ? args[arg] : 0;
+        ++arg;
+
+        char *out = p + used;
+        size_t size = ps - used;
+        switch (conversion)
+        {
+            case 'd':
+            case 'i':
+                if (wide)
+                    snprintf(out, size, spec, (long) value);
+                else
+                    snprintf(out, size, spec, (int) value);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'b':
+                if (wide)
+                    snprintf(out, size, spec, (unsigned long) value);
+                else
+                    snprintf(out, size, spec, (unsigned) value);
+                break;
+            case 'c':
+                snprintf(out, size, spec, (int) value);
+                break;
+            case 's':
+                snprintf(out, size, spec, value ? (const char*) (uintptr_t) value : "(null)");
+                break;
+            case 'p':
+                snprintf(out, size, spec, (void*) (uintptr_t) value);
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            {
+                union { double d; uint64_t u; } tmp;
+                tmp.u = value;
+                snprintf(out, size, spec, tmp.d);
+                break;
+            }
+            default:
+                snprintf(out, size, "%s", spec);
+        }
+        used += strlen(out);
+    }
+    return used;
+}
@@ -0,0 +1,447 @@
+/*
+ * Kernel log.
+ *
+ * Each core appends timestamped records to its own ring without locks: a
+ * record is reserved by advancing the head with a CAS (IRQ handlers may log
+ * while the interrupted code is logging too) and published by writing its
+ * sequence number. A work queue merges the rings by timestamp and writes the
+ * records to the UART, so logging never waits for the serial line.
+ *
+ * Logging takes no lock either: publishing only sets a pending flag of the
+ * core. The drain is kicked by the next caller that may call into the
+ * scheduler, or else by a periodic timer, so messages logged by interrupt
+ * handlers or while holding the scheduler locks can not deadlock.
+ *
+ * Binary records (see 'sys/klog.hh') share the rings: they keep the format
+ * string and the raw arguments, and are formatted by the same readers.
+ *
+ * Records already written to the UART stay in the ring until overwritten and
+ * can be read through '/proc/kmsg'.
+ */
+
+#include <sys/kmsg.h>
+#include <sys/klog.hh>
+#include <sys/work.h>
+#include <sys/task.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/timer.hh>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define KMSG_MASK        (KMSG_RECORDS - 1)
+
+/*
+ * Period of the timer that kicks the drain of records logged where the work
+ * queue could not be woken up.
+ */
+#define KMSG_KICK_US     10000
+
+#define KMSG_TYPE_TEXT   0
+#define KMSG_TYPE_BINARY 1
+
+struct kmsg_record
+{
+    /**
+     * Index of the record plus one once published, zero while being written.
+     */
+    volatile uint64_t seq;
+    /**
+     * Monotonic time in nanoseconds.
+     */
+    uint64_t timestamp;
+    /**
+     * Length of the text (text records only).
+     */
+    uint16_t length;
+    uint8_t core;
+    uint8_t type;
+    /**
+     * Level and number of arguments (binary records only).
+     */
+    uint8_t level;
+    uint8_t count;
+    uint8_t reserved[2];
+    union
+    {
+        char text[KMSG_TEXT_SIZE];
+        struct
+        {
+            const char *format;
+            uint64_t args[KMSG_MAX_ARGS];
+        } binary;
+    };
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) kmsg_ring
+{
+    /**
+     * Next record to reserve and next record to be written to the UART.
+     */
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    volatile uint64_t dropped;
+    /**
+     * Set when a record is published and cleared when the drain is kicked.
+     */
+    volatile uint32_t pending;
+    struct kmsg_record records[KMSG_RECORDS];
+};
+
+static struct kmsg_ring rings[SYS_CPU_CORES];
+
+static struct workqueue *kmsg_wq = nullptr;
+
+static struct work kmsg_work;
+
+static void kmsg_kick_timer( struct timer_event *event );
+
+static struct timer_event kmsg_timer = TIMER_EVENT_INITIALIZER(kmsg_kick_timer, nullptr);
+
+/*
+ * Serializes the writers of the UART (the work queue and 'kmsg_flush').
+ */
+static spinlock_t kmsg_drain_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Whether the last record written to the UART ended a line.
+ */
+static bool kmsg_line_start = true;
+
+static uint64_t kmsg_reported = 0;
+
+static struct kmsg_record *kmsg_reserve( struct kmsg_ring &ring, uint64_t &index )
+{
+    uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+    do
+    {
+        if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) >= KMSG_RECORDS)
+        {
+            __atomic_add_fetch(&ring.dropped, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        }
+    } while (!__atomic_compare_exchange_n(&ring.head, &head, head + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    index = head;
+    struct kmsg_record *record = &ring.records[index & KMSG_MASK];
+    // readers of the old record must notice it is being overwritten
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return record;
+}
+
+/*
+ * Queue the drain if some core published records since the last kick. Takes
+ * the work queue and scheduler locks.
+ */
+static void kmsg_kick()
+{
+    bool pending = false;
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        if (__atomic_load_n(&rings[i].pending, __ATOMIC_RELAXED) == 0) continue;
+        // records published after this are kicked again
+        pending |= __atomic_exchange_n(&rings[i].pending, 0U, __ATOMIC_ACQ_REL) != 0;
+    }
+    if (pending) work_queue(kmsg_wq, &kmsg_work);
+}
+
+static void kmsg_kick_timer( struct timer_event * /* event */ )
+{
+    // the interrupted code can not hold the locks taken with IRQs masked
+    kmsg_kick();
+}
+
+static void kmsg_publish( struct kmsg_ring &ring, struct kmsg_record *record, uint64_t index )
+{
+    __atomic_store_n(&record->seq, index + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring.pending, 1U, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&kmsg_wq, __ATOMIC_ACQUIRE) == nullptr)
+        kmsg_flush();
+    else
+    // IRQ handlers and lock holders leave the kick to the timer
+    if (task_preemptible())
+        kmsg_kick();
+}
+
+void kmsg_write( const char *text, size_t length )
+{
+    if (text == nullptr) return;
+
+    uint32_t id = smp_core_id();
+    uint64_t index;
+    struct kmsg_record *record = kmsg_reserve(rings[id], index);
+    if (record == nullptr) return;
+
+    if (length >= KMSG_TEXT_SIZE) length = KMSG_TEXT_SIZE - 1;
+    memcpy(record->text, text, length);
+    record->text[length] = 0;
+    record->length = (uint16_t) length;
+    record->core = (uint8_t) id;
+    record->type = KMSG_TYPE_TEXT;
+    record->timestamp = timer_ns();
+    kmsg_publish(rings[id], record, index);
+}
+
+void kmsg_vprint( const char *format, va_list args )
+{
+    if (format == nullptr) return;
+
+    uint32_t id = smp_core_id();
+    uint64_t index;
+    struct kmsg_record *record = kmsg_reserve(rings[id], index);
+    if (record == nullptr) return;
+
+    // format directly in the record: it is private until published
+    record->timestamp = timer_ns();
+    int length = vsnprintf(record->text, KMSG_TEXT_SIZE, format, args);
+    if (length < 0) length = 0;
+    if (length >= KMSG_TEXT_SIZE) length = KMSG_TEXT_SIZE - 1;
+    record->text[length] = 0;
+    record->length = (uint16_t) length;
+    record->core = (uint8_t) id;
+    record->type = KMSG_TYPE_TEXT;
+    kmsg_publish(rings[id], record, index);
+}
+
+void kmsg_write_binary( uint32_t level, const char *format, const uint64_t *args, uint32_t count )
+{
+    if (format == nullptr) return;
+
+    uint32_t id = smp_core_id();
+    uint64_t index;
+    struct kmsg_record *record = kmsg_reserve(rings[id], index);
+    if (record == nullptr) return;
+
+    if (count > KMSG_MAX_ARGS) count = KMSG_MAX_ARGS;
+    record->timestamp = timer_ns();
+    record->length = 0;
+    record->core = (uint8_t) id;
+    record->type = KMSG_TYPE_BINARY;
+    record->level = (uint8_t) level;
+    record->count = (uint8_t) count;
+    record->binary.format = format;
+    for (uint32_t i = 0; i < count; ++i) record->binary.args[i] = args[i];
+    kmsg_publish(rings[id], record, index);
+}
+
+void kmsg_print( const char *format, ... )
+{
+    va_list args;
+    va_start(args, format);
+    kmsg_vprint(format, args);
+    va_end(args);
+}
+
+/*
+ * Returns the published record with index @c index or null.
+ */
+static const struct kmsg_record *kmsg_peek( const struct kmsg_ring &ring, uint64_t index )
+{
+    const struct kmsg_record *record = &ring.records[index & KMSG_MASK];
+    if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != index + 1) return nullptr;
+    return record;
+}
+
+/*
+ * Copy a record that may be overwritten meanwhile. Returns false if that
+ * happened.
+ */
+static bool kmsg_copy( const struct kmsg_ring &ring, uint64_t index, struct kmsg_record &copy )
+{
+    const struct kmsg_record *record = kmsg_peek(ring, index);
+    if (record == nullptr) return false;
+    memcpy(&copy, (const void*) record, sizeof(copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&record->seq, __ATOMIC_RELAXED) == index + 1;
+}
+
+/*
+ * Returns the text of a record and its length. Binary records are formatted
+ * into @c buffer.
+ */
+static const char *kmsg_text( const struct kmsg_record &record, char *buffer, size_t size, size_t &length )
+{
+    if (record.type != KMSG_TYPE_BINARY)
+    {
+        length = record.length;
+        return record.text;
+    }
+    length = klog_format(buffer, size, record.binary.format, record.binary.args, record.count);
+    return buffer;
+}
+
+static void kmsg_emit( const struct kmsg_record &record )
+{
+    char prefix[24];
+    if (kmsg_line_start)
+    {
+        uint64_t us = record.timestamp / 1000;
+        snprintf(prefix, sizeof(prefix), "[%5lu.%06lu] ", us / 1000000, us % 1000000);
+        uart_puts(prefix);
+    }
+    char buffer[KMSG_TEXT_SIZE];
+    size_t length;
+    const char *text = kmsg_text(record, buffer, sizeof(buffer), length);
+    uart_puts(text);
+    kmsg_line_start = length > 0 && text[length - 1] == '\n';
+}
+
+/*
+ * Write pending records to the UART in timestamp order. Must be called
+ * holding 'kmsg_drain_lock'.
+ */
+static void kmsg_drain()
+{
+    while (true)
+    {
+        struct kmsg_ring *oldest = nullptr;
+        const struct kmsg_record *record = nullptr;
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            struct kmsg_ring &ring = rings[i];
+            const struct kmsg_record *current = kmsg_peek(ring, ring.tail);
+            if (current == nullptr) continue;
+            if (record == nullptr || current->timestamp < record->timestamp)
+            {
+                oldest = &ring;
+                record = current;
+            }
+        }
+        if (record == nullptr) break;
+
+        // pending records are never overwritten
+        kmsg_emit(*record);
+        __atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+    }
+
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        dropped += __atomic_load_n(&rings[i].dropped, __ATOMIC_RELAXED);
+    if (dropped != kmsg_reported)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "<kmsg> %lu messages lost\n", dropped - kmsg_reported);
+        uart_puts(text);
+        kmsg_reported = dropped;
+        kmsg_line_start = true;
+    }
+}
+
+static void kmsg_drain_work( struct work *work )
+{
+    // 'kmsg_flush' may be writing right now, but it could miss records
+    // published after its last pass: try again later
+    if (!spin_trylock(&kmsg_drain_lock))
+    {
+        work_queue(kmsg_wq, work);
+        return;
+    }
+    kmsg_drain();
+    spin_unlock(&kmsg_drain_lock);
+}
+
+void kmsg_flush()
+{
+    // the current holder writes every record, including ours
+    if (!spin_trylock(&kmsg_drain_lock)) return;
+    kmsg_drain();
+    spin_unlock(&kmsg_drain_lock);
+}
+
+int kmsg_start()
+{
+    kmsg_work.func = kmsg_drain_work;
+    struct workqueue *wq;
+    int result = workqueue_create("kmsg", TASK_PRIO_LOW, 0, &wq);
+    if (result != EOK) return result;
+    __atomic_store_n(&kmsg_wq, wq, __ATOMIC_RELEASE);
+    return timer_schedule(&kmsg_timer, KMSG_KICK_US, KMSG_KICK_US);
+}
+
+static int proc_kmsg( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    const size_t PREFIX = 15;
+    uint64_t cursor[SYS_CPU_CORES];
+    uint64_t first[SYS_CPU_CORES];
+    uint64_t end[SYS_CPU_CORES];
+    uint64_t dropped = 0;
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        end[i] = cursor[i] = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+        first[i] = (end[i] > KMSG_RECORDS) ? end[i] - KMSG_RECORDS : 0;
+        dropped += rings[i].dropped;
+    }
+
+    // walk back from the newest records to find what fits in the buffer
+    char text[KMSG_TEXT_SIZE];
+    size_t length;
+    size_t used = 64;
+    while (true)
+    {
+        int32_t newest = -1;
+        struct kmsg_record copy, best;
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            while (cursor[i] > first[i] && !kmsg_copy(rings[i], cursor[i] - 1, copy)) --cursor[i];
+            if (cursor[i] == first[i]) continue;
+            if (newest < 0 || copy.timestamp > best.timestamp)
+            {
+                newest = (int32_t) i;
+                best = copy;
+            }
+        }
+        if (newest < 0) break;
+        kmsg_text(best, text, sizeof(text), length);
+        if (used + PREFIX + length >= ps) break;
+        used += PREFIX + length;
+        --cursor[newest];
+    }
+
+    // and print them from the oldest
+    bool line_start = true;
+    while (true)
+    {
+        int32_t oldest = -1;
+        struct kmsg_record copy, best;
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            while (cursor[i] < end[i] && !kmsg_copy(rings[i], cursor[i], copy)) ++cursor[i];
+            if (cursor[i] == end[i]) continue;
+            if (oldest < 0 || copy.timestamp < best.timestamp)
+            {
+                oldest = (int32_t) i;
+                best = copy;
+            }
+        }
+        if (oldest < 0) break;
+        ++cursor[oldest];
+
+        if (line_start)
+        {
+            uint64_t us = best.timestamp / 1000;
+            sncatprintf(p, ps, "[%5lu.%06lu] ", us / 1000000, us % 1000000);
+        }
+        const char *line = kmsg_text(best, text, sizeof(text), length);
+        sncatprintf(p, ps, "%s", line);
+        line_start = length > 0 && line[length - 1] == '\n';
+    }
+
+    if (dropped) sncatprintf(p, ps, "%s<kmsg> %lu messages lost\n", line_start ? "" : "\n", dropped);
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void kmsg_register()
+{
+    procfs_register("/kmsg", proc_kmsg, nullptr);
+}
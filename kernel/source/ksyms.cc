@@ -0,0 +1,37 @@
+/*
+ * Kernel symbol table.
+ *
+ * The kernel is linked twice: the symbols of the first image are converted
+ * into the '.ksyms' section of the second one. The section comes right after
+ * the code in 'kernel.ld', so function addresses are the same in both images.
+ */
+
+#include <sys/ksyms.h>
+
+// from 'kernel.ld'
+extern "C" const struct ksym __begin_ksyms[];
+extern "C" const struct ksym __end_ksyms[];
+extern "C" uint8_t _end_text;
+
+size_t ksyms_count()
+{
+    return (size_t) (__end_ksyms - __begin_ksyms);
+}
+
+const struct ksym *ksyms_lookup( uintptr_t address )
+{
+    if (address >= (uintptr_t) &_end_text) return nullptr;
+
+    // find the last entry at or before the address
+    size_t low = 0;
+    size_t high = ksyms_count();
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (__begin_ksyms[middle].address <= address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return (low == 0) ? nullptr : &__begin_ksyms[low - 1];
+}
@@ -1,12 +1,32 @@
+/*
+ * Mailbox driver.
+ *
+ * Requests are queued per channel and the mailbox is only used to pass the
+ * messages: the VideoCore answers the requests of each channel in order, so
+ * a reply completes the oldest pending request of its channel. Replies are
+ * collected by the mailbox IRQ (see 'mailbox_start') or, until then, by the
+ * cores waiting for them.
+ */
+
 #include <sys/mailbox.h>
 #include <sys/sync.h>
 #include <sys/bcm2837.h>
 #include <sys/sysio.h>
+#include <sys/system.h>
+#include <sys/wait.h>
+#include <sys/errors.h>
+#include <sys/irq.h>
+#include <sys/procfs.h>
+#include <sys/timer.hh>
+#include <sys/cache.h>
 #include <mc/string.h>
+#include <mc/stdio.h>
 
 #define MAILBOX ((volatile __attribute__((aligned(4))) struct mailbox_memory_t*)(uintptr_t)(SOC_MAILBOX_BASE))
 #define MAIL_EMPTY	0x40000000  // nailbox empty
 #define MAIL_FULL	0x80000000  // mailbox full
+#define MAIL_IRQ_DATA	0x00000001  // IRQ when data is available (Config0)
+#define MB_CHANNELS	(MB_CHANNEL_GPU + 1)
 
 struct __attribute__((__packed__, aligned(4))) mailbox_memory_t
 {
@@ -24,52 +44,208 @@ struct __attribute__((__packed__, aligned(4))) mailbox_memory_t
 	uint32_t Config1;												// 0x3C
 };
 
-bool mailbox_write( MAILBOX_CHANNEL channel, uint32_t addr )
+struct mailbox_channel_stats
 {
-	if ((channel >= 0) && (channel <= MB_CHANNEL_GPU))
+	uint64_t requests;
+	uint64_t replies;
+	uint64_t latency_ns;     // total, for the average
+	uint64_t max_latency_ns;
+};
+
+struct mailbox_channel
+{
+	struct mailbox_request *head;  // oldest pending request
+	struct mailbox_request *tail;
+	uint32_t pending;
+	struct mailbox_channel_stats stats;
+};
+
+/*
+ * Protects the channel queues and orders the writes to the mailbox with the
+ * queues. Taken with IRQs masked, since the IRQ handler also needs it.
+ */
+static spinlock_t mailbox_lock = SPINLOCK_INITIALIZER;
+
+static struct mailbox_channel channels[MB_CHANNELS];
+
+/*
+ * Replies without a pending request in their channel.
+ */
+static uint64_t unexpected = 0;
+
+static bool mailbox_irq_mode = false;
+
+static bool mailbox_can_write( void * /* arg */ )
+{
+	return (MAILBOX->Status1 & MAIL_FULL) == 0;
+}
+
+static bool mailbox_can_read( void * /* arg */ )
+{
+	return (MAILBOX->Status0 & MAIL_EMPTY) == 0;
+}
+
+/*
+ * Move the replies in the mailbox to their requests. The completed requests
+ * are returned in a list, to be finished by 'mailbox_complete' without the
+ * lock. Must be called with 'mailbox_lock' held.
+ */
+static struct mailbox_request *mailbox_drain()
+{
+	struct mailbox_request *done = nullptr;
+	struct mailbox_request **done_tail = &done;
+	uint64_t now = 0;
+
+	while (mailbox_can_read(nullptr))
 	{
-		// ensure the channel is set
-		addr = (addr & ~(0xFU)) | channel;
-		// wait for some space in the mailbox
-		while ((MAILBOX->Status1 & MAIL_FULL) != 0);
-		MAILBOX->Write1 = addr;
-		return true;
+		uint32_t value = MAILBOX->Read0;
+		uint32_t index = value & 0xFU;
+		struct mailbox_channel *channel = (index < MB_CHANNELS) ? &channels[index] : nullptr;
+		if (channel == nullptr || channel->head == nullptr)
+		{
+			++unexpected;
+			continue;
+		}
+
+		struct mailbox_request *request = channel->head;
+		channel->head = request->next;
+		if (channel->head == nullptr) channel->tail = nullptr;
+		--channel->pending;
+
+		if (now == 0) now = timer_ns();
+		uint64_t latency = now - request->start_ns;
+		++channel->stats.replies;
+		channel->stats.latency_ns += latency;
+		if (latency > channel->stats.max_latency_ns) channel->stats.max_latency_ns = latency;
+
+		request->response = value & ~0xFU;
+		request->next = nullptr;
+		*done_tail = request;
+		done_tail = &request->next;
 	}
-	return false;
+	return done;
 }
 
-bool mailbox_read( MAILBOX_CHANNEL channel )
+static void mailbox_complete( struct mailbox_request *done )
 {
-	if ((channel >= 0) && (channel <= MB_CHANNEL_GPU))
+	while (done)
 	{
-		uint32_t value;
-		do {
-			// wait for data
-			while ((MAILBOX->Status0 & MAIL_EMPTY) != 0);
-			value = MAILBOX->Read0;
-		} while ((value & 0xFU) != channel);
-		return true;
+		struct mailbox_request *request = done;
+		done = request->next;
+
+		// discard the lines read while the VideoCore was writing the reply
+		if (request->size > 0) cache_invalidate_range((void*) (uintptr_t) request->addr, MAILBOX_SPAN(request->size));
+		// the callback owns the request once it is marked as done: it may
+		// release it or submit it again
+		mailbox_callback_t callback = request->callback;
+		__atomic_store_n(&request->done, 1U, __ATOMIC_RELEASE);
+		if (callback) callback(request);
 	}
-	return false;
+	// wake up the waiting cores
+	sync_sendEvent();
 }
 
-bool mailbox_send( MAILBOX_CHANNEL channel, uint32_t addr )
+static void mailbox_isr( uint32_t /* irq */, void * /* data */ )
+{
+	spin_lock(&mailbox_lock);
+	struct mailbox_request *done = mailbox_drain();
+	spin_unlock(&mailbox_lock);
+	mailbox_complete(done);
+}
+
+static void mailbox_poll()
+{
+	uint64_t flags = spin_lock_irqsave(&mailbox_lock);
+	struct mailbox_request *done = mailbox_drain();
+	spin_unlock_irqrestore(&mailbox_lock, flags);
+	mailbox_complete(done);
+}
+
+static bool mailbox_request_done( void *arg )
+{
+	struct mailbox_request *request = (struct mailbox_request*) arg;
+	if (__atomic_load_n(&request->done, __ATOMIC_ACQUIRE) != 0) return true;
+	// without the IRQ (or while it is routed to a busy core) collect the replies here
+	mailbox_poll();
+	return __atomic_load_n(&request->done, __ATOMIC_ACQUIRE) != 0;
+}
+
+int mailbox_submit( struct mailbox_request *request )
+{
+	if (request == nullptr || request->channel < 0 || request->channel > MB_CHANNEL_GPU)
+		return EARGUMENT;
+	if (request->size > 0 && (request->addr & (CACHE_LINE_SIZE - 1)) != 0)
+		return EARGUMENT;
+
+	request->done = 0;
+	request->response = 0;
+	request->next = nullptr;
+	if (request->size > 0) cache_clean_range((const void*) (uintptr_t) request->addr, MAILBOX_SPAN(request->size));
+
+	uint32_t value = request->addr;
+	if (request->size > 0) value |= GPU_MEMORY_BASE;
+	value = (value & ~0xFU) | (uint32_t) request->channel;
+
+	struct mailbox_channel *channel = &channels[request->channel];
+	while (true)
+	{
+		uint64_t flags = spin_lock_irqsave(&mailbox_lock);
+		if (mailbox_can_write(nullptr))
+		{
+			// queue before writing: the reply may arrive right away
+			if (channel->tail)
+				channel->tail->next = request;
+			else
+				channel->head = request;
+			channel->tail = request;
+			++channel->pending;
+			++channel->stats.requests;
+			request->start_ns = timer_ns();
+			MAILBOX->Write1 = value;
+			spin_unlock_irqrestore(&mailbox_lock, flags);
+			return EOK;
+		}
+
+		// the VideoCore may be waiting for its replies to be read before
+		// taking more requests: read them here, then retry without the lock
+		struct mailbox_request *done = mailbox_drain();
+		spin_unlock_irqrestore(&mailbox_lock, flags);
+		mailbox_complete(done);
+		wait_relax();
+	}
+}
+
+int mailbox_wait( struct mailbox_request *request, uint64_t timeout_us )
 {
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");
+	if (request == nullptr) return EARGUMENT;
+	return wait_until(mailbox_request_done, request, timeout_us);
+}
 
-	bool result = mailbox_write(channel, GPU_MEMORY_BASE | addr);
-	if (!result) return false;
-	result = mailbox_read(channel);
+/*
+ * Synchronous round trip.
+ */
+static bool mailbox_call( MAILBOX_CHANNEL channel, uint32_t addr, uint32_t size )
+{
+	struct mailbox_request request;
+	memset(&request, 0, sizeof(request));
+	request.channel = channel;
+	request.addr = addr;
+	request.size = size;
+	if (mailbox_submit(&request) != EOK) return false;
+	return mailbox_wait(&request, 0) == EOK;
+}
 
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");
-	return result;
+bool mailbox_send( MAILBOX_CHANNEL channel, uint32_t addr )
+{
+	return mailbox_call(channel, addr, CACHE_LINE_SIZE);
 }
 
 int mailbox_tag( uint32_t tag , struct mailbox_message *buffer )
 {
-	// manually align the memory because the 'align' attribute wont work in local variables
-	uint32_t tmp[sizeof(struct mailbox_message) + 15];
-	uint32_t addr = ((uint32_t) (size_t) &tmp + 15) & (~15U);
+	// manually align the memory because the 'align' attribute wont work in local variables;
+	// the message owns its cache lines, which are invalidated after the reply
+	uint8_t tmp[MAILBOX_SPAN(sizeof(struct mailbox_message)) + CACHE_LINE_SIZE];
+	uint32_t addr = ((uint32_t) (size_t) tmp + CACHE_LINE_SIZE - 1) & ~(uint32_t) (CACHE_LINE_SIZE - 1);
 	struct mailbox_message *message = (struct mailbox_message *) (size_t) addr;
 
 	memset(tmp, 0, sizeof(tmp));
@@ -77,12 +253,7 @@ int mailbox_tag( uint32_t tag , struct mailbox_message *buffer )
 	message->tag.header.id = tag;
 	message->tag.header.size = sizeof(struct mailbox_message) - 4 - 4 - 4 - sizeof(struct mailbox_tag_header);
 
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");
-
-	mailbox_write(MB_CHANNEL_TAGS, GPU_MEMORY_BASE | addr);
-	mailbox_read(MB_CHANNEL_TAGS);
-
-	__asm volatile ("dc civac, %0" : : "r" (addr) : "memory");
+	mailbox_call(MB_CHANNEL_TAGS, addr, sizeof(struct mailbox_message));
 
 	if (message->code == MAILBOX_CODE_RESPONSE_OK)
 	{
@@ -91,4 +262,83 @@ int mailbox_tag( uint32_t tag , struct mailbox_message *buffer )
 		return 0;
 	}
 	return message->code & (~MAILBOX_RESPONSE_BIT);
-}
\ No newline at end of file
+}
+
+int mailbox_batch_start( struct mailbox_batch *batch, struct mailbox_request *request,
+	mailbox_callback_t callback, void *arg )
+{
+	if (batch == nullptr || batch->message == nullptr || request == nullptr) return EARGUMENT;
+
+	memset(request, 0, sizeof(*request));
+	request->channel = MB_CHANNEL_TAGS;
+	request->size = mailbox_batch_finish(batch);
+	request->addr = (uint32_t) (uintptr_t) batch->message;
+	request->callback = callback;
+	request->arg = arg;
+	return mailbox_submit(request);
+}
+
+int mailbox_batch_submit( struct mailbox_batch *batch )
+{
+	struct mailbox_request request;
+	int result = mailbox_batch_start(batch, &request, nullptr, nullptr);
+	if (result != EOK) return result;
+	result = mailbox_wait(&request, 0);
+	if (result != EOK) return result;
+	return mailbox_batch_status(batch);
+}
+
+int mailbox_start()
+{
+	if (mailbox_irq_mode) return EEXIST;
+
+	int result = irq_attach(IRQ_ARM_MAILBOX, "mailbox", mailbox_isr, nullptr);
+	if (result != EOK) return result;
+
+	uint64_t flags = spin_lock_irqsave(&mailbox_lock);
+	MAILBOX->Config0 = MAILBOX->Config0 | MAIL_IRQ_DATA;
+	mailbox_irq_mode = true;
+	spin_unlock_irqrestore(&mailbox_lock, flags);
+
+	return irq_enable(IRQ_ARM_MAILBOX);
+}
+
+static const char *CHANNEL_NAMES[MB_CHANNELS] =
+{
+	"power", "fb", "vuart", "vchiq", "leds", "buttons", "touch", "count", "tags", "gpu"
+};
+
+static int proc_mailbox( uint8_t *buffer, int size, void * /* data */ )
+{
+	char *p = (char*) buffer;
+	size_t ps = (size_t) size / sizeof(char);
+	// 'sncatprintf' requires a null-terminator
+	p[0] = 0;
+
+	sncatprintf(p, ps, "Channel  Requests    Replies     Pending  Avg (us)  Max (us)\n");
+	sncatprintf(p, ps, "-------  ----------  ----------  -------  --------  --------\n");
+
+	uint64_t flags = spin_lock_irqsave(&mailbox_lock);
+	for (uint32_t i = 0; i < MB_CHANNELS; ++i)
+	{
+		const struct mailbox_channel &channel = channels[i];
+		if (channel.stats.requests == 0) continue;
+		sncatprintf(p, ps, "%-7s  %-10lu  %-10lu  %-7d  %8lu  %8lu\n",
+			CHANNEL_NAMES[i],
+			channel.stats.requests,
+			channel.stats.replies,
+			channel.pending,
+			(channel.stats.replies == 0) ? 0UL : channel.stats.latency_ns / channel.stats.replies / 1000,
+			channel.stats.max_latency_ns / 1000);
+	}
+	sncatprintf(p, ps, "\nUnexpected replies: %lu\nCompletion: %s\n",
+		unexpected, mailbox_irq_mode ? "IRQ" : "polling");
+	spin_unlock_irqrestore(&mailbox_lock, flags);
+
+	return (int) (strlen(p) * sizeof(char));
+}
+
+void mailbox_register()
+{
+	procfs_register("/mailbox", proc_mailbox, nullptr);
+}
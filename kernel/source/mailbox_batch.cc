@@ -0,0 +1,60 @@
+/*
+ * Property messages with several tags (see 'mailbox.h').
+ *
+ * https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface
+ */
+
+#include <sys/mailbox.h>
+#include <sys/errors.h>
+#include <mc/string.h>
+
+/*
+ * Words of the message header (size and code) and of the end tag.
+ */
+#define BATCH_HEADER_WORDS  2
+#define BATCH_END_WORDS     1
+#define BATCH_WORDS         (MAILBOX_BATCH_SIZE / 4)
+
+void mailbox_batch_init( struct mailbox_batch *batch )
+{
+    // manually align the memory because the 'align' attribute wont work in local variables;
+    // the message owns its cache lines, which are invalidated after the reply
+    uintptr_t addr = ((uintptr_t) batch->storage + CACHE_LINE_SIZE - 1) & ~((uintptr_t) CACHE_LINE_SIZE - 1);
+    batch->message = (uint32_t*) addr;
+    batch->message[0] = 0;
+    batch->message[1] = MAILBOX_CODE_REQUEST;
+    batch->length = BATCH_HEADER_WORDS;
+}
+
+struct mailbox_tag_header *mailbox_batch_add( struct mailbox_batch *batch, uint32_t tag, uint32_t size )
+{
+    // value buffers are padded to 32 bits
+    uint32_t words = (uint32_t) (sizeof(struct mailbox_tag_header) / 4) + (size + 3) / 4;
+    if (batch->length + words + BATCH_END_WORDS > BATCH_WORDS) return nullptr;
+
+    struct mailbox_tag_header *header = (struct mailbox_tag_header*) (batch->message + batch->length);
+    memset(header, 0, words * 4);
+    header->id = tag;
+    header->size = (words - (uint32_t) (sizeof(struct mailbox_tag_header) / 4)) * 4;
+    header->code = MAILBOX_CODE_REQUEST;
+    batch->length += words;
+    return header;
+}
+
+uint32_t mailbox_batch_finish( struct mailbox_batch *batch )
+{
+    batch->message[batch->length] = 0;
+    batch->message[0] = (batch->length + BATCH_END_WORDS) * 4;
+    batch->message[1] = MAILBOX_CODE_REQUEST;
+    return batch->message[0];
+}
+
+int mailbox_batch_status( const struct mailbox_batch *batch )
+{
+    return (batch->message[1] == MAILBOX_CODE_RESPONSE_OK) ? EOK : EINVALID;
+}
+
+bool mailbox_batch_done( const struct mailbox_tag_header *tag )
+{
+    return tag != nullptr && (tag->code & MAILBOX_RESPONSE_BIT) != 0;
+}
@@ -11,6 +11,23 @@
 #include <sys/procfs.h>
 #include <sys/mailbox.h>
 #include <sys/device.hh>
+#include <sys/smp.h>
+#include <sys/job.h>
+#include <sys/mmu.h>
+#include <sys/task.h>
+#include <sys/fiber.h>
+#include <sys/rcu.h>
+#include <sys/irq.h>
+#include <sys/work.h>
+#include <sys/timer.hh>
+#include <sys/kmsg.h>
+#include <sys/trace.hh>
+#include <sys/profile.h>
+#include <sys/pmu.hh>
+#include <sys/bench.hh>
+#include <sys/boot.h>
+#include <sys/cpufreq.h>
+#include <sys/cache.h>
 
 static int proc_sysname( uint8_t *buffer, int size, void *data )
 {
@@ -31,6 +48,7 @@ static int proc_sysname( uint8_t *buffer, int size, void *data )
 void kernel_panic( const char *path, int line )
 {
 	uart_print("KERNEL PANIC!   at %s:%d\n", path, line);
+	kmsg_flush();
 	while (true) asm("wfi");
 }
 
@@ -55,28 +73,53 @@ extern SOC_INFO kvar_soc_info;
 
 extern "C" void kernel_main()
 {
+	// before the first lock: exclusive accesses need Normal memory
+	cache_initialize();
+	mmu_initialize();
+	boot_phase_done("cache geometry and mmu");
     uart_init();
+	boot_phase_done("uart");
 
 	printf("Raspberry PI 3\n  Processor: ARMv8 aarch64 %d cores\n", kvar_soc_info.info.cores_enabled);
 
-	struct mailbox_message message;
-	if (mailbox_tag(MAILBOX_TAG_GET_ARM_MEMORY, &message) == 0)
-		printf("     Memory: %d MB\n", message.tag.memory.size / 1024 / 1024);
-	if (mailbox_tag(MAILBOX_TAG_GET_BOARD_MAC_ADDRESS, &message) == 0)
-		printf("MAC address: %02x:%02x:%02x:%02x:%02x:%02x\n",
-			message.tag.mac.address[0],
-			message.tag.mac.address[1],
-			message.tag.mac.address[2],
-			message.tag.mac.address[3],
-			message.tag.mac.address[4],
-			message.tag.mac.address[5]);
-	if (mailbox_tag(MAILBOX_TAG_GET_BOARD_SERIAL, &message) == 0)
-		printf("     Serial: %lu\n", message.tag.serial.value);
-
-    pmm_initialize();
+	// a single round trip for all the queries
+	struct mailbox_batch batch;
+	mailbox_batch_init(&batch);
+	struct memory_tag *memory = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_ARM_MEMORY, struct memory_tag);
+	struct memory_tag *vc = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_VC_MEMORY, struct memory_tag);
+	struct mac_tag *mac = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_BOARD_MAC_ADDRESS, struct mac_tag);
+	struct serial_tag *serial = mailbox_batch_add_tag(&batch, MAILBOX_TAG_GET_BOARD_SERIAL, struct serial_tag);
+	if (memory == nullptr || vc == nullptr || mac == nullptr || serial == nullptr)
+		kernel_panic(__FILE__, __LINE__);
+	bool queried = mailbox_batch_submit(&batch) == EOK;
+	if (queried)
+	{
+		if (mailbox_batch_done(&memory->header))
+			printf("     Memory: %d MB\n", memory->size / 1024 / 1024);
+		if (mailbox_batch_done(&mac->header))
+			printf("MAC address: %02x:%02x:%02x:%02x:%02x:%02x\n",
+				mac->address[0],
+				mac->address[1],
+				mac->address[2],
+				mac->address[3],
+				mac->address[4],
+				mac->address[5]);
+		if (mailbox_batch_done(&serial->header))
+			printf("     Serial: %lu\n", serial->value);
+	}
+	boot_phase_done("mailbox queries");
+
+	// the memory manager can not work without the memory splits
+	if (!queried || !mailbox_batch_done(&memory->header) || !mailbox_batch_done(&vc->header))
+		kernel_panic(__FILE__, __LINE__);
+	// the VideoCore reads the framebuffer without cache maintenance
+	mmu_map_uncached(vc->base, vc->size);
+    pmm_initialize(memory, vc);
 	//pmm_print();
+	boot_phase_done("pmm");
 
 	heap_initialize();
+	boot_phase_done("heap");
 
     procfs_initialize();
 	procfs_register("/sysname", proc_sysname, NULL);
@@ -85,13 +128,67 @@ extern "C" void kernel_main()
 
 	pmm_register();
 	heap_register();
+	boot_phase_done("procfs");
+
+	irq_initialize();
+	irq_register();
+	boot_phase_done("irq");
+	timer_initialize();
+	timer_register();
+	boot_phase_done("timer");
+	pmu_initialize();
+	pmu_register();
+	uart_start();
+	uart_register();
+	mailbox_start();
+	mailbox_register();
+	boot_phase_done("pmu, uart and mailbox irq");
+	cpufreq_initialize();
+	cpufreq_register();
+	boot_phase_done("cpufreq");
+	job_initialize();
+	job_register();
+	boot_phase_done("jobs");
+	task_initialize();
+	task_register();
+	work_initialize();
+	work_register();
+	kmsg_start();
+	kmsg_register();
+	boot_phase_done("tasks, work queues, kmsg");
+	trace_register();
+	fiber_register();
+	smp_register();
+	rcu_register();
+	profile_register();
+	bench_register();
+	boot_register();
+	kdev_register();
+	cache_register();
+	boot_phase_done("procfs files");
+	// core 0 can not continue without its scheduler
+	if (task_start() != EOK) kernel_panic(__FILE__, __LINE__);
+	boot_phase_done("scheduler");
+	smp_initialize();
+	boot_phase_done("smp");
 
     kernel_print_file("/proc/frames");
     kernel_print_file("/proc/heap");
+	boot_phase_done("memory report");
 
 	kdev_initialize();
-	kdev_enumerate();
+	boot_phase_done("devices (probes started)");
 
+#ifdef BENCH_AT_BOOT
+	bench_run(nullptr);
+	boot_phase_done("benchmarks");
+#endif
+
+	boot_finish();
+	// the boot does not need the devices: list them once probed
+	kdev_probe_wait_all();
+	kdev_enumerate();
 	puts("Done!\n");
-	while (true) { asm("wfi"); };
+	// nothing else to do: let the idle task stop the tick of the core
+	while (true) { task_prepare_block(); task_block(); };
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+ * Identity mapping of the physical address space (see 'sys/mmu.h').
+ *
+ * The first level has four 1GB entries: the first one points to a table of
+ * 2MB blocks for the RAM and the peripherals, the second one maps the
+ * ARM-local peripherals as a single Device block.
+ *
+ * Secondary cores enable their MMU while parked, before the first access to
+ * their stack ('mmu_enable' in 'entrypoint.S'), so no data written through
+ * the caches of core 0 hides stale memory from them.
+ */
+
+#include <sys/mmu.h>
+#include <sys/cache.h>
+#include <sys/bcm2837.h>
+#include <sys/system.h>
+#include <sys/errors.h>
+
+#define MMU_L1_ENTRIES       4
+#define MMU_L2_ENTRIES       512
+
+/* Bits of the descriptors */
+#define MMU_INVALID          0ULL
+#define MMU_BLOCK            1ULL
+#define MMU_TABLE            3ULL
+#define MMU_ATTR(index)      ((uint64_t) (index) << 2)
+#define MMU_INNER_SHAREABLE  (3ULL << 8)
+#define MMU_ACCESS_FLAG      (1ULL << 10)
+#define MMU_PXN              (1ULL << 53)
+#define MMU_UXN              (1ULL << 54)
+
+#define MMU_NORMAL \
+    (MMU_BLOCK | MMU_ATTR(MMU_ATTR_NORMAL) | MMU_INNER_SHAREABLE | MMU_ACCESS_FLAG)
+#define MMU_NORMAL_NC \
+    (MMU_BLOCK | MMU_ATTR(MMU_ATTR_NORMAL_NC) | MMU_INNER_SHAREABLE | MMU_ACCESS_FLAG | MMU_PXN | MMU_UXN)
+#define MMU_DEVICE \
+    (MMU_BLOCK | MMU_ATTR(MMU_ATTR_DEVICE) | MMU_ACCESS_FLAG | MMU_PXN | MMU_UXN)
+
+extern "C" {
+// used by 'entrypoint.S'
+__attribute__((aligned(SYS_PAGE_SIZE))) uint64_t mmu_l1_table[MMU_L1_ENTRIES];
+}
+
+static __attribute__((aligned(SYS_PAGE_SIZE))) uint64_t mmu_l2_table[MMU_L2_ENTRIES];
+
+/*
+ * Publish changes to the tables to the table walkers of every core, including
+ * the parked ones (their walks are not coherent until their MMU is enabled).
+ */
+static void mmu_sync_tables()
+{
+    cache_clean_range(mmu_l1_table, sizeof(mmu_l1_table));
+    cache_clean_range(mmu_l2_table, sizeof(mmu_l2_table));
+}
+
+void mmu_initialize()
+{
+    for (uint32_t i = 0; i < MMU_L2_ENTRIES; ++i)
+    {
+        uint64_t address = (uint64_t) i * MMU_BLOCK_SIZE;
+        mmu_l2_table[i] = address | ((address < CPU_IO_BASE) ? MMU_NORMAL : MMU_DEVICE);
+    }
+    mmu_l1_table[0] = (uint64_t) (uintptr_t) mmu_l2_table | MMU_TABLE;
+    mmu_l1_table[1] = (uint64_t) SOC_LOCAL_BASE | MMU_DEVICE;
+    mmu_l1_table[2] = MMU_INVALID;
+    mmu_l1_table[3] = MMU_INVALID;
+
+    // nothing was cacheable so far: the caches hold no dirty data, only lines
+    // left by the firmware or by instruction fetches
+    cache_invalidate_all();
+    mmu_enable();
+}
+
+int mmu_map_uncached( uintptr_t base, size_t size )
+{
+    // only whole blocks (the partial ones at the edges stay cacheable)
+    uintptr_t first = (base + MMU_BLOCK_SIZE - 1) / MMU_BLOCK_SIZE;
+    uintptr_t last = (base + size) / MMU_BLOCK_SIZE;
+    if (last > CPU_IO_BASE / MMU_BLOCK_SIZE) return EARGUMENT;
+    if (first >= last) return EOK;
+
+    // break-before-make: the attributes of a live mapping can not be changed
+    for (uintptr_t i = first; i < last; ++i) mmu_l2_table[i] = MMU_INVALID;
+    __asm__ volatile ("dsb ishst; tlbi vmalle1is; dsb ish; isb" ::: "memory");
+    for (uintptr_t i = first; i < last; ++i)
+        mmu_l2_table[i] = (uint64_t) (i * MMU_BLOCK_SIZE) | MMU_NORMAL_NC;
+    __asm__ volatile ("dsb ishst; isb" ::: "memory");
+    mmu_sync_tables();
+
+    // discard the lines allocated (e.g. by prefetches) while it was cacheable
+    cache_clean_invalidate_range((const void*) (first * MMU_BLOCK_SIZE), (last - first) * MMU_BLOCK_SIZE);
+    return EOK;
+}
@@ -21,6 +21,7 @@
 #include <sys/system.h>
 #include <sys/procfs.h>
 #include <sys/errors.h>
+#include <sys/sync.h>
 #include <mc/string.h>
 #include <mc/stdio.h>
 
@@ -65,6 +66,11 @@ static size_t start_index;
 */
 static uint8_t *table;
 
+/**
+ * @brief Lock protecting the frame table and the counters.
+ */
+static spinlock_t pmm_lock = SPINLOCK_INITIALIZER;
+
 
 static struct
 {
@@ -188,24 +194,15 @@ static void pmm_map_memory( const memory_tag &arm, const memory_tag &/* vc */ )
 	kern_memory_map.stack.el2_core2.end = (uintptr_t) &__EL2_stack_core2;
 }
 
-void pmm_initialize()
+void pmm_initialize( const struct memory_tag *arm, const struct memory_tag *vc )
 {
 	uart_puts("Initializing physical memory manager...\n");
-	// probe the ARM memory map
-	struct mailbox_message message1;
-	memset(&message1, 0, sizeof(message1));
-	if (mailbox_tag(MAILBOX_TAG_GET_ARM_MEMORY, &message1) != 0)
-		kernel_panic(__FILE__, __LINE__);
-	// probe the GPU memory map
-	struct mailbox_message message2;
-	memset(&message2, 0, sizeof(message2));
-	if (mailbox_tag(MAILBOX_TAG_GET_VC_MEMORY, &message2) != 0)
-		kernel_panic(__FILE__, __LINE__);
-
-	uart_print("ARM split: %x - %x\n", message1.tag.memory.base, message1.tag.memory.base + message1.tag.memory.size);
-	uart_print("GPU split: %x - %x\n", message2.tag.memory.base, message2.tag.memory.base + message2.tag.memory.size);
-
-	pmm_map_memory(message1.tag.memory, message2.tag.memory);
+	if (arm == nullptr || vc == nullptr) kernel_panic(__FILE__, __LINE__);
+
+	uart_print("ARM split: %x - %x\n", arm->base, arm->base + arm->size);
+	uart_print("GPU split: %x - %x\n", vc->base, vc->base + vc->size);
+
+	pmm_map_memory(*arm, *vc);
 
 	// if (split.base != 0 || split.size < 256) panic();
 	free_count = frame_count = (kern_memory_map.heap.end - kern_memory_map.heap.begin) / SYS_PAGE_SIZE;
@@ -235,10 +232,11 @@ void pmm_initialize()
 }
 
 
-uintptr_t pmm_allocate( size_t count, frame_type_t tag )
+static uintptr_t pmm_find_frames( size_t count, frame_type_t tag )
 {
 	if (count == 0) return 0;
-	if (tag & 0x01) return 0;//panic("Can not allocate with tag PFT_FREE");
+	// frames must be allocated with a tag that marks them as not free
+	if ((tag & 0x01) == 0) return 0;
 
 	bool update = true;
 	// check if we have enough free memory
@@ -273,15 +271,17 @@ uintptr_t pmm_allocate( size_t count, frame_type_t tag )
 }
 
 
-uintptr_t pmm_allocate_aligned( size_t count, size_t alignment, frame_type_t tag )
+static uintptr_t pmm_find_frames_aligned( size_t count, size_t alignment, frame_type_t tag )
 {
 	if (count == 0) return 0;
-	if (tag & 0x01) return 0;//panic("Can not allocate with tag PFT_FREE");
+	// frames must be allocated with a tag that marks them as not free
+	if ((tag & 0x01) == 0) return 0;
 
 	// check if we have enough free memory
 	if (free_count < count) return 0;
-	// find some region with available frames
-	size_t i = start_index + (alignment - (start_index % (alignment + 1)));
+	// find some region with available frames, starting at the first aligned one
+	if (alignment == 0) alignment = 1;
+	size_t i = (start_index + alignment - 1) / alignment * alignment;
 	for (; i < frame_count; i += alignment)
 	{
 		if (!IS_FREE_PFT(PFRAME_GET_TAG(i))) continue;
@@ -304,11 +304,29 @@ uintptr_t pmm_allocate_aligned( size_t count, size_t alignment, frame_type_t tag
 	return 0;
 }
 
+uintptr_t pmm_allocate( size_t count, frame_type_t tag )
+{
+	spin_lock(&pmm_lock);
+	uintptr_t result = pmm_find_frames(count, tag);
+	spin_unlock(&pmm_lock);
+	return result;
+}
+
+
+uintptr_t pmm_allocate_aligned( size_t count, size_t alignment, frame_type_t tag )
+{
+	spin_lock(&pmm_lock);
+	uintptr_t result = pmm_find_frames_aligned(count, alignment, tag);
+	spin_unlock(&pmm_lock);
+	return result;
+}
+
 void pmm_free( uintptr_t address, size_t count )
 {
 	size_t index = ADDRESS_TOFRAME(address);
 	if (index >= frame_count || count == 0) return;
 
+	spin_lock(&pmm_lock);
 	for (size_t i = index, t = index + count; i < t; ++i)
 	{
 		PFRAME_SET_TAG(i, PFT_DIRTY);
@@ -316,6 +334,7 @@ void pmm_free( uintptr_t address, size_t count )
 	}
 
 	if (index < start_index) start_index = index;
+	spin_unlock(&pmm_lock);
 }
 
 size_t pmm_total()
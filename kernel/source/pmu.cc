@@ -0,0 +1,410 @@
+/*
+ * Cortex-A53 performance monitors (see 'sys/pmu.hh').
+ *
+ * Event counters have 32 bits: their overflow interrupt (delivered through
+ * the ARM-local controller) extends them to 64 bits, except for the sampler
+ * counter while sampling, which is reloaded with -period on each overflow.
+ * The cycle counter is used in 64-bit mode.
+ */
+
+#include <sys/pmu.hh>
+#include <sys/profile.h>
+#include <sys/irq.h>
+#include <sys/sync.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <sys/system.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<pmu> "
+
+/* Bits of PMCR_EL0 */
+#define PMCR_E           (1U << 0)
+#define PMCR_P           (1U << 1)
+#define PMCR_C           (1U << 2)
+#define PMCR_LC          (1U << 6)
+#define PMCR_N(x)        (((uint32_t) (x) >> 11) & 0x1FU)
+
+#define PMU_CYCLE_BIT    (1U << 31)
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) pmu_core
+{
+    /**
+     * Event counters implemented by the core (up to PMU_COUNTERS).
+     */
+    uint32_t counters;
+    /**
+     * Overflows of each event counter (the upper 32 bits).
+     */
+    uint64_t high[PMU_COUNTERS];
+    uint64_t samples;
+};
+
+static const uint32_t PMU_EVENTS[PMU_COUNTERS] =
+{
+    PMU_EVENT_INST_RETIRED,
+    PMU_EVENT_L1D_REFILL,
+    PMU_EVENT_L1D_TLB_REFILL,
+    PMU_EVENT_L1I_REFILL,
+    PMU_EVENT_L2D_REFILL,
+    PMU_EVENT_BR_MIS_PRED,
+};
+
+static const struct
+{
+    const char *name;
+    uint32_t event;
+} PMU_EVENT_NAMES[] =
+{
+    { "cycles", PMU_EVENT_CPU_CYCLES },
+    { "instructions", PMU_EVENT_INST_RETIRED },
+    { "l1d_refill", PMU_EVENT_L1D_REFILL },
+    { "l1i_refill", PMU_EVENT_L1I_REFILL },
+    { "l2d_refill", PMU_EVENT_L2D_REFILL },
+    { "dtlb_refill", PMU_EVENT_L1D_TLB_REFILL },
+    { "itlb_refill", PMU_EVENT_L1I_TLB_REFILL },
+    { "br_mis_pred", PMU_EVENT_BR_MIS_PRED },
+};
+
+static struct pmu_core cores[SYS_CPU_CORES];
+
+static struct pmu_region *pmu_regions = nullptr;
+
+static spinlock_t pmu_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Event and period of the sampler counter (no sampling if the event is zero).
+ */
+static uint32_t pmu_sample_event = 0;
+static uint32_t pmu_sample_period = 0;
+
+/*
+ * Event counters are accessed through their own registers, as PMSELR_EL0
+ * would be shared with the overflow handler.
+ */
+#define PMU_CASE_GET(n) \
+    case n: __asm__ volatile ("mrs %0, pmevcntr" #n "_el0" : "=r" (value)); break;
+#define PMU_CASE_SET(n) \
+    case n: __asm__ volatile ("msr pmevcntr" #n "_el0, %0" :: "r" (value)); break;
+#define PMU_CASE_TYPE(n) \
+    case n: __asm__ volatile ("msr pmevtyper" #n "_el0, %0" :: "r" (value)); break;
+
+static inline uint32_t pmu_counter_get( uint32_t counter )
+{
+    uint64_t value = 0;
+    switch (counter)
+    {
+        PMU_CASE_GET(0) PMU_CASE_GET(1) PMU_CASE_GET(2)
+        PMU_CASE_GET(3) PMU_CASE_GET(4) PMU_CASE_GET(5)
+    }
+    return (uint32_t) value;
+}
+
+static inline void pmu_counter_set( uint32_t counter, uint32_t count )
+{
+    uint64_t value = count;
+    switch (counter)
+    {
+        PMU_CASE_SET(0) PMU_CASE_SET(1) PMU_CASE_SET(2)
+        PMU_CASE_SET(3) PMU_CASE_SET(4) PMU_CASE_SET(5)
+    }
+}
+
+/*
+ * Program the event of a counter. Filter bits are zero: count in EL0 and EL1.
+ */
+static inline void pmu_counter_type( uint32_t counter, uint32_t event )
+{
+    uint64_t value = event;
+    switch (counter)
+    {
+        PMU_CASE_TYPE(0) PMU_CASE_TYPE(1) PMU_CASE_TYPE(2)
+        PMU_CASE_TYPE(3) PMU_CASE_TYPE(4) PMU_CASE_TYPE(5)
+    }
+}
+
+static inline uint64_t pmu_cycles()
+{
+    uint64_t value;
+    __asm__ volatile ("mrs %0, pmccntr_el0" : "=r" (value));
+    return value;
+}
+
+static inline uint32_t pmu_overflows()
+{
+    uint64_t value;
+    __asm__ volatile ("mrs %0, pmovsset_el0" : "=r" (value));
+    return (uint32_t) value;
+}
+
+static void pmu_interrupt( uint32_t /* irq */, void * /* data */ )
+{
+    uint64_t pc;
+    __asm__ volatile ("mrs %0, elr_el1" : "=r" (pc));
+
+    struct pmu_core &core = cores[smp_core_id()];
+    uint32_t flags = pmu_overflows();
+    __asm__ volatile ("msr pmovsclr_el0, %0" :: "r" ((uint64_t) flags));
+    __asm__ volatile ("isb" ::: "memory");
+
+    for (uint32_t i = 0; i < core.counters; ++i)
+    {
+        if ((flags & (1U << i)) == 0) continue;
+        if (i == PMU_SAMPLER && pmu_sample_event != 0)
+        {
+            pmu_counter_set(i, (uint32_t) -pmu_sample_period);
+            ++core.samples;
+            profile_sample(pc);
+        }
+        else
+            core.high[i] += 1ULL << 32;
+    }
+}
+
+void pmu_enable()
+{
+    struct pmu_core &core = cores[smp_core_id()];
+
+    uint64_t pmcr;
+    __asm__ volatile ("mrs %0, pmcr_el0" : "=r" (pmcr));
+    core.counters = PMCR_N(pmcr);
+    if (core.counters > PMU_COUNTERS) core.counters = PMU_COUNTERS;
+    memset(core.high, 0, sizeof(core.high));
+
+    uint32_t mask = (1U << core.counters) - 1;
+    __asm__ volatile ("msr pmcntenclr_el0, %0" :: "r" ((uint64_t) 0xFFFFFFFFU));
+    __asm__ volatile ("msr pmccfiltr_el0, %0" :: "r" ((uint64_t) 0));
+    for (uint32_t i = 0; i < core.counters; ++i)
+        pmu_counter_type(i, PMU_EVENTS[i]);
+    __asm__ volatile ("msr pmovsclr_el0, %0" :: "r" ((uint64_t) 0xFFFFFFFFU));
+    __asm__ volatile ("msr pmintenclr_el1, %0" :: "r" ((uint64_t) 0xFFFFFFFFU));
+    __asm__ volatile ("msr pmintenset_el1, %0" :: "r" ((uint64_t) mask));
+    __asm__ volatile ("msr pmcr_el0, %0" :: "r" ((uint64_t) (PMCR_E | PMCR_P | PMCR_C | PMCR_LC)));
+    __asm__ volatile ("msr pmcntenset_el0, %0" :: "r" ((uint64_t) (mask | PMU_CYCLE_BIT)));
+    __asm__ volatile ("isb" ::: "memory");
+
+    irq_enable(IRQ_LOCAL_PMU);
+}
+
+int pmu_initialize()
+{
+    memset(cores, 0, sizeof(cores));
+
+    int result = irq_attach(IRQ_LOCAL_PMU, "pmu", pmu_interrupt, nullptr);
+    if (result != EOK) return result;
+    pmu_enable();
+
+    uart_print(LOG_TITLE "Enabled cycle counter and %d event counters\n", cores[smp_core_id()].counters);
+    return EOK;
+}
+
+void pmu_snapshot( struct pmu_counters *counters )
+{
+    uint32_t count = cores[smp_core_id()].counters;
+    counters->cycles = pmu_cycles();
+    for (uint32_t i = 0; i < PMU_COUNTERS; ++i)
+        counters->events[i] = (i < count) ? pmu_counter_get(i) : 0;
+}
+
+void pmu_read( struct pmu_counters *counters )
+{
+    uint64_t flags = sync_saveInterrupts();
+    struct pmu_core &core = cores[smp_core_id()];
+    counters->cycles = pmu_cycles();
+    for (uint32_t i = 0; i < PMU_COUNTERS; ++i)
+    {
+        if (i >= core.counters)
+        {
+            counters->events[i] = 0;
+            continue;
+        }
+        uint32_t value = pmu_counter_get(i);
+        uint64_t high = core.high[i];
+        // the counter may have wrapped after the last interrupt
+        if ((pmu_overflows() & (1U << i)) && value < 0x80000000U)
+            high += 1ULL << 32;
+        counters->events[i] = high | value;
+    }
+    sync_restoreInterrupts(flags);
+}
+
+void pmu_region_add( struct pmu_region *region, uint32_t core, const struct pmu_counters *start )
+{
+    struct pmu_counters now;
+    pmu_snapshot(&now);
+
+    uint64_t flags = sync_saveInterrupts();
+    struct pmu_region_core &stats = region->cores[core];
+    if (smp_core_id() != core)
+        ++stats.migrated;
+    else
+    {
+        ++stats.calls;
+        stats.total.cycles += now.cycles - start->cycles;
+        for (uint32_t i = 0; i < PMU_COUNTERS; ++i)
+            stats.total.events[i] += (uint32_t) (now.events[i] - start->events[i]);
+    }
+    sync_restoreInterrupts(flags);
+
+    if (region->listed == 0 && __atomic_exchange_n(&region->listed, 1U, __ATOMIC_ACQ_REL) == 0)
+    {
+        flags = spin_lock_irqsave(&pmu_lock);
+        region->next = pmu_regions;
+        pmu_regions = region;
+        spin_unlock_irqrestore(&pmu_lock, flags);
+    }
+}
+
+static void pmu_core_sample( void * /* arg */ )
+{
+    struct pmu_core &core = cores[smp_core_id()];
+    if (core.counters <= PMU_SAMPLER) return;
+
+    uint64_t flags = sync_saveInterrupts();
+    __asm__ volatile ("msr pmcntenclr_el0, %0" :: "r" ((uint64_t) (1U << PMU_SAMPLER)));
+    if (pmu_sample_event != 0)
+    {
+        pmu_counter_type(PMU_SAMPLER, pmu_sample_event);
+        pmu_counter_set(PMU_SAMPLER, (uint32_t) -pmu_sample_period);
+    }
+    else
+    {
+        pmu_counter_type(PMU_SAMPLER, PMU_EVENTS[PMU_SAMPLER]);
+        pmu_counter_set(PMU_SAMPLER, 0);
+    }
+    core.high[PMU_SAMPLER] = 0;
+    __asm__ volatile ("msr pmovsclr_el0, %0" :: "r" ((uint64_t) (1U << PMU_SAMPLER)));
+    __asm__ volatile ("msr pmcntenset_el0, %0" :: "r" ((uint64_t) (1U << PMU_SAMPLER)));
+    __asm__ volatile ("isb" ::: "memory");
+    sync_restoreInterrupts(flags);
+}
+
+int pmu_sample( uint32_t event, uint32_t period )
+{
+    if (event != 0 && period == 0) return EARGUMENT;
+    if (event != 0)
+    {
+        int result = profile_prepare();
+        if (result != EOK) return result;
+    }
+
+    pmu_sample_period = period;
+    pmu_sample_event = event;
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+        smp_call_function(i, pmu_core_sample, nullptr);
+    return EOK;
+}
+
+static void pmu_core_read( void *arg )
+{
+    pmu_read((struct pmu_counters*) arg);
+}
+
+/*
+ * Print @c value / @c count with two decimal places.
+ */
+static void proc_pmu_ratio( char *p, size_t ps, uint64_t value, uint64_t count )
+{
+    uint64_t ratio = (count > 0) ? value * 100 / count : 0;
+    sncatprintf(p, ps, "%5lu.%02lu  ", ratio / 100, ratio % 100);
+}
+
+static int proc_pmu( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Core  Cycles          Instructions    IPC       L1D refill  TLB refill  L1I refill  L2D refill  %s\n",
+        (pmu_sample_event != 0) ? "Samples" : "BR mispred");
+    sncatprintf(p, ps, "----  --------------  --------------  --------  ----------  ----------  ----------  ----------  ----------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        struct pmu_counters counters;
+        smp_call_function(i, pmu_core_read, &counters);
+        sncatprintf(p, ps, "%-4d  %-14lu  %-14lu  ", i, counters.cycles, counters.events[PMU_INSTRUCTIONS]);
+        proc_pmu_ratio(p, ps, counters.events[PMU_INSTRUCTIONS], counters.cycles);
+        sncatprintf(p, ps, "%-10lu  %-10lu  %-10lu  %-10lu  %-10lu\n",
+            counters.events[PMU_L1D_REFILLS],
+            counters.events[PMU_TLB_REFILLS],
+            counters.events[PMU_L1I_REFILLS],
+            counters.events[PMU_L2D_REFILLS],
+            (pmu_sample_event != 0) ? cores[i].samples : counters.events[PMU_SAMPLER]);
+    }
+
+    sncatprintf(p, ps, "\nRegion            Calls       Cycles/call  IPC       L1D/call  TLB/call  L2D/call  Migrated\n");
+    sncatprintf(p, ps, "----------------  ----------  -----------  --------  --------  --------  --------  --------\n");
+    uint64_t flags = spin_lock_irqsave(&pmu_lock);
+    for (struct pmu_region *region = pmu_regions; region; region = region->next)
+    {
+        struct pmu_region_core total;
+        memset(&total, 0, sizeof(total));
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            const struct pmu_region_core &stats = region->cores[i];
+            total.calls += stats.calls;
+            total.migrated += stats.migrated;
+            total.total.cycles += stats.total.cycles;
+            for (uint32_t j = 0; j < PMU_COUNTERS; ++j)
+                total.total.events[j] += stats.total.events[j];
+        }
+
+        uint64_t calls = (total.calls > 0) ? total.calls : 1;
+        sncatprintf(p, ps, "%-16s  %-10lu  %-11lu  ", region->name, total.calls, total.total.cycles / calls);
+        proc_pmu_ratio(p, ps, total.total.events[PMU_INSTRUCTIONS], total.total.cycles);
+        sncatprintf(p, ps, "%-8lu  %-8lu  %-8lu  %lu\n",
+            total.total.events[PMU_L1D_REFILLS] / calls,
+            total.total.events[PMU_TLB_REFILLS] / calls,
+            total.total.events[PMU_L2D_REFILLS] / calls,
+            total.migrated);
+    }
+    spin_unlock_irqrestore(&pmu_lock, flags);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+/*
+ * Accepts "sample <event> <period>" and "sample off".
+ */
+static int proc_pmu_write( const uint8_t *buffer, int size, void * /* data */ )
+{
+    char line[48];
+    int length = size;
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' ')) --length;
+    if (length >= (int) sizeof(line)) return EARGUMENT;
+    memcpy(line, buffer, (size_t) length);
+    line[length] = 0;
+
+    if (strncmp(line, "sample ", 7) != 0) return EARGUMENT;
+    char *name = line + 7;
+    if (strcmp(name, "off") == 0)
+    {
+        int result = pmu_sample(0, 0);
+        return (result == EOK) ? size : result;
+    }
+
+    char *period = name;
+    while (*period != 0 && *period != ' ') ++period;
+    if (*period == 0) return EARGUMENT;
+    *period++ = 0;
+    uint32_t value = 0;
+    for (; *period >= '0' && *period <= '9'; ++period)
+        value = value * 10 + (uint32_t) (*period - '0');
+    if (*period != 0) return EARGUMENT;
+
+    for (size_t i = 0; i < sizeof(PMU_EVENT_NAMES) / sizeof(PMU_EVENT_NAMES[0]); ++i)
+    {
+        if (strcmp(PMU_EVENT_NAMES[i].name, name) != 0) continue;
+        int result = pmu_sample(PMU_EVENT_NAMES[i].event, value);
+        return (result == EOK) ? size : result;
+    }
+    return ENOENT;
+}
+
+void pmu_register()
+{
+    procfs_register_rw("/pmu", proc_pmu, proc_pmu_write, nullptr);
+}
@@ -18,8 +18,7 @@
  * Simple "procfs" file system.
  */
 
-// TODO: introduce write callback
-// TODO: execute the handler when the user read/write data
+// TODO: execute the handler when the user read data
 
 #include <sys/procfs.h>
 #include <sys/vfs.h>
@@ -27,6 +26,8 @@
 #include <mc/string.h>
 #include <sys/heap.h>
 #include <sys/uart.h>
+#include <sys/sync.h>
+#include <sys/rcu.h>
 #include <mc/stdlib.h>
 #include <mc/string.h>
 
@@ -37,6 +38,7 @@ struct inode
     char name[MAX_FILENAME];
     ino_t inode;
     procfunc_t callback;
+    procwrite_t write;
     void *data;
     struct inode *next;
 };
@@ -49,17 +51,25 @@ struct fsdata
     int size;
 };
 
+/*
+ * Read without locks (see 'rcu.h'); writers are serialized by 'procLock'.
+ */
 static struct inode *procList = NULL;
 
+static spinlock_t procLock = SPINLOCK_INITIALIZER;
+
 static ino_t counter = 0;
 
+/*
+ * Must be called inside a RCU read-side section (or holding 'procLock').
+ */
 static struct inode *find_inode( const char *name )
 {
-    struct inode *node = procList;
+    struct inode *node = rcu_dereference(procList);
     while (node)
     {
         if (strcmp(name, node->name) == 0) return node;
-        node = node->next;
+        node = rcu_dereference(node->next);
     }
 
     return NULL;
@@ -73,11 +83,11 @@ static struct inode *remove_inode( const char *name )
     {
         if (strcmp(name, node->name) == 0)
         {
+            // readers may still be walking 'node', so keep its link
             if (prev)
-                prev->next = node->next;
+                rcu_assign_pointer(prev->next, node->next);
             else
-                procList->next = node->next;
-            node->next = NULL;
+                rcu_assign_pointer(procList, node->next);
             return node;
         }
         prev = node;
@@ -91,17 +101,28 @@ static int procfs_open( struct file *fp, const char *path, uint32_t flags )
 {
     (void) flags;
 
-    struct inode *inode = find_inode(path);
-    if (inode == NULL) return ENOENT;
-
     // create procfs specific data
     struct fsdata *data = (struct fsdata*) heap_allocate( sizeof(struct fsdata) );
     if (data == NULL) return EMEMORY;
     memset(data, 0, sizeof(*data));
+
+    rcu_read_lock();
+    struct inode *inode = find_inode(path);
+    if (inode == NULL)
+    {
+        rcu_read_unlock();
+        heap_free(data);
+        return ENOENT;
+    }
     data->inode = inode;
+    // callbacks may block (e.g. mailbox round trips), so they run outside the
+    // read-side section
+    procfunc_t callback = inode->callback;
+    void *arg = inode->data;
+    rcu_read_unlock();
 
     // call registered function with a fixed size internal buffer
-    int result = inode->callback(data->buffer, PROCFS_MAX_BUFFER, inode->data);
+    int result = callback(data->buffer, PROCFS_MAX_BUFFER, arg);
     if (result < 0 || result > PROCFS_MAX_BUFFER)
     {
         heap_free(data);
@@ -135,10 +156,26 @@ static int procfs_read( struct file *fp, uint8_t *buffer, size_t count )
 
 static int procfs_write( struct file *fp, const uint8_t *buffer, size_t count )
 {
-    (void) fp;
-    (void) buffer;
-    (void) count;
-    return ENOIMP;
+    struct fsdata *data = (struct fsdata*) fp->fsdata;
+    if (data == NULL) return EINVALID;
+    if (count > PROCFS_MAX_BUFFER) return ETOOLONG;
+
+    // the inode may have been unregistered since the file was opened
+    rcu_read_lock();
+    struct inode *node = rcu_dereference(procList);
+    while (node && node != data->inode) node = rcu_dereference(node->next);
+    if (node == NULL)
+    {
+        rcu_read_unlock();
+        return ENOENT;
+    }
+    // called outside the read-side section, like the read callbacks
+    procwrite_t write = node->write;
+    void *arg = node->data;
+    rcu_read_unlock();
+
+    if (write == NULL) return ENOIMP;
+    return write(buffer, (int) count, arg);
 }
 
 static int procfs_stat( struct file *fp, struct stat *info )
@@ -187,19 +224,32 @@ int procfs_initialize()
 
 int procfs_register( const char *name, procfunc_t func, void *data )
 {
-    if (strlen(name ) >= MAX_FILENAME) return ETOOLONG;
+    return procfs_register_rw(name, func, NULL, data);
+}
 
-    if (find_inode(name)) return EEXIST;
+int procfs_register_rw( const char *name, procfunc_t func, procwrite_t write, void *data )
+{
+    if (strlen(name ) >= MAX_FILENAME) return ETOOLONG;
 
     struct inode *ptr = (struct inode*) heap_allocate( sizeof(struct inode) );
     if (ptr == NULL) return EMEMORY;
 
     strcpy(ptr->name, name);
     ptr->callback = func;
+    ptr->write = write;
     ptr->data = data;
+
+    spin_lock(&procLock);
+    if (find_inode(name))
+    {
+        spin_unlock(&procLock);
+        heap_free(ptr);
+        return EEXIST;
+    }
     ptr->inode = ++counter;
     ptr->next = procList;
-    procList = ptr;
+    rcu_assign_pointer(procList, ptr);
+    spin_unlock(&procLock);
 
     uart_print("Registered procfs file '%s'\n", name);
 
@@ -208,9 +258,12 @@ int procfs_register( const char *name, procfunc_t func, void *data )
 
 int procfs_unregister( const char *name )
 {
+    spin_lock(&procLock);
     struct inode *tmp = remove_inode(name);
+    spin_unlock(&procLock);
     if (tmp == NULL) return ENOENT;
 
+    rcu_synchronize();
     heap_free(tmp);
     return EOK;
 }
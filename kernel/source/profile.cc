@@ -0,0 +1,312 @@
+/*
+ * Sampling profiler.
+ *
+ * While running, the virtual timer (CNTV) of each core interrupts it
+ * PROFILE_HZ times per second and the interrupted instruction (ELR_EL1) is
+ * counted in a histogram covering the kernel code. The physical timer is left
+ * to the timer wheel, so sampling does not disturb timer events.
+ *
+ * Other sources (like PMU counter overflows) may add samples to the same
+ * histogram with 'profile_sample'.
+ *
+ * Reports are symbolised with the kernel symbol table (see 'sys/ksyms.h').
+ */
+
+#include <sys/profile.h>
+#include <sys/ksyms.h>
+#include <sys/irq.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/heap.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<profile> "
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) profile_core
+{
+    volatile bool running;
+    uint64_t samples;
+    /**
+     * Samples outside the kernel code (should not happen).
+     */
+    uint64_t outside;
+};
+
+struct profile_entry
+{
+    const struct ksym *symbol;
+    uint64_t samples;
+};
+
+// from 'kernel.ld'
+extern "C" uint8_t _kernel_begin;
+extern "C" uint8_t _end_text;
+
+static struct profile_core cores[SYS_CPU_CORES];
+
+static uint32_t *profile_histogram = nullptr;
+
+static size_t profile_size = 0;
+
+/*
+ * Sampling period in counter ticks.
+ */
+static uint64_t profile_interval = 0;
+
+static volatile bool profile_running = false;
+
+static inline void profile_arm()
+{
+    __asm__ volatile ("msr cntv_tval_el0, %0" :: "r" (profile_interval));
+    __asm__ volatile ("msr cntv_ctl_el0, %0" :: "r" ((uint64_t) 1));
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+static inline void profile_disarm()
+{
+    __asm__ volatile ("msr cntv_ctl_el0, %0" :: "r" ((uint64_t) 0));
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+void profile_sample( uint64_t pc )
+{
+    uint32_t *histogram = __atomic_load_n(&profile_histogram, __ATOMIC_ACQUIRE);
+    if (histogram == nullptr) return;
+
+    struct profile_core &core = cores[smp_core_id()];
+    ++core.samples;
+    uintptr_t base = (uintptr_t) &_kernel_begin;
+    size_t index = (size_t) (pc - base) / PROFILE_GRANULE;
+    if (pc < base || index >= profile_size)
+        ++core.outside;
+    else
+        __atomic_add_fetch(&histogram[index], 1U, __ATOMIC_RELAXED);
+}
+
+static void profile_interrupt( uint32_t /* irq */, void * /* data */ )
+{
+    // the handler runs before the exception return, so ELR_EL1 still has the
+    // interrupted instruction
+    uint64_t pc;
+    __asm__ volatile ("mrs %0, elr_el1" : "=r" (pc));
+
+    if (!cores[smp_core_id()].running)
+    {
+        profile_disarm();
+        return;
+    }
+    profile_arm();
+    profile_sample(pc);
+}
+
+static void profile_core_start( void * /* arg */ )
+{
+    cores[smp_core_id()].running = true;
+    irq_enable(IRQ_LOCAL_CNTV);
+    profile_arm();
+}
+
+static void profile_core_stop( void * /* arg */ )
+{
+    cores[smp_core_id()].running = false;
+    profile_disarm();
+    irq_disable(IRQ_LOCAL_CNTV);
+}
+
+int profile_prepare()
+{
+    static spinlock_t lock = SPINLOCK_INITIALIZER;
+
+    int result = EOK;
+    uint64_t flags = spin_lock_irqsave(&lock);
+    if (profile_histogram == nullptr)
+    {
+        size_t size = (size_t) (&_end_text - &_kernel_begin) / PROFILE_GRANULE;
+        uint32_t *histogram = (uint32_t*) heap_allocate(size * sizeof(uint32_t));
+        if (histogram == nullptr)
+            result = EMEMORY;
+        else
+        {
+            memset(histogram, 0, size * sizeof(uint32_t));
+            profile_size = size;
+            __atomic_store_n(&profile_histogram, histogram, __ATOMIC_RELEASE);
+
+            uint64_t frequency;
+            __asm__ volatile ("mrs %0, cntfrq_el0" : "=r" (frequency));
+            profile_interval = frequency / PROFILE_HZ;
+
+            irq_attach(IRQ_LOCAL_CNTV, "profile", profile_interrupt, nullptr);
+            uart_print(LOG_TITLE "Histogram with %lu counters and %lu symbols\n",
+                profile_size, ksyms_count());
+        }
+    }
+    spin_unlock_irqrestore(&lock, flags);
+    return result;
+}
+
+int profile_start()
+{
+    if (__atomic_exchange_n(&profile_running, true, __ATOMIC_ACQ_REL)) return EEXIST;
+
+    int result = profile_prepare();
+    if (result != EOK)
+    {
+        profile_running = false;
+        return result;
+    }
+
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+        smp_call_function(i, profile_core_start, nullptr);
+    return EOK;
+}
+
+int profile_stop()
+{
+    if (!__atomic_exchange_n(&profile_running, false, __ATOMIC_ACQ_REL)) return ENOENT;
+
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+        smp_call_function(i, profile_core_stop, nullptr);
+    return EOK;
+}
+
+void profile_reset()
+{
+    if (profile_histogram)
+        memset(profile_histogram, 0, profile_size * sizeof(uint32_t));
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        cores[i].samples = 0;
+        cores[i].outside = 0;
+    }
+}
+
+/*
+ * Keep the PROFILE_TOP functions with more samples, sorted.
+ */
+static void profile_rank( struct profile_entry *top, size_t &count, const struct ksym *symbol, uint64_t samples )
+{
+    if (samples == 0) return;
+    if (count == PROFILE_TOP && top[count - 1].samples >= samples) return;
+
+    size_t i = (count < PROFILE_TOP) ? count++ : count - 1;
+    for (; i > 0 && top[i - 1].samples < samples; --i)
+        top[i] = top[i - 1];
+    top[i].symbol = symbol;
+    top[i].samples = samples;
+}
+
+static int proc_profile( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    uint64_t total = 0;
+    uint64_t outside = 0;
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        total += cores[i].samples;
+        outside += cores[i].outside;
+    }
+
+    sncatprintf(p, ps, "State: %s  Rate: %d Hz  Samples: %lu  Outside code: %lu\n\n",
+        profile_running ? "running" : "stopped", PROFILE_HZ, total, outside);
+    if (profile_histogram == nullptr) return (int) (strlen(p) * sizeof(char));
+
+    // counters of a function are contiguous
+    struct profile_entry top[PROFILE_TOP];
+    size_t count = 0;
+    const struct ksym *current = nullptr;
+    uint64_t samples = 0;
+    uintptr_t base = (uintptr_t) &_kernel_begin;
+    for (size_t i = 0; i < profile_size; ++i)
+    {
+        if (profile_histogram[i] == 0) continue;
+        const struct ksym *symbol = ksyms_lookup(base + i * PROFILE_GRANULE);
+        if (symbol != current)
+        {
+            profile_rank(top, count, current, samples);
+            current = symbol;
+            samples = 0;
+        }
+        samples += profile_histogram[i];
+    }
+    profile_rank(top, count, current, samples);
+
+    sncatprintf(p, ps, "Samples     Percent  Function\n");
+    sncatprintf(p, ps, "----------  -------  ------------------------------\n");
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t percent = (total > 0) ? top[i].samples * 10000 / total : 0;
+        sncatprintf(p, ps, "%-10lu  %3lu.%02lu%%  %s\n",
+            top[i].samples,
+            percent / 100,
+            percent % 100,
+            top[i].symbol ? top[i].symbol->name : "(unknown)");
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+/*
+ * Accepts "start", "stop" and "reset".
+ */
+static int proc_profile_write( const uint8_t *buffer, int size, void * /* data */ )
+{
+    char command[16];
+    int length = size;
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' ')) --length;
+    if (length >= (int) sizeof(command)) return EARGUMENT;
+    memcpy(command, buffer, (size_t) length);
+    command[length] = 0;
+
+    int result;
+    if (strcmp(command, "start") == 0)
+        result = profile_start();
+    else
+    if (strcmp(command, "stop") == 0)
+        result = profile_stop();
+    else
+    if (strcmp(command, "reset") == 0)
+    {
+        profile_reset();
+        result = EOK;
+    }
+    else
+        result = EARGUMENT;
+    return (result == EOK) ? size : result;
+}
+
+/*
+ * Non-zero counters as "<address> <samples>", for offline symbolisation.
+ */
+static int proc_profile_raw( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    if (profile_histogram == nullptr) return 0;
+
+    uintptr_t base = (uintptr_t) &_kernel_begin;
+    for (size_t i = 0; i < profile_size; ++i)
+    {
+        if (profile_histogram[i] == 0) continue;
+        sncatprintf(p, ps, "%016lx %u\n", base + i * PROFILE_GRANULE, profile_histogram[i]);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void profile_register()
+{
+    procfs_register_rw("/profile", proc_profile, proc_profile_write, nullptr);
+    procfs_register("/profile_raw", proc_profile_raw, nullptr);
+}
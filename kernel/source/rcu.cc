@@ -0,0 +1,243 @@
+/*
+ * Read-copy-update.
+ *
+ * Readers only disable preemption, so a core is known to be outside any
+ * read-side section whenever it switches tasks, takes the scheduler tick in a
+ * preemptible context or runs the idle loop. Each core counts these
+ * quiescent states; a grace period is over once every other online core
+ * reported at least one quiescent state since it started.
+ *
+ * Idle cores stop their tick and may sleep for long periods, so they are
+ * flagged as idle instead: an idle core is always quiescent, except while it
+ * is handling an IRQ.
+ */
+
+#include <sys/rcu.h>
+#include <sys/smp.h>
+#include <sys/timer.hh>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+/*
+ * Interval (in microseconds) between polls of idle cores while callbacks are
+ * waiting.
+ */
+#define RCU_POLL_INTERVAL  1000
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) rcu_core
+{
+    volatile uint64_t quiescent;
+    volatile uint32_t online;
+    volatile uint32_t idle;
+    /**
+     * The idle flag was cleared by the IRQ being handled.
+     */
+    bool irq_idle;
+    /**
+     * Wakes up the idle loop to call 'rcu_poll' again.
+     */
+    struct timer_event poll;
+};
+
+/**
+ * Quiescent state counters of the cores that must be observed before a grace
+ * period is over.
+ */
+struct rcu_snapshot
+{
+    uint32_t mask;
+    uint64_t quiescent[SYS_CPU_CORES];
+};
+
+static struct rcu_core cores[SYS_CPU_CORES];
+
+static spinlock_t rcu_lock = SPINLOCK_INITIALIZER;
+
+/**
+ * Callbacks waiting for the next grace period to start.
+ */
+static struct rcu_head *next_head = nullptr;
+static struct rcu_head *next_tail = nullptr;
+
+/**
+ * Callbacks waiting for the grace period described by 'wait_snapshot'.
+ */
+static struct rcu_head *wait_head = nullptr;
+static struct rcu_snapshot wait_snapshot;
+
+static uint64_t rcu_grace_periods = 0;
+static uint64_t rcu_queued = 0;
+static uint64_t rcu_invoked = 0;
+
+static void rcu_take_snapshot( struct rcu_snapshot &snapshot )
+{
+    // the unlinking of objects must be visible before sampling the counters
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint32_t self = smp_core_id();
+    snapshot.mask = 0;
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        // the current core is quiescent by definition
+        if (i == self || !__atomic_load_n(&cores[i].online, __ATOMIC_ACQUIRE)) continue;
+        if (__atomic_load_n(&cores[i].idle, __ATOMIC_ACQUIRE)) continue;
+        snapshot.mask |= 1U << i;
+        snapshot.quiescent[i] = __atomic_load_n(&cores[i].quiescent, __ATOMIC_ACQUIRE);
+    }
+}
+
+static bool rcu_completed( const struct rcu_snapshot &snapshot )
+{
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        if ((snapshot.mask & (1U << i)) == 0) continue;
+        if (__atomic_load_n(&cores[i].idle, __ATOMIC_ACQUIRE)) continue;
+        if (__atomic_load_n(&cores[i].quiescent, __ATOMIC_ACQUIRE) == snapshot.quiescent[i]) return false;
+    }
+    return true;
+}
+
+void rcu_quiescent()
+{
+    struct rcu_core &core = cores[smp_core_id()];
+    __atomic_store_n(&core.quiescent, core.quiescent + 1, __ATOMIC_RELEASE);
+    // later reads must not be satisfied before the report is visible
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_idle_enter()
+{
+    rcu_quiescent();
+    __atomic_store_n(&cores[smp_core_id()].idle, 1U, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_idle_exit()
+{
+    __atomic_store_n(&cores[smp_core_id()].idle, 0U, __ATOMIC_RELEASE);
+    // read-side sections must not start before the core is tracked again
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_irq_enter()
+{
+    struct rcu_core &core = cores[smp_core_id()];
+    if (!core.idle) return;
+    rcu_idle_exit();
+    core.irq_idle = true;
+}
+
+void rcu_irq_exit()
+{
+    struct rcu_core &core = cores[smp_core_id()];
+    if (!core.irq_idle) return;
+    core.irq_idle = false;
+    rcu_idle_enter();
+}
+
+static void rcu_poll_timer( struct timer_event * /* event */ )
+{
+    // nothing to do: the interrupt wakes up the idle loop
+}
+
+void rcu_online()
+{
+    cores[smp_core_id()].poll.func = rcu_poll_timer;
+    rcu_quiescent();
+    __atomic_store_n(&cores[smp_core_id()].online, 1U, __ATOMIC_RELEASE);
+}
+
+void rcu_synchronize()
+{
+    struct rcu_snapshot snapshot;
+    rcu_take_snapshot(snapshot);
+    while (!rcu_completed(snapshot)) task_yield();
+    __atomic_add_fetch(&rcu_grace_periods, 1, __ATOMIC_RELAXED);
+}
+
+void rcu_call( struct rcu_head *head, rcu_func_t func )
+{
+    if (head == nullptr || func == nullptr) return;
+    head->func = func;
+    head->next = nullptr;
+
+    uint64_t flags = spin_lock_irqsave(&rcu_lock);
+    if (next_tail)
+        next_tail->next = head;
+    else
+        next_head = head;
+    next_tail = head;
+    __atomic_add_fetch(&rcu_queued, 1, __ATOMIC_RELAXED);
+    spin_unlock_irqrestore(&rcu_lock, flags);
+
+    // idle cores start the grace period
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+}
+
+void rcu_poll()
+{
+    struct rcu_head *done = nullptr;
+
+    uint64_t flags = spin_lock_irqsave(&rcu_lock);
+    if (wait_head && rcu_completed(wait_snapshot))
+    {
+        done = wait_head;
+        wait_head = nullptr;
+        __atomic_add_fetch(&rcu_grace_periods, 1, __ATOMIC_RELAXED);
+    }
+    if (wait_head == nullptr && next_head)
+    {
+        // start a new grace period for the callbacks queued so far
+        wait_head = next_head;
+        next_head = next_tail = nullptr;
+        rcu_take_snapshot(wait_snapshot);
+    }
+    bool waiting = wait_head != nullptr;
+    spin_unlock_irqrestore(&rcu_lock, flags);
+
+    // the tick of idle cores is stopped: poll again later
+    struct timer_event &poll = cores[smp_core_id()].poll;
+    if (waiting && !timer_pending(&poll)) timer_schedule(&poll, RCU_POLL_INTERVAL, 0);
+
+    while (done)
+    {
+        struct rcu_head *next = done->next;
+        done->func(done);
+        __atomic_add_fetch(&rcu_invoked, 1, __ATOMIC_RELAXED);
+        done = next;
+    }
+}
+
+static int proc_rcu( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Grace periods: %lu\n", rcu_grace_periods);
+    sncatprintf(p, ps, "    Callbacks: %lu queued, %lu invoked\n\n", rcu_queued, rcu_invoked);
+
+    sncatprintf(p, ps, "Core  Online  Idle  Quiescent states\n");
+    sncatprintf(p, ps, "----  ------  ----  ----------------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        sncatprintf(p, ps, "%-4d  %-6s  %-4s  %lu\n",
+            i,
+            cores[i].online ? "yes" : "no",
+            cores[i].idle ? "yes" : "no",
+            cores[i].quiescent);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void rcu_register()
+{
+    procfs_register("/rcu", proc_rcu, nullptr);
+}
@@ -0,0 +1,329 @@
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/sysio.h>
+#include <sys/bcm2837.h>
+#include <sys/job.h>
+#include <sys/task.h>
+#include <sys/irq.h>
+#include <sys/pmu.hh>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <sys/cache.h>
+#include <sys/system.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE  "<smp> "
+
+/*
+ * Local mailbox used for IPIs. The mailbox 3 is left for the start protocol
+ * of 'kern_wake_core'.
+ */
+#define IPI_MAILBOX      0
+
+static const char *IPI_NAMES[] = { "wakeup", "reschedule", "call", "tlb", "cache", "flush" };
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) smp_core
+{
+    /**
+     * Pending function calls for this core.
+     */
+    spinlock_t lock;
+    struct smp_call *head;
+    struct smp_call *tail;
+    /**
+     * For each IPI type, the ticket of the last request sent to this core and
+     * the ticket of the last request handled by it.
+     */
+    volatile uint32_t requested[IPI_TYPES];
+    volatile uint32_t completed[IPI_TYPES];
+    uint64_t received[IPI_TYPES];
+};
+
+static struct smp_core cores[SYS_CPU_CORES];
+
+static ipi_handler_t ipi_handlers[IPI_TYPES];
+
+/*
+ * Bit mask of the cores able to receive IPIs.
+ */
+static volatile uint32_t smp_online = 0;
+
+// from 'entrypoint.S'
+extern "C" uint32_t kvar_cores_available;
+extern "C" uint64_t kvar_secondary_entry;
+
+static void smp_ipi_enable( uint32_t id )
+{
+    PUT32(SOC_LOCAL_MAILBOX_CLEAR(id, IPI_MAILBOX), 0xFFFFFFFFU);
+    irq_enable(IRQ_LOCAL_MAILBOX(IPI_MAILBOX));
+    __atomic_or_fetch(&smp_online, 1U << id, __ATOMIC_RELEASE);
+}
+
+/*
+ * Handle pending IPIs while waiting for another core, so two cores waiting for
+ * each other with IRQs masked can not deadlock.
+ */
+static void smp_ipi_poll()
+{
+    uint64_t flags = sync_saveInterrupts();
+    smp_ipi_dispatch();
+    sync_restoreInterrupts(flags);
+}
+
+static void smp_ipi_wait( uint32_t core, uint32_t type, uint32_t ticket )
+{
+    const volatile uint32_t *completed = &cores[core].completed[type];
+    while ((int32_t) (__atomic_load_n(completed, __ATOMIC_ACQUIRE) - ticket) < 0)
+    {
+        smp_ipi_poll();
+        sync_waitEvent();
+    }
+}
+
+static uint32_t smp_ipi_post( uint32_t core, uint32_t type )
+{
+    uint32_t ticket = __atomic_add_fetch(&cores[core].requested[type], 1, __ATOMIC_ACQ_REL);
+    // everything written so far must be visible to the target core
+    sync_dataSyncBarrier();
+    PUT32(SOC_LOCAL_MAILBOX_SET(core, IPI_MAILBOX), 1U << type);
+    // the target may be waiting in 'wfe' with IRQs masked
+    sync_sendEvent();
+    return ticket;
+}
+
+static void smp_ipi_call( uint32_t /* type */ )
+{
+    struct smp_core &core = cores[smp_core_id()];
+
+    spin_lock(&core.lock);
+    struct smp_call *call = core.head;
+    core.head = core.tail = nullptr;
+    spin_unlock(&core.lock);
+
+    while (call)
+    {
+        // the caller may release the request as soon as 'done' is set
+        struct smp_call *next = call->next;
+        call->func(call->arg);
+        __atomic_store_n(&call->done, 1U, __ATOMIC_RELEASE);
+        call = next;
+    }
+}
+
+static void smp_ipi_tlb( uint32_t /* type */ )
+{
+    __asm__ volatile ("tlbi vmalle1" ::: "memory");
+    sync_dataSyncBarrier();
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+static void smp_ipi_drain( uint32_t /* type */ )
+{
+    sync_dataSyncBarrier();
+}
+
+static void smp_ipi_handler( uint32_t /* irq */, void * /* data */ )
+{
+    smp_ipi_dispatch();
+}
+
+/*
+ * Entry point for secondary cores. This function is called with the EL1
+ * stack of the core already set by the entry point.
+ */
+extern "C" void kernel_secondary_main()
+{
+    smp_ipi_enable(smp_core_id());
+    pmu_enable();
+    // the boot context becomes the idle task of this core
+    task_start();
+    job_worker_main();
+}
+
+uint32_t smp_cores()
+{
+    return kvar_cores_available;
+}
+
+int smp_initialize()
+{
+    if (kvar_secondary_entry != 0) return EEXIST;
+
+    // IPI_WAKEUP needs no handler: the interrupt itself wakes the core
+    ipi_handlers[IPI_CALL_FUNCTION] = smp_ipi_call;
+    ipi_handlers[IPI_TLB_SHOOTDOWN] = smp_ipi_tlb;
+    ipi_handlers[IPI_CACHE_DRAIN] = smp_ipi_drain;
+    irq_attach(IRQ_LOCAL_MAILBOX(IPI_MAILBOX), "ipi", smp_ipi_handler, nullptr);
+    smp_ipi_enable(0);
+
+    // parked cores are waiting in 'wfe' for a non-zero entry address
+    // parked cores read memory without their MMU, so not through the caches
+    kvar_secondary_entry = (uint64_t) (uintptr_t) kernel_secondary_main;
+    cache_clean_range(&kvar_secondary_entry, sizeof(kvar_secondary_entry));
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+
+    uart_print(LOG_TITLE "Released %d secondary cores\n", smp_cores() - 1);
+    return EOK;
+}
+
+int smp_ipi_register( uint32_t type, ipi_handler_t handler )
+{
+    if (type >= IPI_TYPES) return EARGUMENT;
+    ipi_handlers[type] = handler;
+    return EOK;
+}
+
+int smp_ipi_send( uint32_t core, uint32_t type, bool wait )
+{
+    if (core >= SYS_CPU_CORES || type >= IPI_TYPES) return EARGUMENT;
+    if ((__atomic_load_n(&smp_online, __ATOMIC_ACQUIRE) & (1U << core)) == 0) return EINVALID;
+
+    uint32_t ticket = smp_ipi_post(core, type);
+    if (wait) smp_ipi_wait(core, type, ticket);
+    return EOK;
+}
+
+int smp_ipi_broadcast( uint32_t type, bool wait )
+{
+    if (type >= IPI_TYPES) return EARGUMENT;
+
+    uint32_t self = smp_core_id();
+    uint32_t online = __atomic_load_n(&smp_online, __ATOMIC_ACQUIRE) & ~(1U << self);
+    uint32_t tickets[SYS_CPU_CORES];
+
+    // send everything before waiting, so the targets work in parallel
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        if (online & (1U << i)) tickets[i] = smp_ipi_post(i, type);
+    if (wait)
+    {
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+            if (online & (1U << i)) smp_ipi_wait(i, type, tickets[i]);
+    }
+    return EOK;
+}
+
+void smp_ipi_dispatch()
+{
+    uint32_t id = smp_core_id();
+    struct smp_core &core = cores[id];
+
+    uint32_t pending = GET32(SOC_LOCAL_MAILBOX_CLEAR(id, IPI_MAILBOX));
+    if (pending == 0) return;
+    // clear before reading the tickets: a request posted after this point
+    // sets the bit again and is handled by another IRQ
+    PUT32(SOC_LOCAL_MAILBOX_CLEAR(id, IPI_MAILBOX), pending);
+    sync_dataSyncBarrier();
+
+    while (pending)
+    {
+        uint32_t type = (uint32_t) __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        uint32_t ticket = __atomic_load_n(&core.requested[type], __ATOMIC_ACQUIRE);
+        ++core.received[type];
+        if (ipi_handlers[type]) ipi_handlers[type](type);
+        __atomic_store_n(&core.completed[type], ticket, __ATOMIC_RELEASE);
+    }
+
+    // wake up senders waiting for completion
+    sync_dataSyncBarrier();
+    sync_sendEvent();
+}
+
+int smp_call_function_async( uint32_t core, struct smp_call *call )
+{
+    if (core >= SYS_CPU_CORES || call == nullptr || call->func == nullptr) return EARGUMENT;
+    if ((__atomic_load_n(&smp_online, __ATOMIC_ACQUIRE) & (1U << core)) == 0) return EINVALID;
+
+    call->done = 0;
+    call->next = nullptr;
+
+    struct smp_core &target = cores[core];
+    uint64_t flags = spin_lock_irqsave(&target.lock);
+    if (target.tail)
+        target.tail->next = call;
+    else
+        target.head = call;
+    target.tail = call;
+    spin_unlock_irqrestore(&target.lock, flags);
+
+    smp_ipi_post(core, IPI_CALL_FUNCTION);
+    return EOK;
+}
+
+int smp_call_function( uint32_t core, smp_func_t func, void *arg )
+{
+    if (func == nullptr) return EARGUMENT;
+    if (core == smp_core_id())
+    {
+        func(arg);
+        return EOK;
+    }
+
+    struct smp_call call;
+    call.func = func;
+    call.arg = arg;
+    int result = smp_call_function_async(core, &call);
+    if (result != EOK) return result;
+    smp_call_wait(&call);
+    return EOK;
+}
+
+bool smp_call_done( const struct smp_call *call )
+{
+    return __atomic_load_n(&call->done, __ATOMIC_ACQUIRE) != 0;
+}
+
+void smp_call_wait( struct smp_call *call )
+{
+    while (!smp_call_done(call))
+    {
+        smp_ipi_poll();
+        sync_waitEvent();
+    }
+}
+
+void smp_tlb_shootdown()
+{
+    smp_ipi_broadcast(IPI_TLB_SHOOTDOWN, true);
+    smp_ipi_tlb(IPI_TLB_SHOOTDOWN);
+}
+
+void smp_cache_drain()
+{
+    smp_ipi_broadcast(IPI_CACHE_DRAIN, true);
+    smp_ipi_drain(IPI_CACHE_DRAIN);
+}
+
+static int proc_ipi( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    const uint32_t types = sizeof(IPI_NAMES) / sizeof(IPI_NAMES[0]);
+
+    sncatprintf(p, ps, "Type        ");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+        sncatprintf(p, ps, "Core%-8d", i);
+    sncatprintf(p, ps, "\n");
+
+    for (uint32_t t = 0; t < types; ++t)
+    {
+        sncatprintf(p, ps, "%-10s  ", IPI_NAMES[t]);
+        for (uint32_t i = 0; i < smp_cores(); ++i)
+            sncatprintf(p, ps, "%-10lu  ", cores[i].received[t]);
+        sncatprintf(p, ps, "\n");
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void smp_register()
+{
+    procfs_register("/ipi", proc_ipi, nullptr);
+}
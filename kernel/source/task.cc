@@ -1,11 +1,599 @@
-extern "C" void kernel_schedule (void)
+/*
+ * Preemptive scheduler for kernel threads.
+ *
+ * Each core has its own run queues (one per priority) and only runs the tasks
+ * bound to it. The scheduler tick is a periodic timer event of the core; the
+ * current task is preempted when its time slice expires or when a task with
+ * higher priority becomes ready. The tick is stopped while the core is idle.
+ *
+ * Context switches always happen in the exit path of 'exception.S': the full
+ * register context (including FP/SIMD) is saved on the stack of the task and
+ * 'task_schedule' returns the context of the next task to be restored.
+ */
+
+#include <sys/task.h>
+#include <sys/smp.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/pmm.hh>
+#include <sys/heap.h>
+#include <sys/job.h>
+#include <sys/rcu.h>
+#include <sys/irq.h>
+#include <sys/timer.hh>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<task> "
+
+/*
+ * SPSR value for new tasks: EL1 using SP_EL1 with all exceptions unmasked.
+ */
+#define TASK_INITIAL_SPSR  (0x5)
+
+/*
+ * IRQ mask bit of the DAIF register.
+ */
+#define TASK_DAIF_IRQ      (1U << 7)
+
+struct task_queue
+{
+    struct task *head;
+    struct task *tail;
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) task_core
+{
+    spinlock_t lock;
+    struct task_queue queues[TASK_PRIORITIES];
+    struct task *current;
+    struct task *idle;
+    struct task *dead;
+    volatile bool need_resched;
+    /**
+     * Preemption is disabled while greater than zero.
+     */
+    uint32_t preempt_count;
+    struct timer_event tick;
+    uint64_t ticks;
+    uint64_t switches;
+    uint64_t preemptions;
+    /**
+     * Storage for the task created from the boot context of the core.
+     */
+    struct task boot;
+};
+
+/**
+ * Time slice (in scheduler ticks) of each priority.
+ */
+static const uint32_t TASK_SLICE[TASK_PRIORITIES] = { 2, 10, 20 };
+
+static const char *STATE_NAMES[] = { "?", "ready", "running", "blocked", "dead" };
+
+static struct task_core cores[SYS_CPU_CORES];
+
+static struct task *task_list = nullptr;
+
+static spinlock_t task_list_lock = SPINLOCK_INITIALIZER;
+
+static uint32_t task_counter = 0;
+
+// from 'exception.S'
+extern "C" void arch_task_yield();
+
+static void task_enqueue( struct task_core &core, struct task *task )
+{
+    struct task_queue &queue = core.queues[task->priority];
+    task->next = nullptr;
+    if (queue.tail)
+        queue.tail->next = task;
+    else
+        queue.head = task;
+    queue.tail = task;
+}
+
+static void task_unqueue( struct task_core &core, struct task *task )
+{
+    struct task_queue &queue = core.queues[task->priority];
+    struct task *prev = nullptr;
+    for (struct task *p = queue.head; p; prev = p, p = p->next)
+    {
+        if (p != task) continue;
+        if (prev)
+            prev->next = p->next;
+        else
+            queue.head = p->next;
+        if (queue.tail == p) queue.tail = prev;
+        p->next = nullptr;
+        return;
+    }
+}
+
+static struct task *task_dequeue( struct task_core &core )
+{
+    for (uint32_t i = 0; i < TASK_PRIORITIES; ++i)
+    {
+        struct task_queue &queue = core.queues[i];
+        struct task *task = queue.head;
+        if (task == nullptr) continue;
+        queue.head = task->next;
+        if (queue.head == nullptr) queue.tail = nullptr;
+        task->next = nullptr;
+        return task;
+    }
+    return nullptr;
+}
+
+/*
+ * Returns whether there is a ready task with priority equal or higher than
+ * @c priority.
+ */
+static bool task_has_ready( struct task_core &core, uint32_t priority )
+{
+    for (uint32_t i = 0; i <= priority && i < TASK_PRIORITIES; ++i)
+        if (core.queues[i].head) return true;
+    return false;
+}
+
+static void task_add_list( struct task *task )
+{
+    uint64_t flags = spin_lock_irqsave(&task_list_lock);
+    task->all_next = task_list;
+    task_list = task;
+    spin_unlock_irqrestore(&task_list_lock, flags);
+}
+
+static void task_remove_list( struct task *task )
+{
+    uint64_t flags = spin_lock_irqsave(&task_list_lock);
+    struct task *prev = nullptr;
+    for (struct task *p = task_list; p; prev = p, p = p->all_next)
+    {
+        if (p != task) continue;
+        if (prev)
+            prev->all_next = p->all_next;
+        else
+            task_list = p->all_next;
+        break;
+    }
+    spin_unlock_irqrestore(&task_list_lock, flags);
+}
+
+extern "C" void task_trampoline( struct task *task )
+{
+    task->entry(task->arg);
+    task_exit();
+}
+
+static void task_idle( void * /* arg */ )
+{
+    job_worker_main();
+}
+
+static struct task *task_allocate(
+    const char *name,
+    task_entry_t entry,
+    void *arg,
+    uint32_t priority,
+    uint32_t core )
+{
+    struct task *task = (struct task*) heap_allocate(sizeof(struct task));
+    if (task == nullptr) return nullptr;
+    memset(task, 0, sizeof(*task));
+
+    task->stack_size = TASK_STACK_SIZE;
+    task->stack = (uint8_t*) pmm_allocate(TASK_STACK_SIZE / SYS_PAGE_SIZE, PFT_ALLOCATED);
+    if (task->stack == nullptr)
+    {
+        heap_free(task);
+        return nullptr;
+    }
+
+    strncpy(task->name, name, TASK_MAX_NAME);
+    task->id = __atomic_add_fetch(&task_counter, 1, __ATOMIC_RELAXED);
+    task->state = TASK_BLOCKED;
+    task->priority = priority;
+    task->core = core;
+    task->entry = entry;
+    task->arg = arg;
+
+    // initial context: 'eret' jumps to 'task_trampoline(task)'
+    struct task_context *context = (struct task_context*) (task->stack + task->stack_size - sizeof(struct task_context));
+    memset(context, 0, sizeof(*context));
+    context->x[0] = (uint64_t) (uintptr_t) task;
+    context->elr = (uint64_t) (uintptr_t) task_trampoline;
+    context->spsr = TASK_INITIAL_SPSR;
+    task->context = context;
+
+    return task;
+}
+
+/*
+ * Release the resources of the tasks terminated in the current core. This can
+ * not be done in 'task_exit', nor by another core, because 'task_schedule'
+ * runs on the stack of the terminated task until the switch is complete.
+ */
+void task_reap()
 {
+    struct task_core &core = cores[smp_core_id()];
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    struct task *dead = core.dead;
+    core.dead = nullptr;
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    while (dead)
+    {
+        struct task *next = dead->next;
+        task_remove_list(dead);
+        pmm_free((uintptr_t) dead->stack, dead->stack_size / SYS_PAGE_SIZE);
+        heap_free(dead);
+        dead = next;
+    }
 }
 
 /*
- *	This is the TICK interrupt service routine, note. no SAVE/RESTORE_CONTEXT here
- *	as thats done in the bottom-half of the ISR in assembler.
+ * Save the context of the current task and select the next one. Called by
+ * 'exception.S' with IRQs masked.
  */
-extern "C" void kernel_tick_isr(void)
+extern "C" struct task_context *task_schedule( struct task_context *frame )
+{
+    struct task_core &core = cores[smp_core_id()];
+    struct task *prev = core.current;
+    if (prev == nullptr) return frame;
+    prev->context = frame;
+
+    // a context switch is never done inside an RCU read-side section
+    rcu_quiescent();
+
+    spin_lock_raw(&core.lock);
+    core.need_resched = false;
+    if (prev->state == TASK_RUNNING)
+    {
+        prev->state = TASK_READY;
+        if (prev != core.idle) task_enqueue(core, prev);
+    }
+    else
+    if (prev->state == TASK_DEAD)
+    {
+        prev->next = core.dead;
+        core.dead = prev;
+    }
+
+    struct task *next = task_dequeue(core);
+    if (next == nullptr) next = core.idle;
+    next->state = TASK_RUNNING;
+    spin_unlock_raw(&core.lock);
+
+    next->slice = TASK_SLICE[next->priority];
+    if (next != prev)
+    {
+        ++core.switches;
+        ++next->switches;
+    }
+    core.current = next;
+
+    // the idle task needs no time slice: wake ups reschedule directly
+    if (next == core.idle)
+        timer_cancel(&core.tick);
+    else
+    {
+        // an IRQ taken by the sleeping idle loop may switch to another task
+        rcu_idle_exit();
+        if (!timer_pending(&core.tick))
+            timer_schedule(&core.tick, 1000000 / TASK_TICK_HZ, 1000000 / TASK_TICK_HZ);
+    }
+
+    return next->context;
+}
+
+/*
+ * Handler of the scheduler tick.
+ */
+static void task_tick( struct timer_event * /* event */ )
+{
+    struct task_core &core = cores[smp_core_id()];
+    ++core.ticks;
+
+    // the interrupted context is not inside an RCU read-side section
+    if (core.preempt_count == 0) rcu_quiescent();
+
+    struct task *current = core.current;
+    if (current == nullptr) return;
+    ++current->ticks;
+
+    spin_lock_raw(&core.lock);
+    if (current == core.idle)
+    {
+        if (task_has_ready(core, TASK_PRIORITIES - 1)) core.need_resched = true;
+    }
+    else
+    if (current->slice > 0 && --current->slice == 0)
+    {
+        // keep running if nobody else with the same priority is waiting
+        if (task_has_ready(core, current->priority))
+            core.need_resched = true;
+        else
+            current->slice = TASK_SLICE[current->priority];
+    }
+    spin_unlock_raw(&core.lock);
+}
+
+struct task_context *task_irq_exit( struct task_context *frame )
+{
+    struct task_core &core = cores[smp_core_id()];
+    if (!core.need_resched || core.preempt_count > 0) return frame;
+    ++core.preemptions;
+    return task_schedule(frame);
+}
+
+static void task_ipi_reschedule( uint32_t /* type */ )
+{
+    // the switch happens in the exit path of the IRQ
+    cores[smp_core_id()].need_resched = true;
+}
+
+int task_initialize()
+{
+    memset(cores, 0, sizeof(cores));
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        cores[i].tick.func = task_tick;
+    smp_ipi_register(IPI_RESCHEDULE, task_ipi_reschedule);
+    uart_print(LOG_TITLE "Scheduler tick at %d Hz\n", TASK_TICK_HZ);
+    return EOK;
+}
+
+int task_start()
+{
+    uint32_t id = smp_core_id();
+    struct task_core &core = cores[id];
+    if (core.current) return EEXIST;
+
+    struct task *boot = &core.boot;
+    memset(boot, 0, sizeof(*boot));
+    boot->id = __atomic_add_fetch(&task_counter, 1, __ATOMIC_RELAXED);
+    boot->state = TASK_RUNNING;
+    boot->core = id;
+
+    if (id == 0)
+    {
+        // the boot context of the core 0 runs the kernel initialization and
+        // can not be the idle task
+        strcpy(boot->name, "main");
+        boot->priority = TASK_PRIO_NORMAL;
+
+        struct task *idle = task_allocate("idle/0", task_idle, nullptr, TASK_PRIO_LOW, id);
+        if (idle == nullptr) return EMEMORY;
+        idle->state = TASK_READY;
+        core.idle = idle;
+        task_add_list(idle);
+    }
+    else
+    {
+        snprintf(boot->name, sizeof(boot->name), "idle/%d", id);
+        boot->priority = TASK_PRIO_LOW;
+        core.idle = boot;
+    }
+    boot->slice = TASK_SLICE[boot->priority];
+    task_add_list(boot);
+    core.current = boot;
+    rcu_online();
+
+    timer_enable();
+    if (boot != core.idle)
+        timer_schedule(&core.tick, 1000000 / TASK_TICK_HZ, 1000000 / TASK_TICK_HZ);
+
+    sync_enableInterrupts();
+    return EOK;
+}
+
+int task_create(
+    const char *name,
+    task_entry_t entry,
+    void *arg,
+    uint32_t priority,
+    int core,
+    struct task **task )
+{
+    if (name == nullptr || entry == nullptr || priority >= TASK_PRIORITIES) return EARGUMENT;
+    if (core >= (int) SYS_CPU_CORES) return EARGUMENT;
+    if (strlen(name) > TASK_MAX_NAME) return ETOOLONG;
+
+    struct task *tmp = task_allocate(name, entry, arg, priority, (core < 0) ? smp_core_id() : (uint32_t) core);
+    if (tmp == nullptr) return EMEMORY;
+    task_add_list(tmp);
+    if (task) *task = tmp;
+
+    task_wake(tmp);
+    return EOK;
+}
+
+struct task *task_current()
+{
+    return cores[smp_core_id()].current;
+}
+
+void task_yield()
+{
+    struct task_core &core = cores[smp_core_id()];
+    if (core.current == nullptr || irq_context()) return;
+    arch_task_yield();
+}
+
+void task_preempt_disable()
+{
+    // tasks never change core, so the counter stays the one of this core
+    ++cores[smp_core_id()].preempt_count;
+}
+
+void task_preempt_enable()
+{
+    struct task_core &core = cores[smp_core_id()];
+    if (--core.preempt_count > 0 || !core.need_resched) return;
+
+    // with IRQs masked the caller may hold other locks: the switch then
+    // happens in the exit path of the next IRQ
+    uint64_t daif;
+    __asm__ volatile ("mrs %0, daif" : "=r" (daif));
+    if ((daif & TASK_DAIF_IRQ) == 0) task_yield();
+}
+
+bool task_preemptible()
+{
+    uint64_t daif;
+    __asm__ volatile ("mrs %0, daif" : "=r" (daif));
+    if ((daif & TASK_DAIF_IRQ) != 0 || irq_context()) return false;
+    return cores[smp_core_id()].preempt_count == 0;
+}
+
+void task_prepare_block()
+{
+    struct task_core &core = cores[smp_core_id()];
+    struct task *current = core.current;
+    if (current == nullptr || current == core.idle) return;
+
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    // a previous wake up may have left the task in the run queue
+    if (current->state == TASK_READY) task_unqueue(core, current);
+    current->state = TASK_BLOCKED;
+    spin_unlock_irqrestore(&core.lock, flags);
+}
+
+void task_cancel_block()
+{
+    struct task_core &core = cores[smp_core_id()];
+    struct task *current = core.current;
+    if (current == nullptr) return;
+
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    if (current->state == TASK_READY) task_unqueue(core, current);
+    current->state = TASK_RUNNING;
+    spin_unlock_irqrestore(&core.lock, flags);
+}
+
+void task_block()
+{
+    task_yield();
+}
+
+static void task_sleep_timer( struct timer_event *event )
+{
+    task_wake((struct task*) event->arg);
+}
+
+int task_sleep( uint64_t us )
+{
+    struct task_core &core = cores[smp_core_id()];
+    struct task *current = core.current;
+    if (current == nullptr || current == core.idle || irq_context() || core.preempt_count > 0) return EINVALID;
+
+    // the event runs in this core, so it can not fire while we are running
+    struct timer_event event = TIMER_EVENT_INITIALIZER(task_sleep_timer, current);
+    int result = timer_schedule(&event, us, 0);
+    if (result != EOK) return result;
+
+    // other wake ups are ignored
+    while (timer_pending(&event))
+    {
+        task_prepare_block();
+        if (!timer_pending(&event))
+        {
+            task_cancel_block();
+            break;
+        }
+        task_block();
+    }
+    return EOK;
+}
+
+void task_wake( struct task *task )
+{
+    if (task == nullptr) return;
+
+    struct task_core &core = cores[task->core];
+    bool preempt = false;
+    bool remote = false;
+
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    if (task->state == TASK_BLOCKED)
+    {
+        task->state = TASK_READY;
+        task_enqueue(core, task);
+
+        struct task *current = core.current;
+        if (current == nullptr || current == core.idle || task->priority < current->priority)
+        {
+            core.need_resched = true;
+            preempt = (task->core == smp_core_id());
+            remote = !preempt;
+        }
+    }
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    // switch immediately to a more urgent task of the current core, unless
+    // the caller masked IRQs (it may hold a spin lock): the switch then
+    // happens in the exit path of the next IRQ
+    if (preempt && (flags & TASK_DAIF_IRQ) == 0 && cores[smp_core_id()].preempt_count == 0) task_yield();
+    // other cores are interrupted instead of waiting for the next tick
+    if (remote) smp_ipi_send(task->core, IPI_RESCHEDULE, false);
+}
+
+void task_exit()
+{
+    struct task_core &core = cores[smp_core_id()];
+    struct task *current = core.current;
+
+    uint64_t flags = spin_lock_irqsave(&core.lock);
+    if (current->state == TASK_READY) task_unqueue(core, current);
+    current->state = TASK_DEAD;
+    spin_unlock_irqrestore(&core.lock, flags);
+
+    arch_task_yield();
+    while (true);
+}
+
+static int proc_tasks( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "ID    Core  Prio  State     Switches    Ticks       Name\n");
+    sncatprintf(p, ps, "----  ----  ----  --------  ----------  ----------  -----------------------\n");
+
+    uint64_t flags = spin_lock_irqsave(&task_list_lock);
+    for (struct task *task = task_list; task; task = task->all_next)
+    {
+        sncatprintf(p, ps, "%-4d  %-4d  %-4d  %-8s  %-10lu  %-10lu  %s\n",
+            task->id,
+            task->core,
+            task->priority,
+            STATE_NAMES[task->state],
+            task->switches,
+            task->ticks,
+            task->name);
+    }
+    spin_unlock_irqrestore(&task_list_lock, flags);
+
+    sncatprintf(p, ps, "\nCore  Ticks       Switches    Preemptions\n");
+    sncatprintf(p, ps, "----  ----------  ----------  -----------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        sncatprintf(p, ps, "%-4d  %-10lu  %-10lu  %-10lu\n",
+            i,
+            cores[i].ticks,
+            cores[i].switches,
+            cores[i].preemptions);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void task_register()
 {
+    procfs_register("/tasks", proc_tasks, nullptr);
 }
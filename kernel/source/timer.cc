@@ -1,29 +1,559 @@
+/*
+ * Timers.
+ *
+ * The monotonic clock reads the virtual counter of the generic timer (the
+ * system timer of the SoC is the fallback when the counter frequency is not
+ * set), converting cycles to nanoseconds with a multiplication and a shift.
+ * Timer events live in a hierarchical timing wheel per core, driven by the
+ * non-secure physical timer (CNTP) of the core: the comparator is programmed
+ * with the earliest pending expiration only, so idle cores sleep until the
+ * next event instead of waking up on every tick.
+ *
+ * The wheel does not cascade: each level is 8 times coarser than the previous
+ * one and events are placed in the level that covers their expiration,
+ * rounded up to the granularity of the level. An event never expires early;
+ * the error grows with the distance to the expiration (up to 1/8).
+ */
+
 #include <sys/timer.hh>
+#include <sys/smp.h>
+#include <sys/task.h>
+#include <sys/wait.h>
+#include <sys/irq.h>
 #include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<timer> "
+
+/*
+ * Wheel geometry: 5 levels of 64 slots, which covers 258 seconds at 1000 Hz.
+ * Events further away are parked in the last slot reachable and placed again
+ * when it expires.
+ */
+#define WHEEL_LEVELS      5
+#define WHEEL_SLOT_BITS   6
+#define WHEEL_SLOTS       (1U << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_CLK_SHIFT   3
+#define WHEEL_CLK_MASK    ((1U << WHEEL_CLK_SHIFT) - 1)
+
+#define WHEEL_SHIFT(l)    ((l) * WHEEL_CLK_SHIFT)
+#define WHEEL_GRAN(l)     (1ULL << WHEEL_SHIFT(l))
+#define WHEEL_START(l)    ((uint64_t) (WHEEL_SLOTS - 1) << WHEEL_SHIFT((l) - 1))
+#define WHEEL_CUTOFF      WHEEL_START(WHEEL_LEVELS)
+#define WHEEL_MAX         (WHEEL_CUTOFF - WHEEL_GRAN(WHEEL_LEVELS - 1))
+
+#define WHEEL_NONE        (~0ULL)
+
+/*
+ * 'slot' of the events collected by 'timer_interrupt' and not processed yet.
+ */
+#define WHEEL_EXPIRED     (~0U)
+
+/*
+ * Shift of the conversion from clock source cycles to nanoseconds.
+ */
+#define CLOCK_SHIFT       32
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+struct timer_stats
+{
+    uint32_t pending;
+    uint64_t scheduled;
+    uint64_t expired;
+    uint64_t cancelled;
+    uint64_t interrupts;
+    /**
+     * Time (in microseconds) between the expiration and the callback.
+     */
+    uint64_t total_latency;
+    uint64_t max_latency;
+};
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) timer_wheel
+{
+    spinlock_t lock;
+    /**
+     * Wheel ticks processed so far: every pending slot expires at or after it.
+     */
+    uint64_t clk;
+    /**
+     * Wheel tick programmed in the comparator (WHEEL_NONE if stopped).
+     */
+    uint64_t programmed;
+    uint64_t pending[WHEEL_LEVELS];
+    struct timer_event *slots[WHEEL_LEVELS * WHEEL_SLOTS];
+    /**
+     * Events due at the current wheel tick: the lock is dropped around each
+     * callback, so the others may be cancelled or rescheduled meanwhile.
+     */
+    struct timer_event *expired;
+    struct timer_stats stats;
+};
+
+static struct timer_wheel wheels[SYS_CPU_CORES];
+
+/*
+ * Generic timer frequency and counter ticks per wheel tick.
+ */
+static uint64_t timer_frequency = 0;
+static uint64_t timer_resolution = 0;
 
 
 void st_initialize();
 uint64_t st_tick();
 void st_update( uint32_t cycles );
 
+static uint64_t arch_clock_read();
+
+static struct timer_t system_clock = { "systimer", st_tick, 1000000, 1000ULL << CLOCK_SHIFT, CLOCK_SHIFT, 100 };
+static struct timer_t arch_clock = { "cntvct", arch_clock_read, 0, 0, 0, 300 };
+
+/*
+ * Current clock source. The monotonic clock is 'clock_offset' plus the time
+ * elapsed since the clock source read 'clock_base'.
+ */
+static struct timer_t *clock = &system_clock;
+static uint64_t clock_base = 0;
+static uint64_t clock_offset = 0;
+
+
+static void timer_interrupt( uint32_t irq, void *data );
+
+
+static inline uint64_t arch_timer_frequency()
+{
+    uint64_t value;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r" (value));
+    return value;
+}
+
+static uint64_t arch_clock_read()
+{
+    uint64_t value;
+    __asm__ volatile ("isb; mrs %0, cntvct_el0" : "=r" (value) :: "memory");
+    return value;
+}
+
+static inline uint64_t arch_timer_counter()
+{
+    uint64_t value;
+    __asm__ volatile ("isb; mrs %0, cntpct_el0" : "=r" (value) :: "memory");
+    return value;
+}
+
+static inline void arch_timer_program( uint64_t cval )
+{
+    __asm__ volatile ("msr cntp_cval_el0, %0" :: "r" (cval));
+    __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r" ((uint64_t) 1));
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+static inline void arch_timer_stop()
+{
+    __asm__ volatile ("msr cntp_ctl_el0, %0" :: "r" ((uint64_t) 0));
+    __asm__ volatile ("isb" ::: "memory");
+}
+
 
 void timer_initialize()
 {
 	st_initialize();
 	st_update(100000);
+
+    timer_register_clock(system_clock);
+    arch_clock.frequency = arch_timer_frequency();
+    if (arch_clock.frequency) timer_register_clock(arch_clock);
+
+    memset(wheels, 0, sizeof(wheels));
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        wheels[i].programmed = WHEEL_NONE;
+
+    timer_frequency = arch_timer_frequency();
+    timer_resolution = timer_frequency / TIMER_WHEEL_HZ;
+    if (timer_resolution == 0)
+    {
+        // CNTFRQ not set by the firmware: no timer events
+        uart_print(LOG_TITLE "Generic timer frequency not set, timer events disabled\n");
+    }
+    else
+    {
+        // each core serves its own wheel (see 'timer_enable')
+        irq_attach(IRQ_LOCAL_CNTPNS, "timer", timer_interrupt, nullptr);
+    }
+    uart_print(LOG_TITLE "Clock source '%s' at %lu Hz\n", clock->name, clock->frequency);
+    uart_print(LOG_TITLE "Timer wheel at %d Hz (%lu Hz counter)\n", TIMER_WHEEL_HZ, timer_frequency);
+}
+
+
+void timer_register_clock( struct timer_t &timer )
+{
+    if (timer.now == nullptr || timer.frequency == 0) return;
+
+    // round to nearest; the error is below 1 ppb for any counter above 1 kHz
+    timer.shift = CLOCK_SHIFT;
+    timer.mult = ((1000000000ULL << CLOCK_SHIFT) + timer.frequency / 2) / timer.frequency;
+
+    if (&timer != clock && timer.rating <= clock->rating) return;
+    uint64_t offset = timer_ns();
+    clock_base = timer.now();
+    clock_offset = offset;
+    clock = &timer;
+}
+
+
+uint64_t timer_cycles()
+{
+    return clock->now();
+}
+
+
+uint64_t timer_cycles_to_ns( uint64_t cycles )
+{
+    return (uint64_t) (((uint128_t) cycles * clock->mult) >> clock->shift);
+}
+
+
+uint64_t timer_ns()
+{
+    return clock_offset + timer_cycles_to_ns(clock->now() - clock_base);
 }
 
 
 uint64_t timer_tick()
 {
-	return st_tick();
+	return timer_ns() / 1000;
 }
 
 
 void timer_wait( uint64_t micro )
 {
-    micro += st_tick();
-    while (st_tick() < micro);
+    uint64_t deadline = timer_tick() + micro;
+    // long waits give the core to other tasks
+    if (micro >= 1000000 / TIMER_WHEEL_HZ && task_sleep(micro) == EOK) return;
+    while (timer_tick() < deadline) wait_relax();
+}
+
+static uint64_t timer_us_to_counter( uint64_t us )
+{
+    return (us / 1000000) * timer_frequency + (us % 1000000) * timer_frequency / 1000000;
 }
 
+static uint64_t timer_counter_to_us( uint64_t counter )
+{
+    return (counter / timer_frequency) * 1000000 + (counter % timer_frequency) * 1000000 / timer_frequency;
+}
+
+/*
+ * Returns the wheel slot of an event expiring at @c expires and the wheel
+ * tick in which that slot expires.
+ */
+static uint32_t timer_slot( const struct timer_wheel &wheel, uint64_t expires, uint64_t &bucket )
+{
+    if (expires < wheel.clk) expires = wheel.clk;
+    uint64_t delta = expires - wheel.clk;
+
+    if (delta < WHEEL_START(1))
+    {
+        bucket = expires;
+        return (uint32_t) (expires & WHEEL_SLOT_MASK);
+    }
+
+    uint32_t level = 1;
+    if (delta >= WHEEL_CUTOFF)
+    {
+        expires = wheel.clk + WHEEL_MAX;
+        level = WHEEL_LEVELS - 1;
+    }
+    else
+    {
+        while (delta >= WHEEL_START(level + 1)) ++level;
+    }
+
+    // round up, so the event never expires early
+    uint64_t index = (expires >> WHEEL_SHIFT(level)) + 1;
+    bucket = index << WHEEL_SHIFT(level);
+    return level * WHEEL_SLOTS + (uint32_t) (index & WHEEL_SLOT_MASK);
+}
 
+/*
+ * Returns the wheel tick of the earliest pending slot (WHEEL_NONE if the
+ * wheel is empty).
+ */
+static uint64_t timer_next_expiry( const struct timer_wheel &wheel )
+{
+    uint64_t next = WHEEL_NONE;
+    for (uint32_t level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        uint64_t bits = wheel.pending[level];
+        if (bits == 0) continue;
+
+        // first slot of the level not yet processed
+        uint64_t clk = (wheel.clk + WHEEL_GRAN(level) - 1) >> WHEEL_SHIFT(level);
+        uint32_t start = (uint32_t) (clk & WHEEL_SLOT_MASK);
+        if (start) bits = (bits >> start) | (bits << (WHEEL_SLOTS - start));
+
+        uint64_t bucket = (clk + (uint64_t) __builtin_ctzll(bits)) << WHEEL_SHIFT(level);
+        if (bucket < next) next = bucket;
+    }
+    return next;
+}
+
+static void timer_insert( struct timer_wheel &wheel, struct timer_event *event )
+{
+    uint64_t bucket;
+    uint32_t slot = timer_slot(wheel, event->expires, bucket);
+
+    event->prev = nullptr;
+    event->next = wheel.slots[slot];
+    if (event->next) event->next->prev = event;
+    wheel.slots[slot] = event;
+    wheel.pending[slot / WHEEL_SLOTS] |= 1ULL << (slot % WHEEL_SLOTS);
+    event->slot = slot + 1;
+}
+
+static void timer_unlink( struct timer_wheel &wheel, struct timer_event *event )
+{
+    struct timer_event **head = (event->slot == WHEEL_EXPIRED) ? &wheel.expired : &wheel.slots[event->slot - 1];
+    if (event->prev)
+        event->prev->next = event->next;
+    else
+        *head = event->next;
+    if (event->next) event->next->prev = event->prev;
+    if (event->slot != WHEEL_EXPIRED && *head == nullptr)
+    {
+        uint32_t slot = event->slot - 1;
+        wheel.pending[slot / WHEEL_SLOTS] &= ~(1ULL << (slot % WHEEL_SLOTS));
+    }
+
+    event->next = event->prev = nullptr;
+    event->slot = 0;
+}
+
+/*
+ * Program the comparator of the current core with the earliest expiration.
+ */
+static void timer_program( struct timer_wheel &wheel )
+{
+    uint64_t next = timer_next_expiry(wheel);
+    if (next == wheel.programmed) return;
+    wheel.programmed = next;
+    if (next == WHEEL_NONE)
+        arch_timer_stop();
+    else
+        arch_timer_program(next * timer_resolution);
+}
+
+/*
+ * Move the wheel forward when nothing expires until @c now, so new events are
+ * placed with the best granularity possible.
+ */
+static void timer_forward( struct timer_wheel &wheel, uint64_t now )
+{
+    if (now > wheel.clk && timer_next_expiry(wheel) > now) wheel.clk = now;
+}
+
+/*
+ * Move the events of every slot expiring at the current wheel tick to the
+ * expired list.
+ */
+static void timer_collect( struct timer_wheel &wheel )
+{
+    uint64_t clk = wheel.clk;
+    for (uint32_t level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        uint32_t index = (uint32_t) (clk & WHEEL_SLOT_MASK);
+        uint32_t slot = level * WHEEL_SLOTS + index;
+        struct timer_event *event = wheel.slots[slot];
+        wheel.slots[slot] = nullptr;
+        wheel.pending[level] &= ~(1ULL << index);
+
+        while (event)
+        {
+            struct timer_event *next = event->next;
+            event->prev = nullptr;
+            event->next = wheel.expired;
+            if (wheel.expired) wheel.expired->prev = event;
+            wheel.expired = event;
+            event->slot = WHEEL_EXPIRED;
+            event = next;
+        }
+
+        // coarser levels are only due when the clock is aligned to them
+        if (clk & WHEEL_CLK_MASK) break;
+        clk >>= WHEEL_CLK_SHIFT;
+    }
+}
+
+static void timer_interrupt( uint32_t /* irq */, void * /* data */ )
+{
+    if (timer_resolution == 0) return;
+    struct timer_wheel &wheel = wheels[smp_core_id()];
+
+    spin_lock(&wheel.lock);
+    ++wheel.stats.interrupts;
+    // the comparator is programmed again below
+    wheel.programmed = WHEEL_NONE;
+
+    uint64_t counter = arch_timer_counter();
+    uint64_t now = counter / timer_resolution;
+    while (true)
+    {
+        uint64_t next = timer_next_expiry(wheel);
+        if (next > now) break;
+        wheel.clk = next;
+
+        timer_collect(wheel);
+        while (wheel.expired)
+        {
+            struct timer_event *event = wheel.expired;
+            timer_unlink(wheel, event);
+
+            if (event->expires > wheel.clk)
+            {
+                // parked in the last level: not due yet
+                timer_insert(wheel, event);
+                continue;
+            }
+
+            uint64_t latency = timer_counter_to_us(counter - event->deadline);
+            ++wheel.stats.expired;
+            wheel.stats.total_latency += latency;
+            if (latency > wheel.stats.max_latency) wheel.stats.max_latency = latency;
+
+            if (event->period)
+            {
+                // keep the phase of periodic events, skipping missed periods
+                event->deadline += ((counter - event->deadline) / event->period + 1) * event->period;
+                event->expires = (event->deadline + timer_resolution - 1) / timer_resolution;
+                timer_insert(wheel, event);
+            }
+            else
+                --wheel.stats.pending;
+
+            // the callback may schedule or cancel events of this wheel
+            spin_unlock(&wheel.lock);
+            event->func(event);
+            spin_lock(&wheel.lock);
+        }
+    }
+    wheel.clk = now;
+
+    timer_program(wheel);
+    spin_unlock(&wheel.lock);
+}
+
+void timer_enable()
+{
+    if (timer_resolution == 0) return;
+    struct timer_wheel &wheel = wheels[smp_core_id()];
+
+    uint64_t flags = spin_lock_irqsave(&wheel.lock);
+    wheel.clk = arch_timer_counter() / timer_resolution;
+    wheel.programmed = WHEEL_NONE;
+    arch_timer_stop();
+    spin_unlock_irqrestore(&wheel.lock, flags);
+
+    irq_enable(IRQ_LOCAL_CNTPNS);
+}
+
+static bool timer_remove( struct timer_event *event )
+{
+    struct timer_wheel &wheel = wheels[event->core];
+
+    uint64_t flags = spin_lock_irqsave(&wheel.lock);
+    bool pending = event->slot != 0;
+    if (pending)
+    {
+        timer_unlink(wheel, event);
+        --wheel.stats.pending;
+        ++wheel.stats.cancelled;
+        // the comparator is left as is: an early interrupt is harmless
+    }
+    spin_unlock_irqrestore(&wheel.lock, flags);
+    return pending;
+}
+
+int timer_schedule( struct timer_event *event, uint64_t delay_us, uint64_t period_us )
+{
+    if (event == nullptr || event->func == nullptr) return EARGUMENT;
+    if (timer_resolution == 0) return EINVALID;
+
+    if (event->slot) timer_remove(event);
+
+    uint32_t id = smp_core_id();
+    struct timer_wheel &wheel = wheels[id];
+
+    uint64_t flags = spin_lock_irqsave(&wheel.lock);
+    uint64_t counter = arch_timer_counter();
+    event->core = id;
+    event->deadline = counter + timer_us_to_counter(delay_us);
+    event->period = timer_us_to_counter(period_us);
+    if (period_us && event->period == 0) event->period = 1;
+    event->expires = (event->deadline + timer_resolution - 1) / timer_resolution;
+
+    timer_forward(wheel, counter / timer_resolution);
+    timer_insert(wheel, event);
+    ++wheel.stats.pending;
+    ++wheel.stats.scheduled;
+
+    uint64_t next = timer_next_expiry(wheel);
+    if (next < wheel.programmed)
+    {
+        wheel.programmed = next;
+        arch_timer_program(next * timer_resolution);
+    }
+    spin_unlock_irqrestore(&wheel.lock, flags);
+    return EOK;
+}
+
+int timer_cancel( struct timer_event *event )
+{
+    if (event == nullptr) return EARGUMENT;
+    return timer_remove(event) ? EOK : ENOENT;
+}
+
+bool timer_pending( const struct timer_event *event )
+{
+    return event != nullptr && __atomic_load_n(&event->slot, __ATOMIC_RELAXED) != 0;
+}
+
+static int proc_timers( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Clock source: %s (%lu Hz, mult %lu, shift %d)\n", clock->name, clock->frequency, clock->mult, clock->shift);
+    sncatprintf(p, ps, "   Monotonic: %lu ns\n\n", timer_ns());
+
+    sncatprintf(p, ps, "Core  Pending  Scheduled   Expired     Cancelled   IRQs        Avg (us)  Max (us)\n");
+    sncatprintf(p, ps, "----  -------  ----------  ----------  ----------  ----------  --------  --------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        const struct timer_stats &stats = wheels[i].stats;
+        sncatprintf(p, ps, "%-4d  %-7d  %-10lu  %-10lu  %-10lu  %-10lu  %-8lu  %-8lu\n",
+            i,
+            stats.pending,
+            stats.scheduled,
+            stats.expired,
+            stats.cancelled,
+            stats.interrupts,
+            (stats.expired > 0) ? stats.total_latency / stats.expired : 0,
+            stats.max_latency);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void timer_register()
+{
+    procfs_register("/timers", proc_timers, nullptr);
+}
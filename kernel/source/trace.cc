@@ -0,0 +1,261 @@
+/*
+ * Static tracepoints (see 'sys/trace.hh').
+ *
+ * The sites of disabled tracepoints are NOPs. Enabling a tracepoint replaces
+ * them with a 'b' to the tracing code; both are single instructions the
+ * architecture allows to be modified while other cores execute them, so the
+ * only requirement is to invalidate the instruction cache and make every core
+ * synchronize its instruction stream (any exception return does it).
+ *
+ * Each core writes its records to its own ring. A record is reserved with an
+ * atomic add on the head, overwriting the oldest one (IRQ handlers may trace
+ * while the interrupted code is tracing too), and published by writing its
+ * sequence number; readers copy records and check the sequence number again
+ * to detect concurrent overwrites.
+ */
+
+#include <sys/trace.hh>
+#include <sys/smp.h>
+#include <sys/cache.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/timer.hh>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define INSN_NOP        0xD503201FU
+#define INSN_B          0x14000000U
+
+#define TRACE_MASK      (TRACE_RECORDS - 1)
+
+// from 'kernel.ld'
+extern "C" struct trace_point __begin_trace_points[];
+extern "C" struct trace_point __end_trace_points[];
+extern "C" struct trace_site __begin_trace_sites[];
+extern "C" struct trace_site __end_trace_sites[];
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) trace_ring
+{
+    volatile uint64_t head;
+    struct trace_record records[TRACE_RECORDS];
+};
+
+static struct trace_ring trace_rings[SYS_CPU_CORES];
+
+/*
+ * Serializes patching.
+ */
+static spinlock_t trace_lock = SPINLOCK_INITIALIZER;
+
+void trace_write( struct trace_point *point, const uint64_t *args, uint32_t count )
+{
+    __atomic_add_fetch(&point->hits, 1, __ATOMIC_RELAXED);
+
+    uint32_t id = smp_core_id();
+    struct trace_ring &ring = trace_rings[id];
+
+    uint64_t index = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+    struct trace_record *record = &ring.records[index & TRACE_MASK];
+    __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (count > KLOG_MAX_ARGS) count = KLOG_MAX_ARGS;
+    record->format = point->format;
+    record->timestamp = timer_cycles();
+    record->level = KLOG_LEVEL_TRACE;
+    record->core = (uint8_t) id;
+    record->count = (uint8_t) count;
+    for (uint32_t i = 0; i < count; ++i) record->args[i] = args[i];
+
+    __atomic_store_n(&record->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+static void trace_patch( uint64_t code, uint32_t insn )
+{
+    volatile uint32_t *address = (volatile uint32_t*) (uintptr_t) code;
+    *address = insn;
+    // make the new instruction visible to instruction fetches
+    cache_sync_instructions((const void*) address, sizeof(insn));
+}
+
+int trace_set( const char *name, bool enable )
+{
+    if (name == nullptr) return EARGUMENT;
+    bool all = strcmp(name, "all") == 0;
+    uint32_t changed = 0;
+
+    uint64_t flags = spin_lock_irqsave(&trace_lock);
+    for (struct trace_point *point = __begin_trace_points; point < __end_trace_points; ++point)
+    {
+        if (!all && strcmp(point->name, name) != 0) continue;
+        point->enabled = enable;
+        ++changed;
+    }
+    for (struct trace_site *site = __begin_trace_sites; site < __end_trace_sites; ++site)
+    {
+        if (!all && strcmp(site->point->name, name) != 0) continue;
+        uint32_t insn = INSN_NOP;
+        if (enable)
+            insn = INSN_B | ((uint32_t) ((site->target - site->code) >> 2) & 0x3FFFFFFU);
+        trace_patch(site->code, insn);
+    }
+    __asm__ volatile ("isb" ::: "memory");
+    spin_unlock_irqrestore(&trace_lock, flags);
+
+    if (changed == 0) return ENOENT;
+    // the IPI entry and exit synchronize the instruction stream of the others
+    smp_ipi_broadcast(IPI_CACHE_DRAIN, true);
+    return EOK;
+}
+
+static bool trace_copy( const struct trace_ring &ring, uint64_t index, struct trace_record &copy )
+{
+    const struct trace_record *record = &ring.records[index & TRACE_MASK];
+    if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != index + 1) return false;
+    memcpy(&copy, (const void*) record, sizeof(copy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&record->seq, __ATOMIC_RELAXED) == index + 1;
+}
+
+static void trace_print_record( char *p, size_t ps, const struct trace_record &record )
+{
+    uint64_t us = timer_cycles_to_ns(record.timestamp) / 1000;
+    sncatprintf(p, ps, "[%5lu.%06lu] %d ", us / 1000000, us % 1000000, record.core);
+    size_t len = strlen(p);
+    len += klog_format(p + len, ps - len, record.format, record.args, record.count);
+    if (len > 0 && p[len - 1] != '\n') sncatprintf(p, ps, "\n");
+}
+
+/*
+ * Print the newest records that fit in the buffer, merged by timestamp.
+ */
+static int proc_trace( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    uint64_t cursor[SYS_CPU_CORES];
+    uint64_t first[SYS_CPU_CORES];
+    uint64_t end[SYS_CPU_CORES];
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        end[i] = cursor[i] = __atomic_load_n(&trace_rings[i].head, __ATOMIC_ACQUIRE);
+        first[i] = (end[i] > TRACE_RECORDS) ? end[i] - TRACE_RECORDS : 0;
+    }
+
+    // walk back from the newest records to find what fits in the buffer
+    char line[256];
+    size_t used = 0;
+    while (true)
+    {
+        int32_t newest = -1;
+        struct trace_record copy, best;
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            while (cursor[i] > first[i] && !trace_copy(trace_rings[i], cursor[i] - 1, copy)) --cursor[i];
+            if (cursor[i] == first[i]) continue;
+            if (newest < 0 || copy.timestamp > best.timestamp)
+            {
+                newest = (int32_t) i;
+                best = copy;
+            }
+        }
+        if (newest < 0) break;
+
+        line[0] = 0;
+        trace_print_record(line, sizeof(line), best);
+        if (used + strlen(line) + 1 >= ps) break;
+        used += strlen(line);
+        --cursor[newest];
+    }
+
+    // and print them from the oldest
+    while (true)
+    {
+        int32_t oldest = -1;
+        struct trace_record copy, best;
+        for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+        {
+            while (cursor[i] < end[i] && !trace_copy(trace_rings[i], cursor[i], copy)) ++cursor[i];
+            if (cursor[i] == end[i]) continue;
+            if (oldest < 0 || copy.timestamp < best.timestamp)
+            {
+                oldest = (int32_t) i;
+                best = copy;
+            }
+        }
+        if (oldest < 0) break;
+        ++cursor[oldest];
+
+        line[0] = 0;
+        trace_print_record(line, sizeof(line), best);
+        if (strlen(p) + strlen(line) + 1 >= ps) break;
+        sncatprintf(p, ps, "%s", line);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+static int proc_tracepoints( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "State     Hits        Name\n");
+    sncatprintf(p, ps, "--------  ----------  -----------------------\n");
+    for (struct trace_point *point = __begin_trace_points; point < __end_trace_points; ++point)
+    {
+        sncatprintf(p, ps, "%-8s  %-10lu  %s\n",
+            point->enabled ? "enabled" : "disabled",
+            point->hits,
+            point->name);
+    }
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+/*
+ * Accepts lines with "enable <name>" or "disable <name>".
+ */
+static int proc_tracepoints_write( const uint8_t *buffer, int size, void * /* data */ )
+{
+    char line[64];
+    int result = EOK;
+    int start = 0;
+
+    for (int i = 0; i <= size; ++i)
+    {
+        if (i < size && buffer[i] != '\n') continue;
+
+        int length = i - start;
+        if (length > 0)
+        {
+            if (length >= (int) sizeof(line)) return ETOOLONG;
+            memcpy(line, buffer + start, (size_t) length);
+            line[length] = 0;
+
+            if (strncmp(line, "enable ", 7) == 0)
+                result = trace_set(line + 7, true);
+            else
+            if (strncmp(line, "disable ", 8) == 0)
+                result = trace_set(line + 8, false);
+            else
+                result = EARGUMENT;
+            if (result != EOK) return result;
+        }
+        start = i + 1;
+    }
+    return size;
+}
+
+void trace_register()
+{
+    procfs_register("/trace", proc_trace, nullptr);
+    procfs_register_rw("/tracepoints", proc_tracepoints, proc_tracepoints_write, nullptr);
+}
@@ -1,9 +1,87 @@
+/*
+ * PL011 driver.
+ *
+ * Until 'uart_start' is called, output is written directly to the FIFO.
+ * After that, transmission and reception are interrupt-driven: bytes are
+ * queued in ring buffers and moved to/from the FIFO by the IRQ handler, so
+ * callers only wait when the TX ring is full.
+ */
+
 #include <sys/uart.h>
 #include <sys/bcm2837.h>
 #include <sys/sysio.h>
+#include <sys/wait.h>
+#include <sys/sync.h>
+#include <sys/irq.h>
+#include <sys/cache.h>
+#include <sys/system.h>
+#include <sys/kmsg.h>
+#include <sys/procfs.h>
+#include <sys/errors.h>
 #include <mc/string.h>
 #include <mc/stdio.h>
 
+/*
+ * Ring sizes (must be powers of two).
+ */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE   4096
+#endif
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE   1024
+#endif
+
+/*
+ * FIFO levels for the interrupts (0 = 1/8, 1 = 1/4, 2 = 1/2, 3 = 3/4, 4 = 7/8).
+ * The TX interrupt fires when the FIFO drains below its level and the RX
+ * interrupt when the FIFO fills above its level.
+ */
+#ifndef UART_TX_FIFO_LEVEL
+#define UART_TX_FIFO_LEVEL    1
+#endif
+#ifndef UART_RX_FIFO_LEVEL
+#define UART_RX_FIFO_LEVEL    2
+#endif
+
+#define UART_IFLS_TX(x)       ((uint32_t) (x) & 0x7U)
+#define UART_IFLS_RX(x)       (((uint32_t) (x) & 0x7U) << 3)
+
+/* Bits of UART0_FR */
+#define UART_FR_BUSY          (1U << 3)
+#define UART_FR_RXFE          (1U << 4)
+#define UART_FR_TXFF          (1U << 5)
+
+/* Bits of UART0_IMSC, UART0_MIS and UART0_ICR */
+#define UART_INT_RX           (1U << 4)
+#define UART_INT_TX           (1U << 5)
+#define UART_INT_RT           (1U << 6)
+#define UART_INT_ERRORS       (0xFU << 7)
+
+struct uart_ring
+{
+    uint32_t head;
+    uint32_t tail;
+};
+
+struct uart_stats
+{
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint64_t rx_overruns;
+    uint64_t tx_stalls;
+    uint64_t interrupts;
+};
+
+static uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
+static uint8_t rx_buffer[UART_RX_BUFFER_SIZE];
+static struct uart_ring tx_ring;
+static struct uart_ring rx_ring;
+static struct uart_stats uart_stats;
+
+static spinlock_t uart_lock = SPINLOCK_INITIALIZER;
+
+static bool uart_irq_mode = false;
+
 static void DUMMY(uint32_t value )
 {
     (void) value;
@@ -15,8 +93,8 @@ static inline void busy_wait( int32_t cycles )
 		 : "=r"(cycles): [count]"0"(cycles) : "cc");
 }*/
 
-// mailbox message changing the clock rate of PL011 to 3MHz tag
-volatile unsigned int  __attribute__((aligned(16))) mbox[9] =
+// mailbox message changing the clock rate of PL011 to 3MHz tag (in a cache line of its own)
+volatile unsigned int  __attribute__((aligned(CACHE_LINE_SIZE))) mbox[CACHE_LINE_SIZE / 4] =
 {
     9*4, 0, 0x38002, 12, 8, 2, 3000000, 0 ,0
 };
@@ -44,6 +122,7 @@ void uart_init()
 	// Set it to 3Mhz so that we can consistently set the baud rate
     // UART_CLOCK = 30000000;
     uint32_t r = (((uint32_t)( (size_t) &mbox ) & (uint32_t)(~0xF)) | 8);
+    cache_clean_range((const void*) mbox, sizeof(mbox));
     // wait until we can talk to the VC
     while ( GET32(SOC_MAILBOX_POLL) & 0x80000000 ) { }
     // send our message to property channel and wait for the response
@@ -62,39 +141,213 @@ void uart_init()
     PUT32(UART0_FBRD,40);
     // enable FIFO & 8 bit data transmission (1 stop bit, no parity)
     PUT32(UART0_LCRH,0x70);
-    // mask all interrupts
-    PUT32(UART0_IMSC, (1 << 1) | (1 << 4) | (1 << 5) | (1 << 6) |
-	                  (1 << 7) | (1 << 8) | (1 << 9) | (1 << 10));
+    // FIFO levels that trigger the TX and RX interrupts
+    PUT32(UART0_IFLS, UART_IFLS_TX(UART_TX_FIFO_LEVEL) | UART_IFLS_RX(UART_RX_FIFO_LEVEL));
+    // mask all interrupts until 'uart_start' is called
+    PUT32(UART0_IMSC, 0);
     // enable UART0, receive & transfer part of UART
     PUT32(UART0_CR, (1 << 0) | (1 << 8) | (1 << 9));
 }
 
-void uart_putc( uint8_t c )
+/*
+ * Whether IRQs were masked in the DAIF value saved by 'spin_lock_irqsave'.
+ */
+static inline bool uart_irq_masked( uint64_t flags )
+{
+    return (flags & (1U << 7)) != 0;
+}
+
+static inline void uart_put_fifo( uint8_t c )
 {
-    while((GET32(UART0_FR) & 0x20) != 0);
+    while((GET32(UART0_FR) & UART_FR_TXFF) != 0) wait_relax();
     PUT32(UART0_DR,(uint32_t)c);
 }
 
+/*
+ * Move queued bytes to the FIFO while there is room. Must be called with
+ * 'uart_lock' held.
+ */
+static void uart_fill_fifo()
+{
+    while (tx_ring.head != tx_ring.tail && (GET32(UART0_FR) & UART_FR_TXFF) == 0)
+    {
+        PUT32(UART0_DR, (uint32_t) tx_buffer[tx_ring.tail & (UART_TX_BUFFER_SIZE - 1)]);
+        ++tx_ring.tail;
+    }
+}
+
+/*
+ * Write every queued byte to the FIFO, waiting for room. Must be called with
+ * 'uart_lock' held.
+ */
+static void uart_drain()
+{
+    while (tx_ring.head != tx_ring.tail)
+    {
+        uart_put_fifo(tx_buffer[tx_ring.tail & (UART_TX_BUFFER_SIZE - 1)]);
+        ++tx_ring.tail;
+    }
+}
+
+static size_t uart_send( const uint8_t *data, size_t count, bool block )
+{
+    uint64_t flags = spin_lock_irqsave(&uart_lock);
+    size_t sent = 0;
+
+    if (!uart_irq_mode)
+    {
+        for (; sent < count; ++sent) uart_put_fifo(data[sent]);
+    }
+    else
+    {
+        while (sent < count)
+        {
+            if (tx_ring.head - tx_ring.tail == UART_TX_BUFFER_SIZE)
+            {
+                if (!block) break;
+                // make room by writing the oldest bytes ourselves
+                ++uart_stats.tx_stalls;
+                while ((GET32(UART0_FR) & UART_FR_TXFF) != 0) wait_relax();
+                uart_fill_fifo();
+                continue;
+            }
+            tx_buffer[tx_ring.head & (UART_TX_BUFFER_SIZE - 1)] = data[sent++];
+            ++tx_ring.head;
+        }
+
+        // the TX interrupt only fires when the FIFO level crosses the
+        // threshold, so the first bytes must be written here
+        uart_fill_fifo();
+        // callers that had IRQs masked (e.g. panic) may never see the ring
+        // drain; the lock itself masks them, so test the saved state
+        if (uart_irq_masked(flags)) uart_drain();
+    }
+    uart_stats.tx_bytes += sent;
+
+    spin_unlock_irqrestore(&uart_lock, flags);
+    return sent;
+}
+
+static void uart_isr( uint32_t /* irq */, void * /* data */ )
+{
+    bool received = false;
+
+    spin_lock(&uart_lock);
+    ++uart_stats.interrupts;
+    uint32_t status = GET32(UART0_MIS);
+
+    if (status & (UART_INT_RX | UART_INT_RT))
+    {
+        while ((GET32(UART0_FR) & UART_FR_RXFE) == 0)
+        {
+            uint8_t c = (uint8_t) GET32(UART0_DR);
+            if (rx_ring.head - rx_ring.tail == UART_RX_BUFFER_SIZE)
+            {
+                ++uart_stats.rx_overruns;
+                continue;
+            }
+            rx_buffer[rx_ring.head & (UART_RX_BUFFER_SIZE - 1)] = c;
+            ++rx_ring.head;
+            ++uart_stats.rx_bytes;
+            received = true;
+        }
+    }
+    if (status & UART_INT_TX)
+    {
+        uart_fill_fifo();
+        // nothing left: acknowledge so the interrupt is not raised again
+        // until the next refill crosses the threshold
+        if (tx_ring.head == tx_ring.tail) PUT32(UART0_ICR, UART_INT_TX);
+    }
+    PUT32(UART0_ICR, status & ~UART_INT_TX);
+    spin_unlock(&uart_lock);
+
+    // wake up readers
+    if (received)
+    {
+        sync_dataSyncBarrier();
+        sync_sendEvent();
+    }
+}
+
+int uart_start()
+{
+    if (uart_irq_mode) return EEXIST;
+
+    int result = irq_attach(IRQ_UART0, "uart0", uart_isr, nullptr);
+    if (result != EOK) return result;
+
+    uint64_t flags = spin_lock_irqsave(&uart_lock);
+    PUT32(UART0_ICR, 0x7FF);
+    PUT32(UART0_IMSC, UART_INT_RX | UART_INT_TX | UART_INT_RT);
+    uart_irq_mode = true;
+    spin_unlock_irqrestore(&uart_lock, flags);
+
+    return irq_enable(IRQ_UART0);
+}
+
+int uart_write( const uint8_t *data, size_t count )
+{
+    if (data == nullptr) return EARGUMENT;
+    return (int) uart_send(data, count, false);
+}
+
+int uart_read( uint8_t *data, size_t count )
+{
+    if (data == nullptr) return EARGUMENT;
+
+    size_t received = 0;
+    uint64_t flags = spin_lock_irqsave(&uart_lock);
+    if (!uart_irq_mode)
+    {
+        while (received < count && (GET32(UART0_FR) & UART_FR_RXFE) == 0)
+            data[received++] = (uint8_t) GET32(UART0_DR);
+    }
+    else
+    {
+        while (received < count && rx_ring.head != rx_ring.tail)
+        {
+            data[received++] = rx_buffer[rx_ring.tail & (UART_RX_BUFFER_SIZE - 1)];
+            ++rx_ring.tail;
+        }
+    }
+    spin_unlock_irqrestore(&uart_lock, flags);
+    return (int) received;
+}
+
+void uart_flush()
+{
+    uint64_t flags = spin_lock_irqsave(&uart_lock);
+    uart_drain();
+    while ((GET32(UART0_FR) & UART_FR_BUSY) != 0) wait_relax();
+    spin_unlock_irqrestore(&uart_lock, flags);
+}
+
+void uart_putc( uint8_t c )
+{
+    uart_send(&c, 1, true);
+}
+
 void uart_putc2( uint8_t c )
 {
-    while((GET32(UART0_FR) & 0x20) != 0);
-    PUT32(UART0_DR,(uint32_t)c);
+    uart_send(&c, 1, true);
 }
 
 uint8_t uart_getc()
 {
-    while((GET32(UART0_FR) & 0x10) != 0);
-    return (uint8_t) GET32(UART0_DR);
+    uint8_t c;
+    while (uart_read(&c, 1) != 1)
+    {
+        // the IRQ handler sends an event when data arrives
+        wait_relax();
+    }
+    return c;
 }
 
 void uart_puts( const char *str )
 {
     if (str == NULL || *str == 0) return;
-    while (*str != 0)
-    {
-        uart_putc((uint8_t)*str);
-        ++str;
-    }
+    uart_send((const uint8_t*) str, strlen(str), true);
 }
 
 void _putchar( char c )
@@ -106,7 +359,31 @@ void uart_print( const char *format, ... )
 {
 	va_list args;
 
+	// goes through the kernel log, written to the UART asynchronously
 	va_start(args, format);
-	vprintf(format, args);
+	kmsg_vprint(format, args);
 	va_end(args);
-}
\ No newline at end of file
+}
+
+static int proc_uart( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "       Mode: %s\n", uart_irq_mode ? "interrupt" : "polling");
+    sncatprintf(p, ps, "   TX bytes: %lu\n", uart_stats.tx_bytes);
+    sncatprintf(p, ps, "  TX stalls: %lu\n", uart_stats.tx_stalls);
+    sncatprintf(p, ps, "  TX queued: %d/%d\n", tx_ring.head - tx_ring.tail, UART_TX_BUFFER_SIZE);
+    sncatprintf(p, ps, "   RX bytes: %lu\n", uart_stats.rx_bytes);
+    sncatprintf(p, ps, "RX overruns: %lu\n", uart_stats.rx_overruns);
+    sncatprintf(p, ps, " Interrupts: %lu\n", uart_stats.interrupts);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void uart_register()
+{
+    procfs_register("/uart", proc_uart, nullptr);
+}
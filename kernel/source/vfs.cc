@@ -2,16 +2,25 @@
 #include <sys/errors.h>
 #include <mc/string.h>
 #include <sys/heap.h>
+#include <sys/sync.h>
+#include <sys/rcu.h>
+#include <sys/trace.hh>
 #include <mc/string.h>
 
 
 #define MAX_FS_ENTRIES 8
 
 
+/*
+ * Both lists are read without locks (see 'rcu.h'); writers are serialized by
+ * 'vfs_lock'.
+ */
 struct filesystem *fsList;
 
 struct mount *mountList;
 
+static spinlock_t vfs_lock = SPINLOCK_INITIALIZER;
+
 
 int vfs_initialize()
 {
@@ -35,15 +44,21 @@ int vfs_register( struct filesystem *fs )
         fs->ops.unmount != NULL;
     if (!valid) return EINVALID;
 
+    spin_lock(&vfs_lock);
     struct filesystem *p = fsList;
     while (p)
     {
-        if (strcmp(p->type, fs->type) == 0) return EEXIST;
+        if (strcmp(p->type, fs->type) == 0)
+        {
+            spin_unlock(&vfs_lock);
+            return EEXIST;
+        }
         p = p->next;
     }
 
     fs->next = fsList;
-    fsList = fs;
+    rcu_assign_pointer(fsList, fs);
+    spin_unlock(&vfs_lock);
 
     //uart_print("Registered filesystem '%s'\n", fs->type);
 
@@ -55,6 +70,7 @@ int vfs_unregister( const char *type )
 {
     if (type == NULL || type[0] == 0) return EINVALID;
 
+    spin_lock(&vfs_lock);
     struct filesystem *q = NULL;
     struct filesystem *p = fsList;
     while (p)
@@ -62,13 +78,18 @@ int vfs_unregister( const char *type )
         if (strcmp(p->type, type) == 0)
         {
             if (q)
-                q->next = p->next;
+                rcu_assign_pointer(q->next, p->next);
             else
-                fsList = p->next;
+                rcu_assign_pointer(fsList, p->next);
+            spin_unlock(&vfs_lock);
+            // the caller may release the filesystem when we return
+            rcu_synchronize();
             return EOK;
         }
+        q = p;
         p = p->next;
     }
+    spin_unlock(&vfs_lock);
 
     return ENOENT;
 }
@@ -84,12 +105,14 @@ int vfs_mount(
 {
     if (strlen(target) >= MAX_PATH || strlen(source) >= MAX_PATH) return ETOOLONG;
 
-    struct filesystem *fs = fsList;
+    rcu_read_lock();
+    struct filesystem *fs = rcu_dereference(fsList);
     while (fs)
     {
         if (strcmp(fs->type, type) == 0) break;
-        fs = fs->next;
+        fs = rcu_dereference(fs->next);
     }
+    rcu_read_unlock();
     if (fs == NULL) return ENOENT;
 
     struct mount *tmp = (struct mount*) heap_allocate(sizeof(struct mount));
@@ -107,8 +130,10 @@ int vfs_mount(
         return result;
     }
 
+    spin_lock(&vfs_lock);
     tmp->next = mountList;
-    mountList = tmp;
+    rcu_assign_pointer(mountList, tmp);
+    spin_unlock(&vfs_lock);
     if (mp) *mp = tmp;
     return EOK;
 }
@@ -120,23 +145,42 @@ int vfs_unmount( const char *target, uint32_t flags )
 
     if (target == NULL) return EINVALID;
 
+    spin_lock(&vfs_lock);
     struct mount *p = NULL;
     struct mount *m = mountList;
 
-    while (strcmp(m->target, target) == 0)
+    while (m && strcmp(m->target, target) != 0)
     {
         p = m;
         m = m->next;
     }
-    if (m == NULL) return ENOENT;
-
-    int result =  m->fs->ops.unmount(m);
-    if (result < 0) return result;
+    if (m == NULL)
+    {
+        spin_unlock(&vfs_lock);
+        return ENOENT;
+    }
 
-    if (m == mountList)
-        mountList = m->next;
+    // unlink the mount point so new lookups cannot find it
+    if (p)
+        rcu_assign_pointer(p->next, m->next);
     else
-        p->next = m->next;
+        rcu_assign_pointer(mountList, m->next);
+    spin_unlock(&vfs_lock);
+    // lookups still walking the list have taken their references after this
+    rcu_synchronize();
+
+    int result = EBUSY;
+    if (__atomic_load_n(&m->refs, __ATOMIC_ACQUIRE) == 0)
+        result = m->fs->ops.unmount(m);
+    if (result < 0)
+    {
+        // put it back
+        spin_lock(&vfs_lock);
+        m->next = mountList;
+        rcu_assign_pointer(mountList, m);
+        spin_unlock(&vfs_lock);
+        return result;
+    }
 
     heap_free(m);
     return EOK;
@@ -152,7 +196,8 @@ int vfs_lookup( const char *path, struct mount **mp, const char **rest)
     size_t bests = 0;
 
     // find matching mount point
-    struct mount *tmp = mountList;
+    rcu_read_lock();
+    struct mount *tmp = rcu_dereference(mountList);
     while (tmp)
     {
         size_t s = strlen(tmp->target);
@@ -162,8 +207,11 @@ int vfs_lookup( const char *path, struct mount **mp, const char **rest)
             bests = s;
             bestm = tmp;
         }
-        tmp = tmp->next;
+        tmp = rcu_dereference(tmp->next);
     }
+    // the mount point may be released once we leave the read-side section
+    if (bestm) __atomic_fetch_add(&bestm->refs, 1U, __ATOMIC_RELAXED);
+    rcu_read_unlock();
 
     if (bestm == NULL) return ENOENT;
     *rest = path + bests;
@@ -172,6 +220,12 @@ int vfs_lookup( const char *path, struct mount **mp, const char **rest)
 }
 
 
+void vfs_release( struct mount *mp )
+{
+    if (mp) __atomic_fetch_sub(&mp->refs, 1U, __ATOMIC_RELEASE);
+}
+
+
 int vfs_open( const char *path, uint32_t flags, struct file **fp )
 {
     if (path == NULL || path[0] == 0) return EINVALID;
@@ -182,10 +236,14 @@ int vfs_open( const char *path, uint32_t flags, struct file **fp )
     int result = vfs_lookup(path, &mp, &name);
     if (result < 0) return result;
 
-    // create file pointer
+    // create file pointer (it keeps the reference to the mount point)
     struct file *tmp = (struct file *) heap_allocate( sizeof(struct file) + strlen(path) + 1 );
-    if (tmp == NULL) return EMEMORY;
-    memset(tmp, 0, sizeof(tmp));
+    if (tmp == NULL)
+    {
+        vfs_release(mp);
+        return EMEMORY;
+    }
+    memset(tmp, 0, sizeof(*tmp));
     tmp->mp = mp;
     tmp->path = (char*) ((uint8_t*) tmp + sizeof(*tmp));
     strcpy(tmp->path, path);
@@ -194,9 +252,11 @@ int vfs_open( const char *path, uint32_t flags, struct file **fp )
     if (result < 0)
     {
         heap_free(tmp);
+        vfs_release(mp);
         return result;
     }
 
+    trace_event(vfs_open, "vfs_open file=%p result=%d\n", tmp, result);
     *fp = tmp;
     return result;
 }
@@ -204,19 +264,28 @@ int vfs_open( const char *path, uint32_t flags, struct file **fp )
 int vfs_close( struct file *fp )
 {
     if (fp == NULL) return EINVALID;
-    return fp->mp->fs->ops.close(fp);
+    struct mount *mp = fp->mp;
+    int result = mp->fs->ops.close(fp);
+    // allocated by 'vfs_open'
+    heap_free(fp);
+    vfs_release(mp);
+    return result;
 }
 
 int vfs_read( struct file *fp, uint8_t *buffer, size_t count )
 {
     if (fp == NULL || buffer == NULL) return EINVALID;
-    return fp->mp->fs->ops.read(fp, buffer, count);
+    int result = fp->mp->fs->ops.read(fp, buffer, count);
+    trace_event(vfs_read, "vfs_read file=%p count=%lu result=%d\n", fp, count, result);
+    return result;
 }
 
 int vfs_write( struct file *fp, const uint8_t *buffer, size_t count )
 {
     if (fp == NULL) return EINVALID;
-    return fp->mp->fs->ops.write(fp, buffer, count);
+    int result = fp->mp->fs->ops.write(fp, buffer, count);
+    trace_event(vfs_write, "vfs_write file=%p count=%lu result=%d\n", fp, count, result);
+    return result;
 }
 
 int vfs_enumerate( struct file *fp, struct dirent *entry )
@@ -0,0 +1,59 @@
+/*
+ * Sleeping waits.
+ *
+ * Polling loops sleep in 'wfe' instead of spinning. Besides 'sev' and
+ * interrupts, the event stream of the generic timer wakes up the core
+ * periodically, so conditions without any wake up source (like the status of
+ * the mailbox) are still polled with bounded latency. The stream is only
+ * enabled during these waits: the idle loop must sleep until real work
+ * arrives.
+ */
+
+#include <sys/wait.h>
+#include <sys/sync.h>
+#include <sys/fiber.h>
+#include <sys/task.h>
+#include <sys/timer.hh>
+#include <sys/errors.h>
+
+/* Bits of CNTKCTL_EL1 */
+#define CNTKCTL_EVNTEN     (1U << 2)
+#define CNTKCTL_EVNTDIR    (1U << 3)
+#define CNTKCTL_EVNTI(x)   (((uint64_t) (x) & 0xFU) << 4)
+
+static inline void wait_event_stream( bool enable )
+{
+    uint64_t value;
+    __asm__ volatile ("mrs %0, cntkctl_el1" : "=r" (value));
+    value &= ~(CNTKCTL_EVNTI(0xF) | CNTKCTL_EVNTDIR | CNTKCTL_EVNTEN);
+    if (enable) value |= CNTKCTL_EVNTEN | CNTKCTL_EVNTI(WAIT_EVENT_STREAM_BIT);
+    __asm__ volatile ("msr cntkctl_el1, %0" :: "r" (value));
+    __asm__ volatile ("isb" ::: "memory");
+}
+
+void wait_relax()
+{
+    // a caller holding a spin lock (preemption disabled) must not let another
+    // fiber of the core run: it could spin on the same lock
+    if (fiber_current() && task_preemptible())
+    {
+        fiber_yield();
+        return;
+    }
+    wait_event_stream(true);
+    sync_waitEvent();
+    wait_event_stream(false);
+}
+
+int wait_until( wait_cond_t cond, void *arg, uint64_t timeout_us )
+{
+    if (cond == nullptr) return EARGUMENT;
+
+    uint64_t deadline = (timeout_us > 0) ? timer_tick() + timeout_us : 0;
+    while (!cond(arg))
+    {
+        if (deadline && timer_tick() >= deadline) return ETIMEOUT;
+        wait_relax();
+    }
+    return EOK;
+}
@@ -0,0 +1,266 @@
+/*
+ * Deferred work.
+ *
+ * Interrupt handlers should only acknowledge the device and defer the rest of
+ * the processing. Work that can not block goes to the softirq queue of the
+ * core, executed when the IRQ returns; the remaining work goes to a work queue
+ * served by a kernel thread.
+ */
+
+#include <sys/work.h>
+#include <sys/task.h>
+#include <sys/smp.h>
+#include <sys/irq.h>
+#include <sys/sync.h>
+#include <sys/system.h>
+#include <sys/heap.h>
+#include <sys/timer.hh>
+#include <sys/procfs.h>
+#include <sys/errors.h>
+#include <sys/uart.h>
+#include <mc/stdio.h>
+#include <mc/string.h>
+
+#define LOG_TITLE        "<work> "
+
+/*
+ * Maximum amount of softirq work items executed by each IRQ exit. The
+ * remaining items wait for the next IRQ (requested with a self IPI), which
+ * bounds the time spent with IRQs masked.
+ */
+#define SOFTIRQ_BUDGET   16
+
+struct __attribute__((aligned(CACHE_LINE_SIZE))) softirq_core
+{
+    struct work *head;
+    struct work *tail;
+    bool running;  // inside 'softirq_process'
+    struct work_stats stats;
+};
+
+static struct softirq_core cores[SYS_CPU_CORES];
+
+/*
+ * System work queues (one per core).
+ */
+static struct workqueue *system_wq[SYS_CPU_CORES];
+
+static struct workqueue *wq_list = nullptr;
+
+static spinlock_t wq_list_lock = SPINLOCK_INITIALIZER;
+
+static void work_enqueued( struct work_stats &stats )
+{
+    ++stats.queued;
+    if (++stats.backlog > stats.max_backlog) stats.max_backlog = stats.backlog;
+}
+
+static void work_dequeued( struct work_stats &stats, struct work *work )
+{
+    uint64_t latency = timer_tick() - work->queued_at;
+    --stats.backlog;
+    ++stats.executed;
+    stats.total_latency += latency;
+    if (latency > stats.max_latency) stats.max_latency = latency;
+}
+
+static void work_append( struct work *&head, struct work *&tail, struct work *work )
+{
+    work->next = nullptr;
+    if (tail)
+        tail->next = work;
+    else
+        head = work;
+    tail = work;
+}
+
+static struct work *work_pop( struct work *&head, struct work *&tail )
+{
+    struct work *work = head;
+    if (work == nullptr) return nullptr;
+    head = work->next;
+    if (head == nullptr) tail = nullptr;
+    work->next = nullptr;
+    return work;
+}
+
+/*
+ * Mark the item as pending, failing if it already is.
+ */
+static bool work_claim( struct work *work )
+{
+    uint32_t expected = 0;
+    return __atomic_compare_exchange_n(&work->pending, &expected, 1U, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void work_run( struct work *work )
+{
+    // the item may be queued again from its own function
+    __atomic_store_n(&work->pending, 0U, __ATOMIC_RELEASE);
+    work->func(work);
+}
+
+int softirq_raise( struct work *work )
+{
+    if (work == nullptr || work->func == nullptr) return EARGUMENT;
+    if (!work_claim(work)) return EEXIST;
+    work->queued_at = timer_tick();
+
+    // only the current core touches its queue
+    uint64_t flags = sync_saveInterrupts();
+    struct softirq_core &core = cores[smp_core_id()];
+    work_append(core.head, core.tail, work);
+    work_enqueued(core.stats);
+    // no IRQ exit may come soon (e.g. a tickless idle core): run it now
+    if (!irq_context()) softirq_process();
+    sync_restoreInterrupts(flags);
+    return EOK;
+}
+
+void softirq_process()
+{
+    uint32_t id = smp_core_id();
+    struct softirq_core &core = cores[id];
+    // items raised by the work functions are run by the loop below
+    if (core.running) return;
+    core.running = true;
+
+    for (uint32_t i = 0; i < SOFTIRQ_BUDGET && core.head; ++i)
+    {
+        struct work *work = work_pop(core.head, core.tail);
+        work_dequeued(core.stats, work);
+        work_run(work);
+    }
+
+    core.running = false;
+    // the interrupt makes the IRQ exit path run the rest
+    if (core.head) smp_ipi_send(id, IPI_WAKEUP, false);
+}
+
+static void workqueue_main( void *arg )
+{
+    struct workqueue *wq = (struct workqueue*) arg;
+
+    while (true)
+    {
+        // declare the intention to block before checking the queue, so a
+        // concurrent 'task_wake' is not lost
+        task_prepare_block();
+
+        uint64_t flags = spin_lock_irqsave(&wq->lock);
+        struct work *work = work_pop(wq->head, wq->tail);
+        if (work) work_dequeued(wq->stats, work);
+        spin_unlock_irqrestore(&wq->lock, flags);
+
+        if (work == nullptr)
+        {
+            task_block();
+            continue;
+        }
+        task_cancel_block();
+        work_run(work);
+    }
+}
+
+int workqueue_create( const char *name, uint32_t priority, int core, struct workqueue **wq )
+{
+    if (name == nullptr || wq == nullptr) return EARGUMENT;
+    if (strlen(name) >= sizeof((*wq)->name)) return ETOOLONG;
+
+    struct workqueue *tmp = (struct workqueue*) heap_allocate(sizeof(struct workqueue));
+    if (tmp == nullptr) return EMEMORY;
+    memset(tmp, 0, sizeof(*tmp));
+    strcpy(tmp->name, name);
+
+    int result = task_create(name, workqueue_main, tmp, priority, core, &tmp->worker);
+    if (result != EOK)
+    {
+        heap_free(tmp);
+        return result;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&wq_list_lock);
+    tmp->next = wq_list;
+    wq_list = tmp;
+    spin_unlock_irqrestore(&wq_list_lock, flags);
+
+    *wq = tmp;
+    return EOK;
+}
+
+int work_queue( struct workqueue *wq, struct work *work )
+{
+    if (wq == nullptr || work == nullptr || work->func == nullptr) return EARGUMENT;
+    if (!work_claim(work)) return EEXIST;
+    work->queued_at = timer_tick();
+
+    uint64_t flags = spin_lock_irqsave(&wq->lock);
+    work_append(wq->head, wq->tail, work);
+    work_enqueued(wq->stats);
+    spin_unlock_irqrestore(&wq->lock, flags);
+
+    task_wake(wq->worker);
+    return EOK;
+}
+
+int work_schedule( struct work *work )
+{
+    return work_queue(system_wq[smp_core_id()], work);
+}
+
+int work_initialize()
+{
+    memset(cores, 0, sizeof(cores));
+
+    for (uint32_t i = 0; i < SYS_CPU_CORES; ++i)
+    {
+        char name[TASK_MAX_NAME + 1];
+        snprintf(name, sizeof(name), "kworker/%d", i);
+        int result = workqueue_create(name, TASK_PRIO_NORMAL, (int) i, &system_wq[i]);
+        if (result != EOK) return result;
+    }
+
+    uart_print(LOG_TITLE "Created %d system work queues\n", SYS_CPU_CORES);
+    return EOK;
+}
+
+static void proc_work_stats( char *p, size_t ps, const char *name, const struct work_stats &stats )
+{
+    sncatprintf(p, ps, "%-12s  %-10lu  %-10lu  %-7d  %-7d  %-10lu  %-10lu\n",
+        name,
+        stats.queued,
+        stats.executed,
+        stats.backlog,
+        stats.max_backlog,
+        (stats.executed > 0) ? stats.total_latency / stats.executed : 0,
+        stats.max_latency);
+}
+
+static int proc_work( uint8_t *buffer, int size, void * /* data */ )
+{
+    char *p = (char*) buffer;
+    size_t ps = (size_t) size / sizeof(char);
+    // 'sncatprintf' requires a null-terminator
+    p[0] = 0;
+
+    sncatprintf(p, ps, "Queue         Queued      Executed    Backlog  Max      Avg (us)    Max (us)\n");
+    sncatprintf(p, ps, "------------  ----------  ----------  -------  -------  ----------  ----------\n");
+    for (uint32_t i = 0; i < smp_cores(); ++i)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "softirq/%d", i);
+        proc_work_stats(p, ps, name, cores[i].stats);
+    }
+
+    uint64_t flags = spin_lock_irqsave(&wq_list_lock);
+    for (struct workqueue *wq = wq_list; wq; wq = wq->next)
+        proc_work_stats(p, ps, wq->name, wq->stats);
+    spin_unlock_irqrestore(&wq_list_lock, flags);
+
+    return (int) (strlen(p) * sizeof(char));
+}
+
+void work_register()
+{
+    procfs_register("/work", proc_work, nullptr);
+}
@@ -33,7 +33,7 @@ CHAR_TYPE *strcpy( CHAR_TYPE *dst, const CHAR_TYPE *src )
 CHAR_TYPE *strncpy( CHAR_TYPE *dst, const CHAR_TYPE *src, size_t num )
 {
     if (dst == NULL || src == NULL || num == 0) return NULL;
-    while (num-- && *src) { *dst++ = *src++; }
+    for (; num > 0 && *src; --num) { *dst++ = *src++; }
     while (num--) *dst++ = 0;
     return dst;
 }
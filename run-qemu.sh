@@ -1,4 +1,12 @@
 #!/bin/bash
+#
+# Interactive run of a kernel image in QEMU. The emulator binary and machine
+# can be changed with QEMU and QEMU_MACHINE. For headless benchmark runs, see
+# 'tools/qemubench/qemubench.sh'.
+#
+
+QEMU=${QEMU:-qemu-system-aarch64}
+QEMU_MACHINE=${QEMU_MACHINE:-raspi3b}
 
 SERIAL="-serial stdio"
 
@@ -18,6 +26,4 @@ if [ "$1" == "--mon" ]; then
     shift 1
 fi
 
-#/media/dados/github/qemu/build/qemu-system-arm -kernel "$1" -M raspi2 -serial stdio
-/media/dados/github/qemu/build/qemu-system-aarch64 -icount 6 $EXTRA_ARGS -kernel "$1" -M raspi3 $SERIAL
-#/media/dados/github/qemu/build/qemu-system-aarch64 -kernel "$1" -M raspi3 -serial null -serial stdio
+"$QEMU" -icount 6 $EXTRA_ARGS -kernel "$1" -M "$QEMU_MACHINE" $SERIAL
@@ -0,0 +1,348 @@
+/*
+ * Decode the binary kernel log (see 'kernel/include/sys/klog.hh') and the
+ * tracepoint records (see 'kernel/include/sys/trace.hh') from a memory dump,
+ * using the format strings stored in the kernel ELF.
+ *
+ *   klogdump [-f frequency] kernel.elf dump.bin
+ *
+ * The dump may be any range of memory containing the rings (e.g. saved with
+ * 'pmemsave' in the QEMU monitor or 'dump binary memory' in GDB): records are
+ * found by looking for format pointers inside the '.klog' section. Text
+ * records of the kernel log are not decoded.
+ */
+
+#include <elf.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+using namespace std;
+
+
+#define KLOG_MAX_ARGS  6
+
+/*
+ * Must match 'struct trace_record'.
+ */
+struct TraceRecord
+{
+	uint64_t seq;
+	uint64_t format;
+	uint64_t timestamp;
+	uint8_t level;
+	uint8_t core;
+	uint8_t count;
+	uint8_t reserved[5];
+	uint64_t args[KLOG_MAX_ARGS];
+};
+
+/*
+ * Must match the binary records of 'struct kmsg_record' (in 'kmsg.cc'), up to
+ * the arguments.
+ */
+#define KMSG_TYPE_BINARY  1
+
+struct KmsgRecord
+{
+	uint64_t seq;
+	uint64_t timestamp;
+	uint16_t length;
+	uint8_t core;
+	uint8_t type;
+	uint8_t level;
+	uint8_t count;
+	uint8_t reserved[2];
+	uint64_t format;
+	uint64_t args[KLOG_MAX_ARGS];
+};
+
+/*
+ * Decoded record of either kind.
+ */
+struct Record
+{
+	double seconds;
+	uint64_t format;
+	uint8_t level;
+	uint8_t core;
+	uint8_t count;
+	uint64_t args[KLOG_MAX_ARGS];
+};
+
+struct Section
+{
+	string name;
+	uint64_t address;
+	vector<uint8_t> data;
+};
+
+
+static const char *LEVEL_NAMES[] = { "E", "W", "I", "D", "T" };
+
+
+static bool readFile(
+	const string &fileName,
+	vector<uint8_t> &content )
+{
+	ifstream input(fileName.c_str(), ios_base::binary);
+	if (!input.good()) return false;
+	content.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+	return true;
+}
+
+
+static bool loadSections(
+	const vector<uint8_t> &elf,
+	vector<Section> &sections )
+{
+	if (elf.size() < sizeof(Elf64_Ehdr) || memcmp(elf.data(), ELFMAG, SELFMAG) != 0) return false;
+	const Elf64_Ehdr *header = (const Elf64_Ehdr*) elf.data();
+	if (header->e_ident[EI_CLASS] != ELFCLASS64) return false;
+	if (header->e_shoff + (uint64_t) header->e_shnum * sizeof(Elf64_Shdr) > elf.size()) return false;
+
+	const Elf64_Shdr *table = (const Elf64_Shdr*) (elf.data() + header->e_shoff);
+	const Elf64_Shdr &names = table[header->e_shstrndx];
+
+	for (uint32_t i = 0; i < header->e_shnum; ++i)
+	{
+		const Elf64_Shdr &entry = table[i];
+		if ((entry.sh_flags & SHF_ALLOC) == 0 || entry.sh_type != SHT_PROGBITS) continue;
+		if (entry.sh_offset + entry.sh_size > elf.size()) continue;
+
+		Section section;
+		section.name = (const char*) elf.data() + names.sh_offset + entry.sh_name;
+		section.address = entry.sh_addr;
+		section.data.assign(elf.begin() + (long) entry.sh_offset, elf.begin() + (long) (entry.sh_offset + entry.sh_size));
+		sections.push_back(section);
+	}
+	return true;
+}
+
+
+/*
+ * Returns the null-terminated string at the given address of the image.
+ */
+static const char *findString(
+	const vector<Section> &sections,
+	uint64_t address )
+{
+	for (size_t i = 0; i < sections.size(); ++i)
+	{
+		const Section &section = sections[i];
+		if (address < section.address || address >= section.address + section.data.size()) continue;
+		size_t offset = (size_t) (address - section.address);
+		if (memchr(section.data.data() + offset, 0, section.data.size() - offset) == nullptr) return nullptr;
+		return (const char*) section.data.data() + offset;
+	}
+	return nullptr;
+}
+
+
+/*
+ * Same conversion rules used by the kernel in 'klog.cc'.
+ */
+static string format(
+	const vector<Section> &sections,
+	const char *format,
+	const Record &record )
+{
+	string output;
+	uint32_t arg = 0;
+	char buffer[512];
+
+	while (*format)
+	{
+		if (*format != '%')
+		{
+			output += *format++;
+			continue;
+		}
+		if (format[1] == '%')
+		{
+			output += '%';
+			format += 2;
+			continue;
+		}
+
+		string spec(1, *format++);
+		bool wide = false;
+		while (*format && strchr("-+ #0123456789.hlzjt", *format))
+		{
+			if (strchr("lzjt", *format)) wide = true;
+			// the host 'long' is 64 bits too; other modifiers are dropped
+			if (*format != 'h' && *format != 'z' && *format != 'j' && *format != 't') spec += *format;
+			++format;
+		}
+		char conversion = *format;
+		if (conversion == 0) break;
+		++format;
+		if (conversion == 'b') conversion = 'x';
+		spec += conversion;
+
+		uint64_t value = (arg < record.count) ? record.args[arg] : 0;
+		++arg;
+
+		switch (conversion)
+		{
+			case 'd':
+			case 'i':
+				if (wide)
+					snprintf(buffer, sizeof(buffer), spec.c_str(), (long) value);
+				else
+					snprintf(buffer, sizeof(buffer), spec.c_str(), (int) value);
+				break;
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+				if (wide)
+					snprintf(buffer, sizeof(buffer), spec.c_str(), (unsigned long) value);
+				else
+					snprintf(buffer, sizeof(buffer), spec.c_str(), (unsigned) value);
+				break;
+			case 'c':
+				snprintf(buffer, sizeof(buffer), spec.c_str(), (int) value);
+				break;
+			case 's':
+			{
+				const char *text = findString(sections, value);
+				snprintf(buffer, sizeof(buffer), spec.c_str(), text ? text : "(?)");
+				break;
+			}
+			case 'p':
+				snprintf(buffer, sizeof(buffer), "0x%lx", (unsigned long) value);
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			{
+				double number;
+				memcpy(&number, &value, sizeof(number));
+				snprintf(buffer, sizeof(buffer), spec.c_str(), number);
+				break;
+			}
+			default:
+				snprintf(buffer, sizeof(buffer), "%s", spec.c_str());
+		}
+		output += buffer;
+	}
+	return output;
+}
+
+
+static bool compareRecords( const Record &a, const Record &b )
+{
+	return a.seconds < b.seconds;
+}
+
+
+static bool inSection(
+	const Section &section,
+	uint64_t address )
+{
+	return address >= section.address && address < section.address + section.data.size();
+}
+
+
+int main( int argc, char **argv )
+{
+	double frequency = 19200000.0;
+	int first = 1;
+
+	if (argc > 2 && strcmp(argv[1], "-f") == 0)
+	{
+		frequency = atof(argv[2]);
+		first = 3;
+	}
+	if (argc - first != 2 || frequency <= 0)
+	{
+		cerr << "Usage: " << argv[0] << " [-f frequency] kernel.elf dump.bin" << endl;
+		return 1;
+	}
+
+	vector<uint8_t> elf, dump;
+	vector<Section> sections;
+	if (!readFile(argv[first], elf) || !loadSections(elf, sections))
+	{
+		cerr << "Unable to load '" << argv[first] << "'" << endl;
+		return 1;
+	}
+	if (!readFile(argv[first + 1], dump))
+	{
+		cerr << "Unable to load '" << argv[first + 1] << "'" << endl;
+		return 1;
+	}
+
+	const Section *klog = nullptr;
+	for (size_t i = 0; i < sections.size(); ++i)
+		if (sections[i].name == ".klog") klog = &sections[i];
+	if (klog == nullptr)
+	{
+		cerr << "No '.klog' section in '" << argv[first] << "'" << endl;
+		return 1;
+	}
+
+	// published records reference the '.klog' section and have a sane header
+	vector<Record> records;
+	for (size_t offset = 0; offset + sizeof(TraceRecord) <= dump.size(); offset += 8)
+	{
+		Record record;
+		KmsgRecord kmsg;
+		memcpy(&kmsg, dump.data() + offset, sizeof(kmsg));
+		if (kmsg.seq != 0 && kmsg.type == KMSG_TYPE_BINARY && kmsg.level <= 4 && kmsg.count <= KLOG_MAX_ARGS &&
+			inSection(*klog, kmsg.format))
+		{
+			// kernel log timestamps are nanoseconds
+			record.seconds = (double) kmsg.timestamp / 1e9;
+			record.format = kmsg.format;
+			record.level = kmsg.level;
+			record.core = kmsg.core;
+			record.count = kmsg.count;
+			memcpy(record.args, kmsg.args, sizeof(record.args));
+			records.push_back(record);
+			offset += sizeof(KmsgRecord) - 8;
+			continue;
+		}
+
+		TraceRecord trace;
+		memcpy(&trace, dump.data() + offset, sizeof(trace));
+		if (trace.seq == 0 || trace.level > 4 || trace.count > KLOG_MAX_ARGS) continue;
+		if (!inSection(*klog, trace.format)) continue;
+		record.seconds = (double) trace.timestamp / frequency;
+		record.format = trace.format;
+		record.level = trace.level;
+		record.core = trace.core;
+		record.count = trace.count;
+		memcpy(record.args, trace.args, sizeof(record.args));
+		records.push_back(record);
+		offset += sizeof(TraceRecord) - 8;
+	}
+	stable_sort(records.begin(), records.end(), compareRecords);
+
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		const Record &record = records[i];
+		const char *text = findString(sections, record.format);
+		if (text == nullptr) continue;
+
+		char prefix[64];
+		snprintf(prefix, sizeof(prefix), "[%12.6f] %d %s ", record.seconds, record.core, LEVEL_NAMES[record.level]);
+
+		string line = format(sections, text, record);
+		if (line.empty() || line[line.size() - 1] != '\n') line += '\n';
+		cout << prefix << line;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Generate the kernel symbol table (see 'kernel/include/sys/ksyms.h') from the
+# function symbols of a kernel ELF.
+#
+# Usage: ksyms.sh <nm> <kernel.elf> <output.S>
+#
+
+if [ $# -ne 3 ]; then
+    echo "Usage: $0 <nm> <kernel.elf> <output.S>" >&2
+    exit 1
+fi
+
+NM="$1"
+INPUT="$2"
+OUTPUT="$3"
+
+"$NM" -n -C --defined-only "$INPUT" | awk '
+BEGIN {
+    count = 0
+    print "/* Generated by tools/ksyms/ksyms.sh -- do not edit */"
+    print ""
+    print "\t.section .ksyms, \"a\""
+    print "\t.balign 8"
+}
+# function symbols only (mapping symbols like "$x" and local labels are skipped)
+$2 ~ /^[tTwW]$/ {
+    name = substr($0, index($0, " " $2 " ") + 3)
+    if (name ~ /^\$/ || name ~ /^\.L/) next
+    gsub(/\\/, "\\\\", name)
+    gsub(/"/, "\\\"", name)
+    printf "\t.quad 0x%s, .Lksym%d\n", $1, count
+    names[count++] = name
+}
+END {
+    print ""
+    print "\t.section .ksyms.strings, \"a\""
+    for (i = 0; i < count; ++i)
+        printf ".Lksym%d:\n\t.asciz \"%s\"\n", i, names[i]
+}' > "$OUTPUT.tmp" || exit 1
+
+mv "$OUTPUT.tmp" "$OUTPUT"
@@ -0,0 +1,152 @@
+#!/bin/sh
+#
+# Boot a kernel image built with MACHINA_BENCH=ON under QEMU (headless), collect
+# the results of the in-kernel benchmarks from the serial console and compare
+# them with a baseline.
+#
+# Usage: qemubench.sh [options] kernel8.img
+#
+#   -b FILE   baseline (default: tools/qemubench/baseline.txt)
+#   -o FILE   where to write the results (default: qemubench.txt)
+#   -t PCT    median increase flagged as regression (default: 10)
+#   -T SECS   timeout for the benchmark run (default: 600)
+#   -u        replace the baseline with the results
+#
+# Environment: QEMU (default: qemu-system-aarch64), QEMU_MACHINE (default:
+# raspi3b) and QEMU_ICOUNT (default: 4). Instruction counting makes the guest
+# time depend on executed instructions only, so results are repeatable on any
+# host.
+#
+# Results and baseline have one line per benchmark:
+#
+#   <name> <median_ns> <median_cycles> <p99_ns>
+#
+# Exits with 1 if some benchmark regressed and 2 if the run failed.
+#
+
+BASE_DIR=$(cd "$(dirname "$0")" && pwd)
+
+QEMU=${QEMU:-qemu-system-aarch64}
+QEMU_MACHINE=${QEMU_MACHINE:-raspi3b}
+QEMU_ICOUNT=${QEMU_ICOUNT:-4}
+
+BASELINE="$BASE_DIR/baseline.txt"
+RESULTS="qemubench.txt"
+THRESHOLD=10
+TIMEOUT=600
+UPDATE=0
+
+usage()
+{
+    echo "Usage: $0 [-b baseline] [-o results] [-t percent] [-T seconds] [-u] kernel8.img" >&2
+    exit 2
+}
+
+while getopts "b:o:t:T:u" OPTION; do
+    case "$OPTION" in
+        b) BASELINE="$OPTARG" ;;
+        o) RESULTS="$OPTARG" ;;
+        t) THRESHOLD="$OPTARG" ;;
+        T) TIMEOUT="$OPTARG" ;;
+        u) UPDATE=1 ;;
+        *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 1 ] || usage
+IMAGE="$1"
+
+if [ ! -f "$IMAGE" ]; then
+    echo "Kernel image '$IMAGE' not found" >&2
+    exit 2
+fi
+
+LOG=$(mktemp)
+trap 'rm -f "$LOG"' EXIT
+
+# the kernel runs every benchmark at boot and prints "<bench> done" at the end
+"$QEMU" -M "$QEMU_MACHINE" -kernel "$IMAGE" -icount "shift=$QEMU_ICOUNT" \
+    -display none -monitor none -serial stdio > "$LOG" 2>&1 &
+PID=$!
+
+ELAPSED=0
+STATUS=0
+while true; do
+    if grep -q "<bench> done" "$LOG"; then
+        break
+    fi
+    if ! kill -0 $PID 2> /dev/null; then
+        echo "QEMU exited before the benchmarks finished" >&2
+        STATUS=2
+        break
+    fi
+    if [ $ELAPSED -ge "$TIMEOUT" ]; then
+        echo "Timeout after $TIMEOUT seconds" >&2
+        STATUS=2
+        break
+    fi
+    sleep 1
+    ELAPSED=$((ELAPSED + 1))
+done
+kill $PID 2> /dev/null
+wait $PID 2> /dev/null
+
+if [ $STATUS -ne 0 ]; then
+    tail -n 20 "$LOG" >&2
+    exit $STATUS
+fi
+
+# "<bench> name=... median_ns=... median_cycles=... p99_ns=..."
+tr -d '\r' < "$LOG" | awk '
+/<bench> name=/ {
+    name = ""; ns = ""; cycles = ""; p99 = ""
+    for (i = 1; i <= NF; ++i)
+    {
+        split($i, pair, "=")
+        if (pair[1] == "name") name = pair[2]
+        else if (pair[1] == "median_ns") ns = pair[2]
+        else if (pair[1] == "median_cycles") cycles = pair[2]
+        else if (pair[1] == "p99_ns") p99 = pair[2]
+    }
+    if (name != "" && ns != "") print name, ns, cycles, p99
+}' > "$RESULTS"
+
+if [ ! -s "$RESULTS" ]; then
+    echo "No benchmark results in the serial output" >&2
+    exit 2
+fi
+
+if [ $UPDATE -eq 1 ] || [ ! -f "$BASELINE" ]; then
+    [ -f "$BASELINE" ] || echo "No baseline found; creating '$BASELINE'"
+    cp "$RESULTS" "$BASELINE"
+    cat "$RESULTS"
+    exit 0
+fi
+
+awk -v threshold="$THRESHOLD" '
+NR == FNR { base[$1] = $2; next }
+BEGIN {
+    printf "%-20s %14s %14s %9s\n", "Benchmark", "Baseline (ns)", "Current (ns)", "Change"
+}
+{
+    if (!($1 in base) || base[$1] == 0)
+    {
+        printf "%-20s %14s %14d %9s\n", $1, "-", $2, "new"
+        next
+    }
+    change = ($2 - base[$1]) * 100.0 / base[$1]
+    flag = ""
+    if (change > threshold)
+    {
+        flag = "  REGRESSION"
+        ++regressions
+    }
+    printf "%-20s %14d %14d %+8.1f%%%s\n", $1, base[$1], $2, change, flag
+}
+END {
+    if (regressions > 0)
+    {
+        printf "\n%d benchmark(s) regressed more than %s%%\n", regressions, threshold
+        exit 1
+    }
+}' "$BASELINE" "$RESULTS"